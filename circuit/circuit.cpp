@@ -1,18 +1,204 @@
 #include "circuit.h"
 
+#include <QVector>
+
 Circuit::Circuit()
 {
-
+    deviceNode = dependencies.addInput("Device");
 }
 
+/**
+ * @brief Circuit::setParameter changes a parameter and recomputes only the results that depend on it
+ * @param index The parameter
+ * @param value The new value, which invalidates nothing if it is unchanged
+ */
 void Circuit::setParameter(int index, double value)
 {
+    if (parameter[index]->getValue() == value) {
+        return;
+    }
+
     parameter[index]->setValue(value);
 
     update(index);
+    recompute();
 }
 
 double Circuit::getParameter(int index)
 {
     return parameter[index]->getValue();
 }
+
+/**
+ * @brief Circuit::setDevice sets the device and invalidates every result that depends on it
+ * @param newDevice The device
+ */
+void Circuit::setDevice(Device *newDevice)
+{
+    device = newDevice;
+    deviceModelType = device != nullptr ? device->getModelType() : -1;
+    deviceParameters = device != nullptr ? device->getParameterValues() : QVector<double>();
+    dependencies.invalidate(deviceNode);
+
+    recompute();
+}
+
+/**
+ * @brief Circuit::checkDevice invalidates every result that depends on the device if its model has changed
+ *
+ * A device may be refitted, or have another model selected, without being set again, so its model type
+ * and parameters are compared with those it had when the results were last invalidated.
+ */
+void Circuit::checkDevice()
+{
+    if (device == nullptr) {
+        return;
+    }
+
+    int modelType = device->getModelType();
+    QVector<double> parameters = device->getParameterValues();
+    if (modelType != deviceModelType || parameters != deviceParameters) {
+        deviceModelType = modelType;
+        deviceParameters = parameters;
+        dependencies.invalidate(deviceNode);
+    }
+}
+
+/**
+ * @brief Circuit::getDependencies
+ * @return The dependency graph, whose counters show how many recomputations edits have caused and skipped
+ */
+const DependencyGraph &Circuit::getDependencies() const
+{
+    return dependencies;
+}
+
+/**
+ * @brief Circuit::plotCleared checks whether the items drawn by the last plot() are still on the plot
+ * @param plot The plot about to be drawn on
+ * @return true if the plot is a different one or its scene has been cleared (deleting the items) since
+ * the last call, in which case everything must be drawn again
+ */
+bool Circuit::plotCleared(Plot *plot)
+{
+    bool cleared = plot->getScene() != plotScene || plot->getRevision() != plotRevision;
+
+    plotScene = plot->getScene();
+    plotRevision = plot->getRevision();
+
+    return cleared;
+}
+
+/**
+ * @brief Circuit::plot draws the load lines that have changed since the last plot
+ * @param plot The plot
+ * @param device The device
+ *
+ * A load line is only drawn again if a parameter (or the device, including a refit of the same device)
+ * it depends on has changed or the plot has been cleared since it was drawn.
+ */
+void Circuit::plot(Plot *plot, Device *device)
+{
+    if (device != this->device) {
+        setDevice(device);
+    } else {
+        checkDevice();
+    }
+
+    if (plotCleared(plot)) {
+        anodeLoadLine = nullptr;
+        cathodeLoadLine = nullptr;
+        dependencies.invalidate(anodeLineNode);
+        dependencies.invalidate(cathodeLineNode);
+    }
+
+    if (dependencies.needsRecompute(anodeLineNode)) {
+        plotAnodeLoadLine(plot);
+    }
+
+    if (dependencies.needsRecompute(cathodeLineNode)) {
+        plotCathodeLoadLine(plot);
+    }
+
+    recompute();
+}
+
+/**
+ * @brief Circuit::plotLoadLine draws a straight DC load line as anodeLoadLine
+ * @param plot The plot
+ * @param vb The supply voltage
+ * @param r The total resistance in series with the valve, in ohms
+ */
+void Circuit::plotLoadLine(Plot *plot, double vb, double r)
+{
+    QList<QGraphicsItem *> all;
+
+    if (anodeLoadLine != nullptr) {
+        plot->getScene()->removeItem(anodeLoadLine);
+    }
+
+    QPen modelPen;
+    modelPen.setColor(QColor::fromRgb(0, 0, 255));
+
+    double ia = vb * 1000.0 / r;
+
+    all.append(plot->createSegment(0.0, ia, vb, 0, modelPen));
+
+    anodeLoadLine = plot->getScene()->createItemGroup(all);
+}
+
+/**
+ * @brief Circuit::plotBiasLine draws the bias line of a cathode resistor as cathodeLoadLine
+ * @param plot The plot
+ * @param vgOffset The DC grid voltage, relative to the bottom of the cathode resistor
+ * @param rk The cathode resistor in ohms
+ *
+ * With the grid at vgOffset and the cathode at rk * ia, the grid to cathode voltage -vg gives
+ * ia = (vgOffset + vg) / rk (or zero where that is negative). The line is plotted for vg from 0 to
+ * the device's vg1Max, solved in one batch so that each point starts from the previous one.
+ */
+void Circuit::plotBiasLine(Plot *plot, double vgOffset, double rk)
+{
+    QList<QGraphicsItem *> cll;
+
+    if (cathodeLoadLine != nullptr) {
+        plot->getScene()->removeItem(cathodeLoadLine);
+    }
+
+    QPen modelPen;
+    modelPen.setColor(QColor::fromRgb(0, 255, 0));
+
+    double vgMax = device->getVg1Max();
+
+    const int points = 1000;
+    QVector<double> vgPoints(points);
+    QVector<double> iaPoints(points);
+    QVector<double> vaPoints(points);
+    for (int j = 0; j < points; j++) {
+        double vg = vgMax * (j + 1) / 1000.0;
+        vgPoints[j] = -vg;
+        iaPoints[j] = qMax(0.0, vgOffset + vg) * 1000.0 / rk;
+    }
+    device->anodeVoltages(iaPoints.constData(), vgPoints.constData(), nullptr, vaPoints.data(), points);
+
+    for (int j = 1; j < points; j++) {
+        cll.append(plot->createSegment(vaPoints.at(j - 1), iaPoints.at(j - 1), vaPoints.at(j), iaPoints.at(j), modelPen));
+    }
+
+    cathodeLoadLine = plot->getScene()->createItemGroup(cll);
+}
+
+/**
+ * @brief Circuit::recompute solves the operating point if it is stale and there is a device
+ *
+ * The results that do not need a scene are brought up to date here, so that parameter edits take
+ * effect without a plot.
+ */
+void Circuit::recompute()
+{
+    checkDevice();
+
+    if (device != nullptr && dependencies.needsRecompute(operatingPointNode)) {
+        solveOperatingPoint(device);
+    }
+}
@@ -4,10 +4,13 @@
 #include "../model/device.h"
 #include "../ui/plot.h"
 #include "../ui/parameter.h"
+#include "dependencygraph.h"
 
 enum eCircuitType {
     TRIODE_COMMON_CATHODE,
-    PENTODE_COMMON_CATHODE
+    PENTODE_COMMON_CATHODE,
+    TRIODE_AC_CATHODE_FOLLOWER,
+    TRIODE_DC_CATHODE_FOLLOWER
 };
 
 class Circuit : public UIBridge
@@ -15,14 +18,69 @@ class Circuit : public UIBridge
 public:
     Circuit();
 
-    virtual void plot(Plot *plot, Device *device) = 0;
+    virtual void plot(Plot *plot, Device *device);
+    /**
+     * @brief solveOperatingPoint finds the DC operating point (and any results derived from it)
+     * @param device The device
+     * @return true if the solver converged
+     */
+    virtual bool solveOperatingPoint(Device *device) = 0;
     void setParameter(int index, double value);
     double getParameter(int index);
+    void setDevice(Device *newDevice);
+    const DependencyGraph &getDependencies() const;
 
 protected:
     Parameter *parameter[8];
     QGraphicsItemGroup *anodeLoadLine = nullptr;
     QGraphicsItemGroup *cathodeLoadLine = nullptr;
 
+    /**
+     * @brief dependencies The derived results of the circuit and the parameters they depend on
+     */
+    DependencyGraph dependencies;
+    int deviceNode;
+    /**
+     * @brief anodeLineNode The results drawn by plot() and solved by recompute(), added by each circuit
+     */
+    int anodeLineNode = -1;
+    int cathodeLineNode = -1;
+    int operatingPointNode = -1;
+    Device *device = nullptr;
+    /**
+     * @brief deviceModelType The model type of the device when the results depending on it were invalidated
+     */
+    int deviceModelType = -1;
+    /**
+     * @brief deviceParameters The model parameters of the device when the results depending on it were invalidated
+     */
+    QVector<double> deviceParameters;
+
+    bool plotCleared(Plot *plot);
+    void checkDevice();
+    void plotLoadLine(Plot *plot, double vb, double r);
+    void plotBiasLine(Plot *plot, double vgOffset, double rk);
+
+    /**
+     * @brief plotAnodeLoadLine draws the DC load line of the anode circuit into anodeLoadLine
+     */
+    virtual void plotAnodeLoadLine(Plot *plot) = 0;
+    /**
+     * @brief plotCathodeLoadLine draws the bias line of the cathode circuit into cathodeLoadLine
+     */
+    virtual void plotCathodeLoadLine(Plot *plot) = 0;
+
+    /**
+     * @brief update invalidates whatever depends on a parameter that has changed
+     * @param index The parameter
+     */
     virtual void update(int index) = 0;
+    /**
+     * @brief recompute brings the stale results that do not need a scene (e.g. the operating point) up to date
+     */
+    void recompute();
+
+private:
+    QGraphicsScene *plotScene = nullptr;
+    int plotRevision = -1;
 };
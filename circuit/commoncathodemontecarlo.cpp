@@ -0,0 +1,370 @@
+#include "commoncathodemontecarlo.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "stagesolver.h"
+
+/**
+ * @brief MONTE_CARLO_CHUNK The number of trials taken by a thread at a time
+ */
+#define MONTE_CARLO_CHUNK 4096
+
+/**
+ * @brief Tolerance::apply
+ * @param nominal The nominal value
+ * @param random The generator, positioned at the trial being drawn
+ * @return The value drawn for the trial
+ */
+double Tolerance::apply(double nominal, CounterRandom &random) const
+{
+    switch (distribution) {
+    case DISTRIBUTION_UNIFORM:
+        return nominal * (1.0 + spread * (2.0 * random.uniform() - 1.0));
+    case DISTRIBUTION_NORMAL:
+        return nominal * (1.0 + spread * random.normal());
+    default:
+        return nominal;
+    }
+}
+
+CommonCathodeMonteCarlo::CommonCathodeMonteCarlo(Device *device) : device(device)
+{
+    nominal[TRI_CC_VB] = 300.0;
+    nominal[TRI_CC_RK] = 1000.0;
+    nominal[TRI_CC_RA] = 100000.0;
+}
+
+bool CommonCathodeMonteCarlo::addTube(Device *tube)
+{
+    if (tube->getDeviceType() != device->getDeviceType() || tube->getModelType() != device->getModelType()) {
+        qWarning("%s does not have the same model as %s", qPrintable(tube->getName()), qPrintable(device->getName()));
+        return false;
+    }
+
+    tubes.append(tube->getParameterValues());
+
+    return true;
+}
+
+int CommonCathodeMonteCarlo::getTubeCount() const
+{
+    return tubes.size();
+}
+
+void CommonCathodeMonteCarlo::setNominal(int index, double value)
+{
+    if (index >= TRI_CC_VB && index <= TRI_CC_RA) {
+        nominal[index] = value;
+    }
+}
+
+double CommonCathodeMonteCarlo::getNominal(int index) const
+{
+    return nominal[index];
+}
+
+void CommonCathodeMonteCarlo::setTolerance(int index, const Tolerance &newTolerance)
+{
+    if (index >= TRI_CC_VB && index <= TRI_CC_RA) {
+        tolerance[index] = newTolerance;
+    }
+}
+
+void CommonCathodeMonteCarlo::setModelTolerance(int index, const Tolerance &newTolerance)
+{
+    if (index >= 0 && index < MODEL_PARAMETERS) {
+        modelTolerance[index] = newTolerance;
+    }
+}
+
+void CommonCathodeMonteCarlo::setSeed(quint64 newSeed)
+{
+    seed = newSeed;
+}
+
+void CommonCathodeMonteCarlo::setThreadCount(int newThreadCount)
+{
+    threadCount = newThreadCount;
+}
+
+/**
+ * @brief CommonCathodeMonteCarlo::run solves the stage for a number of trials
+ * @param trials The number of trials
+ * @return The number of trials solved
+ *
+ * Every thread solves on its own copy of the device (made through Json, as the models are not
+ * thread safe) with the same model selected, setting the model parameters for each trial. Every
+ * trial starts the solver from the nominal operating point so that its result does not depend on
+ * the trials solved before it.
+ */
+qint64 CommonCathodeMonteCarlo::run(qint64 trials)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int c = 0; c < MC_COLUMNS; c++) {
+        columns[c].assign((size_t) qMax((qint64) 0, trials), 0.0);
+    }
+
+    StageSolver nominalSolver(device);
+    double iaNominal = nominalSolver.solve(0.0, nominal[TRI_CC_VB], nominal[TRI_CC_RA] / 1000.0, 0.0, nominal[TRI_CC_RK] / 1000.0);
+
+    int workers = threadCount > 0 ? threadCount : qMax(1, QThread::idealThreadCount());
+    qint64 chunks = (trials + MONTE_CARLO_CHUNK - 1) / MONTE_CARLO_CHUNK;
+    workers = (int) qMax((qint64) 1, qMin((qint64) workers, chunks));
+
+    QJsonObject modelObject;
+    device->toJson(modelObject);
+    QJsonDocument modelDocument(modelObject);
+
+    QList<Device *> trialDevices;
+    for (int i = 0; i < workers; i++) {
+        Device *trialDevice = new Device(modelDocument);
+        trialDevice->setModelType(device->getModelType()); // The copy starts with its first model
+        trialDevices.append(trialDevice);
+    }
+
+    std::atomic<qint64> nextChunk(0);
+    std::atomic<qint64> totalEvaluations(0);
+    std::atomic<qint64> totalUnconverged(0);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+
+    for (int i = 0; i < workers; i++) {
+        Device *trialDevice = trialDevices.at(i);
+        pool.start([this, trialDevice, trials, chunks, iaNominal, &nextChunk, &totalEvaluations, &totalUnconverged]() {
+            qint64 workerEvaluations = 0;
+            qint64 workerUnconverged = 0;
+            for (qint64 chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) {
+                qint64 first = chunk * MONTE_CARLO_CHUNK;
+                int count = (int) qMin((qint64) MONTE_CARLO_CHUNK, trials - first);
+                solveTrials(trialDevice, first, count, iaNominal, &workerEvaluations, &workerUnconverged);
+            }
+            totalEvaluations += workerEvaluations;
+            totalUnconverged += workerUnconverged;
+        });
+    }
+
+    pool.waitForDone();
+    qDeleteAll(trialDevices);
+
+    evaluations = totalEvaluations;
+    unconverged = totalUnconverged;
+    wallTime = timer.nsecsElapsed() / 1.0e6;
+
+    return trials;
+}
+
+/**
+ * @brief CommonCathodeMonteCarlo::solveTrials solves a run of consecutive trials
+ * @param trialDevice The device to solve on, which is used by this thread only
+ * @param first The index of the first trial
+ * @param count The number of trials
+ * @param iaGuess The anode current to start each solve from, in mA
+ * @param evaluations Receives the number of model evaluations made
+ * @param unconverged Receives the number of trials that did not converge
+ *
+ * For each trial the tube (if there is a set) is drawn first, then the model parameters and then the
+ * supply and resistors, always in the same order. The gain is taken from gm and 1 / rp, the model's
+ * gradient at the operating point: gm * Ra / (1 + Ra / rp) with the cathode bypassed and gm * Ra /
+ * (1 + (Ra + Rk) / rp + gm * Rk) without.
+ */
+void CommonCathodeMonteCarlo::solveTrials(Device *trialDevice, qint64 first, int count, double iaGuess, qint64 *evaluations, qint64 *unconverged)
+{
+    CounterRandom random(seed);
+    StageSolver solver(trialDevice);
+    QVector<double> nominalValues = device->getParameterValues();
+    QVector<double> values = nominalValues;
+
+    for (int i = 0; i < count; i++) {
+        qint64 trial = first + i;
+        size_t row = (size_t) trial;
+        random.setCounter((quint64) trial);
+
+        int tube = -1;
+        if (!tubes.isEmpty()) {
+            tube = qMin((int) (random.uniform() * tubes.size()), tubes.size() - 1);
+        }
+
+        const QVector<double> &base = tube >= 0 ? tubes.at(tube) : nominalValues;
+        for (int p = 0; p < values.size(); p++) {
+            values[p] = modelTolerance[p].apply(base.at(p), random);
+        }
+        trialDevice->setParameterValues(values);
+
+        double vb = tolerance[TRI_CC_VB].apply(nominal[TRI_CC_VB], random);
+        double ra = tolerance[TRI_CC_RA].apply(nominal[TRI_CC_RA], random) / 1000.0;
+        double rk = tolerance[TRI_CC_RK].apply(nominal[TRI_CC_RK], random) / 1000.0;
+
+        double ia = solver.solve(0.0, vb, ra, 0.0, rk, iaGuess);
+        if (!solver.isConverged()) {
+            (*unconverged)++;
+        }
+
+        double vk = rk * ia;
+        double anode = vb - ra * ia;
+        double gp;
+        double gm;
+        trialDevice->anodeCurrentGradient(anode - vk, -vk, 0.0, &gp, &gm);
+
+        columns[MC_VB][row] = vb;
+        columns[MC_RA][row] = ra * 1000.0;
+        columns[MC_RK][row] = rk * 1000.0;
+        columns[MC_TUBE][row] = tube;
+        columns[MC_IA][row] = ia;
+        columns[MC_VA][row] = anode;
+        columns[MC_VK][row] = vk;
+        columns[MC_GAIN][row] = gm * ra / (1.0 + gp * ra);
+        columns[MC_GAIN_UNBYPASSED][row] = gm * ra / (1.0 + gp * (ra + rk) + gm * rk);
+        columns[MC_DISSIPATION][row] = (anode - vk) * ia / 1000.0;
+    }
+
+    *evaluations += solver.getEvaluations() + count;
+}
+
+/**
+ * @brief CommonCathodeMonteCarlo::getTrialCount
+ * @return The number of trials in the last run()
+ */
+qint64 CommonCathodeMonteCarlo::getTrialCount() const
+{
+    return (qint64) columns[0].size();
+}
+
+/**
+ * @brief CommonCathodeMonteCarlo::getColumn
+ * @param column The eMonteCarloColumn
+ * @return The values of the column from the last run(), one per trial
+ */
+const std::vector<double> &CommonCathodeMonteCarlo::getColumn(int column) const
+{
+    return columns[column];
+}
+
+/**
+ * @brief CommonCathodeMonteCarlo::getColumnName
+ * @param column The eMonteCarloColumn
+ * @return The name of the column, with its unit
+ */
+QString CommonCathodeMonteCarlo::getColumnName(int column)
+{
+    switch (column) {
+    case MC_VB:
+        return "vb (V)";
+    case MC_RA:
+        return "ra (ohm)";
+    case MC_RK:
+        return "rk (ohm)";
+    case MC_TUBE:
+        return "tube";
+    case MC_IA:
+        return "ia (mA)";
+    case MC_VA:
+        return "va (V)";
+    case MC_VK:
+        return "vk (V)";
+    case MC_GAIN:
+        return "gain";
+    case MC_GAIN_UNBYPASSED:
+        return "gain unbypassed";
+    case MC_DISSIPATION:
+        return "dissipation (W)";
+    default:
+        return QString();
+    }
+}
+
+/**
+ * @brief CommonCathodeMonteCarlo::getStatistics
+ * @param column The eMonteCarloColumn
+ * @return The mean, standard deviation, extremes and 1st, 50th and 99th percentiles of the column
+ */
+MonteCarloStatistics CommonCathodeMonteCarlo::getStatistics(int column) const
+{
+    MonteCarloStatistics statistics;
+
+    std::vector<double> values = columns[column];
+    size_t n = values.size();
+    if (n == 0) {
+        return statistics;
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += values[i];
+    }
+    statistics.mean = sum / n;
+
+    double squares = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double difference = values[i] - statistics.mean;
+        squares += difference * difference;
+    }
+    statistics.deviation = n > 1 ? std::sqrt(squares / (n - 1)) : 0.0;
+
+    statistics.minimum = *std::min_element(values.begin(), values.end());
+    statistics.maximum = *std::max_element(values.begin(), values.end());
+
+    double *percentiles[] = { &statistics.percentile1, &statistics.median, &statistics.percentile99 };
+    const double fractions[] = { 0.01, 0.5, 0.99 };
+    for (int i = 0; i < 3; i++) {
+        std::vector<double>::iterator nth = values.begin() + (size_t) std::llround(fractions[i] * (n - 1));
+        std::nth_element(values.begin(), nth, values.end());
+        *percentiles[i] = *nth;
+    }
+
+    return statistics;
+}
+
+double CommonCathodeMonteCarlo::getWallTime() const
+{
+    return wallTime;
+}
+
+qint64 CommonCathodeMonteCarlo::getEvaluations() const
+{
+    return evaluations;
+}
+
+qint64 CommonCathodeMonteCarlo::getUnconverged() const
+{
+    return unconverged;
+}
+
+/**
+ * @brief CommonCathodeMonteCarlo::writeCsv writes the result of the last run() as CSV, one row per trial
+ * @param fileName The file to write
+ * @return true if the file was written
+ */
+bool CommonCathodeMonteCarlo::writeCsv(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning("Unable to write %s", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    QTextStream stream(&file);
+    for (int c = 0; c < MC_COLUMNS; c++) {
+        stream << (c > 0 ? "," : "") << getColumnName(c);
+    }
+    stream << "\n";
+
+    for (size_t i = 0; i < columns[0].size(); i++) {
+        for (int c = 0; c < MC_COLUMNS; c++) {
+            stream << (c > 0 ? "," : "") << columns[c][i];
+        }
+        stream << "\n";
+    }
+
+    return true;
+}
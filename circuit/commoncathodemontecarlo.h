@@ -0,0 +1,158 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include <vector>
+
+#include "../model/device.h"
+#include "counterrandom.h"
+#include "triodecommoncathode.h"
+
+enum eDistribution {
+    DISTRIBUTION_NONE,
+    DISTRIBUTION_UNIFORM,
+    DISTRIBUTION_NORMAL
+};
+
+/**
+ * @brief The Tolerance struct
+ *
+ * The spread of one parameter about its nominal value, relative to that value: the half width of a
+ * uniform distribution (so 0.05 for a 5% resistor) or the standard deviation of a normal one.
+ */
+struct Tolerance {
+    int distribution = DISTRIBUTION_NONE;
+    double spread = 0.0;
+
+    double apply(double nominal, CounterRandom &random) const;
+};
+
+/**
+ * @brief The MonteCarloStatistics struct
+ *
+ * A summary of the distribution of one result over the trials of a CommonCathodeMonteCarlo.
+ */
+struct MonteCarloStatistics {
+    double mean = 0.0;
+    double deviation = 0.0;
+    double minimum = 0.0;
+    double percentile1 = 0.0;
+    double median = 0.0;
+    double percentile99 = 0.0;
+    double maximum = 0.0;
+};
+
+/**
+ * @brief The eMonteCarloColumn enum
+ *
+ * The columns of the result of a CommonCathodeMonteCarlo, one row per trial.
+ */
+enum eMonteCarloColumn {
+    MC_VB,
+    MC_RA,
+    MC_RK,
+    MC_TUBE,
+    MC_IA,
+    MC_VA,
+    MC_VK,
+    MC_GAIN,
+    MC_GAIN_UNBYPASSED,
+    MC_DISSIPATION,
+    MC_COLUMNS
+};
+
+/**
+ * @brief The CommonCathodeMonteCarlo class
+ *
+ * Estimates the spread of the bias point and gain of a TriodeCommonCathode stage that is built with
+ * real components. Each trial draws the supply voltage and resistors from their tolerances and draws a
+ * device, either by perturbing the parameters of the nominal model or by picking one of a set of
+ * fitted tubes of the same type (which may also be perturbed), then solves the operating point with a
+ * StageSolver and takes the gain from the model's gradient there.
+ *
+ * Trials are solved in chunks on a thread pool, each thread with its own copy of the device and its
+ * own CounterRandom. The numbers drawn for a trial depend only on the seed and the trial's index, so a
+ * run is reproducible whatever the number of threads.
+ */
+class CommonCathodeMonteCarlo
+{
+public:
+    CommonCathodeMonteCarlo(Device *device);
+
+    /**
+     * @brief addTube adds a fitted tube to the set that trials are drawn from
+     * @param tube A device with the same model type as the nominal device
+     * @return true if the tube was added
+     *
+     * With no tubes, every trial starts from the nominal device.
+     */
+    bool addTube(Device *tube);
+    int getTubeCount() const;
+
+    /**
+     * @brief setNominal
+     * @param index The parameter: TRI_CC_VB, TRI_CC_RK or TRI_CC_RA
+     * @param value Its nominal value, in volts or ohms
+     */
+    void setNominal(int index, double value);
+    double getNominal(int index) const;
+    void setTolerance(int index, const Tolerance &tolerance);
+    /**
+     * @brief setModelTolerance
+     * @param index The model parameter slot (an eTriodeParameter)
+     * @param tolerance The spread of the parameter between tubes
+     */
+    void setModelTolerance(int index, const Tolerance &tolerance);
+    void setSeed(quint64 newSeed);
+    /**
+     * @brief setThreadCount
+     * @param newThreadCount The number of threads, or 0 for one per core
+     */
+    void setThreadCount(int newThreadCount);
+
+    qint64 run(qint64 trials);
+
+    qint64 getTrialCount() const;
+    const std::vector<double> &getColumn(int column) const;
+    static QString getColumnName(int column);
+    MonteCarloStatistics getStatistics(int column) const;
+
+    /**
+     * @brief getWallTime
+     * @return The time in ms taken by the last run()
+     */
+    double getWallTime() const;
+    /**
+     * @brief getEvaluations
+     * @return The number of model evaluations made by the last run()
+     */
+    qint64 getEvaluations() const;
+    /**
+     * @brief getUnconverged
+     * @return The number of trials of the last run() whose operating point did not converge
+     */
+    qint64 getUnconverged() const;
+
+    bool writeCsv(const QString &fileName) const;
+
+private:
+    void solveTrials(Device *trialDevice, qint64 first, int count, double iaGuess, qint64 *evaluations, qint64 *unconverged);
+
+    Device *device;
+    QList<QVector<double>> tubes;
+
+    double nominal[TRI_CC_RA + 1];
+    Tolerance tolerance[TRI_CC_RA + 1];
+    Tolerance modelTolerance[MODEL_PARAMETERS];
+
+    quint64 seed = 1;
+    int threadCount = 0;
+
+    std::vector<double> columns[MC_COLUMNS];
+
+    double wallTime = 0.0;
+    qint64 evaluations = 0;
+    qint64 unconverged = 0;
+};
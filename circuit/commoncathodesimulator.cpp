@@ -0,0 +1,304 @@
+#include "commoncathodesimulator.h"
+
+#include <QElapsedTimer>
+
+#include <cmath>
+
+/**
+ * @brief OVERSAMPLING_TAPS The length of the resampling filters per unit of oversampling
+ */
+#define OVERSAMPLING_TAPS 16
+
+/**
+ * @brief STAGE_STEP_TOLERANCE The Newton step (in mA, relative to 1 + ia) below which the anode current
+ * is accepted
+ *
+ * The error after a Newton step is of the order of the square of the step, so this bounds the error
+ * at around 1e-6 mA, or about -120 dB relative to the signal current of a typical small signal stage.
+ */
+#define STAGE_STEP_TOLERANCE 1.0e-3
+
+/**
+ * @brief CommonCathodeSimulator::CommonCathodeSimulator
+ * @param device The fitted device, whose current model is simulated
+ * @param stage The component values of the stage
+ * @param sampleRate The sample rate of the input and output in Hz
+ * @param oversampling The factor by which the circuit is oversampled, 1 for none
+ */
+CommonCathodeSimulator::CommonCathodeSimulator(Device *device, const CommonCathodeStage &stage, double sampleRate, int oversampling) :
+    device(device), stage(stage), sampleRate(sampleRate), oversampling(qMax(1, oversampling)), solver(device, STAGE_STEP_TOLERANCE)
+{
+    reset();
+}
+
+/**
+ * @brief CommonCathodeSimulator::reset returns the stage to its quiescent state and clears the statistics
+ *
+ * The DC operating point is solved with the capacitors open and the capacitors are charged to it, so
+ * that the simulation starts without a turn-on transient.
+ */
+void CommonCathodeSimulator::reset()
+{
+    double t = 1.0 / (sampleRate * oversampling);
+
+    // Resistances are held in kilohms and conductances in mS so that currents are in mA
+    double ra = stage.ra / 1000.0;
+    double rk = stage.rk / 1000.0;
+
+    gk = stage.ck > 0.0 ? 2.0 * stage.ck / t * 1000.0 : 0.0;
+    rkth = 1.0 / (1.0 / rk + gk);
+
+    if (stage.co > 0.0) {
+        rco = t / (2.0 * stage.co) / 1000.0;
+        ro = stage.rl / 1000.0 + rco;
+        rth = 1.0 / (1.0 / ra + 1.0 / ro);
+    } else {
+        rco = 0.0;
+        ro = 0.0;
+        rth = ra;
+    }
+
+    rci = stage.ci > 0.0 ? t / (2.0 * stage.ci) / 1000.0 : 0.0;
+    gLeak = 1000.0 / stage.rg;
+    couplingScale = 1.0 / (1.0 + rci * gLeak);
+    iSupply = stage.vb / ra;
+
+    StageSolver biasSolver(device);
+    ia = biasSolver.solve(0.0, stage.vb, ra, 0.0, rk);
+    iaPrevious = ia;
+    iaEarlier = ia;
+    biasCurrent = ia;
+    biasCathodeVoltage = rk * ia;
+    biasAnodeVoltage = stage.vb - ra * ia;
+
+    ikHistory = gk * biasCathodeVoltage; // No capacitor current at DC
+    vcoHistory = biasAnodeVoltage;
+    vci = 0.0;
+    iin = 0.0;
+
+    upsampler.design(oversampling);
+    downsampler.design(oversampling);
+    inputSteps.assign(oversampling, 0.0);
+    outputSteps.assign(oversampling, 0.0);
+
+    statistics = SimulationStatistics();
+}
+
+/**
+ * @brief CommonCathodeSimulator::process simulates a block of samples
+ * @param input The input samples, where 1.0 is a grid signal of inputScale volts
+ * @param output Receives the output samples, where 1.0 is outputScale volts (may be the same array as input)
+ * @param count The number of samples
+ *
+ * The output is the AC signal across the load resistor or, without an output coupling capacitor, the
+ * change in anode voltage from its quiescent value. It is not clipped.
+ */
+void CommonCathodeSimulator::process(const float *input, float *output, int count)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < count; i++) {
+        double vin = input[i] * inputScale;
+        double vout;
+
+        if (oversampling == 1) {
+            vout = step(vin);
+        } else {
+            upsampler.interpolate(vin, inputSteps.data());
+            for (int j = 0; j < oversampling; j++) {
+                outputSteps[j] = step(inputSteps[j]);
+            }
+            vout = downsampler.decimate(outputSteps.data());
+        }
+
+        output[i] = (float) (vout / outputScale);
+    }
+
+    statistics.samples += count;
+    statistics.steps += (qint64) count * oversampling;
+    statistics.processingTime += timer.nsecsElapsed() / 1.0e6;
+    if (statistics.processingTime > 0.0) {
+        statistics.realTimeMultiple = (statistics.samples / sampleRate) / (statistics.processingTime / 1000.0);
+    }
+}
+
+/**
+ * @brief CommonCathodeSimulator::step advances the circuit by one (oversampled) step
+ * @param vin The input voltage
+ * @return The output voltage
+ */
+double CommonCathodeSimulator::step(double vin)
+{
+    double vg = vin;
+    if (rci > 0.0) {
+        vci = (vci + rci * (iin + vin * gLeak)) * couplingScale;
+        vg = vin - vci;
+        iin = vg * gLeak;
+    }
+
+    double vh = vcoHistory;
+    double vth = ro > 0.0 ? rth * (iSupply + vh / ro) : stage.vb;
+    double vkth = rkth * ikHistory;
+
+    double iaPredicted = 3.0 * (ia - iaPrevious) + iaEarlier; // Quadratic extrapolation from the last three steps
+    iaEarlier = iaPrevious;
+    iaPrevious = ia;
+    ia = solver.solve(vg, vth, rth, vkth, rkth, iaPredicted);
+    statistics.evaluations += solver.getIterations();
+
+    double vk = vkth + rkth * ia;
+    double va = vth - rth * ia;
+
+    if (gk > 0.0) {
+        ikHistory = 2.0 * gk * vk - ikHistory;
+    }
+
+    if (ro > 0.0) {
+        double rl = stage.rl / 1000.0;
+        double iout = (va - vh) / ro;
+        vcoHistory = va - rl * iout + rco * iout;
+        return rl * iout;
+    }
+
+    return va - biasAnodeVoltage;
+}
+
+void CommonCathodeSimulator::setInputScale(double newInputScale)
+{
+    inputScale = newInputScale;
+}
+
+void CommonCathodeSimulator::setOutputScale(double newOutputScale)
+{
+    outputScale = newOutputScale;
+}
+
+/**
+ * @brief CommonCathodeSimulator::getBiasCurrent
+ * @return The quiescent anode current in mA
+ */
+double CommonCathodeSimulator::getBiasCurrent() const
+{
+    return biasCurrent;
+}
+
+double CommonCathodeSimulator::getBiasAnodeVoltage() const
+{
+    return biasAnodeVoltage;
+}
+
+double CommonCathodeSimulator::getBiasCathodeVoltage() const
+{
+    return biasCathodeVoltage;
+}
+
+int CommonCathodeSimulator::getOversampling() const
+{
+    return oversampling;
+}
+
+const SimulationStatistics &CommonCathodeSimulator::getStatistics() const
+{
+    return statistics;
+}
+
+/**
+ * @brief ResamplingFilter::design designs a Blackman windowed sinc low pass filter
+ * @param factor The oversampling factor
+ *
+ * The cutoff is 90% of the Nyquist frequency of the base sample rate. The taps are normalised to unit
+ * DC gain.
+ */
+void CommonCathodeSimulator::ResamplingFilter::design(int factor)
+{
+    this->factor = factor;
+    length = OVERSAMPLING_TAPS * factor;
+
+    const double pi = 3.14159265358979323846;
+    double cutoff = 0.45 / factor; // In cycles per oversampled step
+    double centre = 0.5 * (length - 1);
+
+    taps.assign(length, 0.0);
+    double sum = 0.0;
+    for (int k = 0; k < length; k++) {
+        double x = k - centre;
+        double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * x) / (pi * x);
+        double window = 0.42 - 0.5 * std::cos(2.0 * pi * k / (length - 1)) + 0.08 * std::cos(4.0 * pi * k / (length - 1));
+        taps[k] = sinc * window;
+        sum += taps[k];
+    }
+    for (int k = 0; k < length; k++) {
+        taps[k] /= sum;
+    }
+
+    // The interpolator uses the taps one phase at a time, so they are also held grouped by phase
+    phaseTaps.assign(length, 0.0);
+    for (int phase = 0; phase < factor; phase++) {
+        for (int j = 0; j < OVERSAMPLING_TAPS; j++) {
+            phaseTaps[phase * OVERSAMPLING_TAPS + j] = factor * taps[phase + j * factor];
+        }
+    }
+
+    reset();
+}
+
+/**
+ * @brief ResamplingFilter::reset clears the filter history
+ *
+ * The history is held twice over so that the most recent values are always contiguous.
+ */
+void CommonCathodeSimulator::ResamplingFilter::reset()
+{
+    history.assign(2 * length, 0.0);
+    position = 0;
+}
+
+/**
+ * @brief ResamplingFilter::interpolate produces factor output values from one input value
+ * @param input The input value
+ * @param output Receives the interpolated values
+ *
+ * Only every factor'th tap meets a non-zero input, so each output phase is a sum over
+ * OVERSAMPLING_TAPS of the most recent inputs.
+ */
+void CommonCathodeSimulator::ResamplingFilter::interpolate(double input, double *output)
+{
+    const int inputs = OVERSAMPLING_TAPS;
+
+    position = position == 0 ? inputs - 1 : position - 1;
+    history[position] = input;
+    history[position + inputs] = input;
+
+    const double *recent = history.data() + position;
+    for (int phase = 0; phase < factor; phase++) {
+        const double *phaseTap = phaseTaps.data() + phase * inputs;
+        double sum = 0.0;
+        for (int j = 0; j < inputs; j++) {
+            sum += phaseTap[j] * recent[j];
+        }
+        output[phase] = sum;
+    }
+}
+
+/**
+ * @brief ResamplingFilter::decimate filters factor input values and returns one output value
+ * @param input The input values, oldest first
+ * @return The filtered value at the last input
+ */
+double CommonCathodeSimulator::ResamplingFilter::decimate(const double *input)
+{
+    for (int i = 0; i < factor; i++) {
+        position = position == 0 ? length - 1 : position - 1;
+        history[position] = input[i];
+        history[position + length] = input[i];
+    }
+
+    const double *recent = history.data() + position;
+    double sum = 0.0;
+    for (int k = 0; k < length; k++) {
+        sum += taps[k] * recent[k];
+    }
+
+    return sum;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <vector>
+
+#include "../model/device.h"
+#include "stagesolver.h"
+
+/**
+ * @brief The CommonCathodeStage struct
+ *
+ * The component values of a triode common cathode stage. Resistances are in ohms and capacitances in
+ * farads, with a capacitance of 0 meaning that the capacitor is absent.
+ */
+struct CommonCathodeStage {
+    /**
+     * @brief vb The supply voltage
+     */
+    double vb = 300.0;
+    double ra = 100000.0;
+    double rk = 1000.0;
+    /**
+     * @brief ck The cathode bypass capacitor, or 0 for an unbypassed cathode resistor
+     */
+    double ck = 0.0;
+    /**
+     * @brief ci The input coupling capacitor, or 0 to drive the grid directly
+     */
+    double ci = 0.0;
+    /**
+     * @brief rg The grid leak resistor, used with the input coupling capacitor
+     */
+    double rg = 1000000.0;
+    /**
+     * @brief co The output coupling capacitor, or 0 to take the output from the anode
+     */
+    double co = 0.0;
+    /**
+     * @brief rl The load resistor after the output coupling capacitor
+     */
+    double rl = 1000000.0;
+};
+
+/**
+ * @brief The SimulationStatistics struct
+ *
+ * The work done by a CommonCathodeSimulator since it was last reset.
+ */
+struct SimulationStatistics {
+    /**
+     * @brief samples The number of input samples processed
+     */
+    qint64 samples = 0;
+    /**
+     * @brief steps The number of circuit steps solved, i.e. samples times the oversampling factor
+     */
+    qint64 steps = 0;
+    /**
+     * @brief evaluations The number of model evaluations made by the stage solver
+     */
+    qint64 evaluations = 0;
+    /**
+     * @brief processingTime The time in ms spent in process()
+     */
+    double processingTime = 0.0;
+    /**
+     * @brief realTimeMultiple The duration of the audio processed divided by the processing time
+     */
+    double realTimeMultiple = 0.0;
+};
+
+/**
+ * @brief The CommonCathodeSimulator class
+ *
+ * Runs a fitted Device as a common cathode stage at audio rate. Blocks of samples (normalised to
+ * +/-1 full scale) are processed in turn with the circuit state carried from one block to the next, so
+ * that a stream of any length can be simulated block by block.
+ *
+ * The capacitors are discretised with the trapezoidal rule, so that at each step the linear parts of
+ * the circuit reduce to a Thevenin source at the anode and at the cathode. The stage equation
+ * ia = f(va - vk, vg - vk) is then solved for the anode current by a StageSolver, starting from the
+ * current extrapolated from the previous three steps (so that one model evaluation is usually enough).
+ * Grid current is not modelled.
+ *
+ * With oversampling the input is interpolated, the circuit is run at the higher rate and the output
+ * is filtered and decimated back to the sample rate, both with windowed sinc filters that together
+ * delay the output by about 16 samples.
+ */
+class CommonCathodeSimulator
+{
+public:
+    CommonCathodeSimulator(Device *device, const CommonCathodeStage &stage, double sampleRate, int oversampling = 1);
+
+    void reset();
+    void process(const float *input, float *output, int count);
+
+    /**
+     * @brief setInputScale
+     * @param newInputScale The grid voltage for a full scale input sample
+     */
+    void setInputScale(double newInputScale);
+    /**
+     * @brief setOutputScale
+     * @param newOutputScale The output voltage that is written as a full scale sample
+     */
+    void setOutputScale(double newOutputScale);
+
+    double getBiasCurrent() const;
+    double getBiasAnodeVoltage() const;
+    double getBiasCathodeVoltage() const;
+    int getOversampling() const;
+    const SimulationStatistics &getStatistics() const;
+
+private:
+    /**
+     * @brief The ResamplingFilter class
+     *
+     * A windowed sinc low pass filter for interpolating or decimating by the oversampling factor.
+     */
+    class ResamplingFilter
+    {
+    public:
+        void design(int factor);
+        void reset();
+        void interpolate(double input, double *output);
+        double decimate(const double *input);
+
+    private:
+        int factor = 1;
+        int length = 0;
+        std::vector<double> taps;
+        /**
+         * @brief phaseTaps The taps of each interpolation phase in turn, scaled by the factor
+         */
+        std::vector<double> phaseTaps;
+        std::vector<double> history;
+        int position = 0;
+    };
+
+    double step(double vin);
+
+    Device *device;
+    CommonCathodeStage stage;
+    double sampleRate;
+    int oversampling;
+    StageSolver solver;
+    double inputScale = 1.0;
+    double outputScale = 100.0;
+
+    /**
+     * @brief The discretised circuit, with resistances in kilohms so that currents are in mA
+     */
+    double rth = 0.0;
+    double rkth = 0.0;
+    double gk = 0.0;
+    double ro = 0.0;
+    double rco = 0.0;
+    double rci = 0.0;
+    /**
+     * @brief gLeak The conductance of the grid leak resistor in mS
+     */
+    double gLeak = 0.0;
+    double couplingScale = 0.0;
+    /**
+     * @brief iSupply The short circuit current of the supply through the anode resistor, in mA
+     */
+    double iSupply = 0.0;
+
+    /**
+     * @brief The circuit state carried from one step to the next
+     */
+    double ia = 0.0;
+    double iaPrevious = 0.0;
+    double iaEarlier = 0.0;
+    double ikHistory = 0.0;
+    double vcoHistory = 0.0;
+    double vci = 0.0;
+    double iin = 0.0;
+
+    double biasCurrent = 0.0;
+    double biasAnodeVoltage = 0.0;
+    double biasCathodeVoltage = 0.0;
+
+    ResamplingFilter upsampler;
+    ResamplingFilter downsampler;
+    std::vector<double> inputSteps;
+    std::vector<double> outputSteps;
+
+    SimulationStatistics statistics;
+};
@@ -0,0 +1,399 @@
+#include "commoncathodesweep.h"
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <atomic>
+#include <cmath>
+
+/**
+ * @brief SWEEP_CHUNK The number of grid points solved together by one task
+ */
+#define SWEEP_CHUNK 4096
+
+/**
+ * @brief SWEEP_ITERATIONS The most Newton iterations used to solve one operating point
+ */
+#define SWEEP_ITERATIONS 50
+
+/**
+ * @brief SWEEP_TOLERANCE The Newton step (in mA, relative to 1 + ia) below which the operating point is accepted
+ */
+#define SWEEP_TOLERANCE 1.0e-9
+
+/**
+ * @brief SWEEP_STEP The step in volts used for the differences that give gm and rp
+ */
+#define SWEEP_STEP 1.0e-3
+
+#define SWEEP_MAGIC 0x43435357 // "CCSW"
+#define SWEEP_VERSION 1
+
+/**
+ * @brief SweepRange::value
+ * @param index The index of the value, from 0 to steps - 1
+ * @return The value
+ */
+double SweepRange::value(int index) const
+{
+    if (steps <= 1) {
+        return start;
+    }
+
+    double fraction = (double) index / (steps - 1);
+    if (logarithmic && start > 0.0 && stop > 0.0) {
+        return start * std::pow(stop / start, fraction);
+    }
+
+    return start + (stop - start) * fraction;
+}
+
+CommonCathodeSweep::CommonCathodeSweep(Device *device) : device(device)
+{
+    ranges[TRI_CC_VB] = { 300.0, 300.0, 1, false };
+    ranges[TRI_CC_RK] = { 1000.0, 1000.0, 1, true };
+    ranges[TRI_CC_RA] = { 100000.0, 100000.0, 1, true };
+}
+
+void CommonCathodeSweep::setRange(int index, const SweepRange &range)
+{
+    if (index >= TRI_CC_VB && index <= TRI_CC_RA) {
+        ranges[index] = range;
+        ranges[index].steps = qMax(1, range.steps);
+    }
+}
+
+const SweepRange &CommonCathodeSweep::getRange(int index) const
+{
+    return ranges[index];
+}
+
+void CommonCathodeSweep::setThreadCount(int newThreadCount)
+{
+    threadCount = newThreadCount;
+}
+
+/**
+ * @brief CommonCathodeSweep::run evaluates the stage at every point of the grid
+ * @return The number of points evaluated
+ */
+qint64 CommonCathodeSweep::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    qint64 points = getPointCount();
+    for (int c = 0; c < SWEEP_COLUMNS; c++) {
+        columns[c].assign((size_t) points, 0.0);
+    }
+
+    int workers = threadCount > 0 ? threadCount : qMax(1, QThread::idealThreadCount());
+    int chunks = (int) ((points + SWEEP_CHUNK - 1) / SWEEP_CHUNK);
+
+    std::atomic<qint64> totalEvaluations(0);
+    std::atomic<qint64> totalUnconverged(0);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+
+    for (int i = 0; i < chunks; i++) {
+        qint64 first = (qint64) i * SWEEP_CHUNK;
+        int count = (int) qMin((qint64) SWEEP_CHUNK, points - first);
+        pool.start([this, first, count, &totalEvaluations, &totalUnconverged]() {
+            qint64 chunkEvaluations = 0;
+            qint64 chunkUnconverged = 0;
+            solveChunk(first, count, &chunkEvaluations, &chunkUnconverged);
+            totalEvaluations += chunkEvaluations;
+            totalUnconverged += chunkUnconverged;
+        });
+    }
+
+    pool.waitForDone();
+
+    evaluations = totalEvaluations;
+    unconverged = totalUnconverged;
+    wallTime = timer.nsecsElapsed() / 1.0e6;
+
+    return points;
+}
+
+/**
+ * @brief CommonCathodeSweep::solveChunk evaluates a run of consecutive grid points
+ * @param first The index of the first point
+ * @param count The number of points
+ * @param evaluations Receives the number of anode current evaluations made
+ * @param unconverged Receives the number of points that did not converge
+ *
+ * With the cathode at rk * ia and the anode at vb - ra * ia, the residual g(ia) = ia - f(vb - (ra + rk)
+ * * ia, -rk * ia) increases with ia and is bracketed by [0, vb / (ra + rk)]. Each iteration evaluates
+ * the residual, and its derivative along the same path by a forward difference, for every unconverged
+ * point in two batch calls; Newton steps that leave a point's bracket are replaced by bisection.
+ *
+ * At the solution, gm and 1 / rp are central differences of the current in the grid and anode voltages.
+ * The gain is gm * Ra / (1 + Ra / rp) with the cathode bypassed and gm * Ra / (1 + (Ra + Rk) / rp +
+ * gm * Rk) without. The headroom is the peak output swing before either cut-off (the anode reaching
+ * the supply) or grid current (the grid swinging past the cathode bias, estimated with the bypassed
+ * gain), whichever comes first.
+ */
+void CommonCathodeSweep::solveChunk(qint64 first, int count, qint64 *evaluations, qint64 *unconverged)
+{
+    std::vector<double> vb(count);
+    std::vector<double> ra(count);
+    std::vector<double> rk(count);
+    std::vector<double> ia(count);
+    std::vector<double> lo(count, 0.0);
+    std::vector<double> hi(count);
+    std::vector<int> active(count);
+
+    std::vector<double> va(2 * count);
+    std::vector<double> vg(2 * count);
+    std::vector<double> current(2 * count);
+
+    int raSteps = ranges[TRI_CC_RA].steps;
+    int rkSteps = ranges[TRI_CC_RK].steps;
+
+    // Resistances are held in kilohms so that currents are in mA
+    for (int i = 0; i < count; i++) {
+        qint64 point = first + i;
+        vb[i] = ranges[TRI_CC_VB].value((int) (point / ((qint64) raSteps * rkSteps)));
+        ra[i] = ranges[TRI_CC_RA].value((int) ((point / rkSteps) % raSteps)) / 1000.0;
+        rk[i] = ranges[TRI_CC_RK].value((int) (point % rkSteps)) / 1000.0;
+        hi[i] = qMax(0.0, vb[i] / (ra[i] + rk[i]));
+        ia[i] = 0.5 * hi[i];
+        active[i] = i;
+    }
+
+    int remaining = count;
+    for (int iteration = 0; iteration < SWEEP_ITERATIONS && remaining > 0; iteration++) {
+        for (int k = 0; k < remaining; k++) {
+            int i = active[k];
+            double delta = 1.0e-7 * (1.0 + ia[i]);
+            va[k] = vb[i] - (ra[i] + rk[i]) * ia[i];
+            vg[k] = -rk[i] * ia[i];
+            va[remaining + k] = va[k] - (ra[i] + rk[i]) * delta;
+            vg[remaining + k] = vg[k] - rk[i] * delta;
+        }
+
+        device->anodeCurrents(va.data(), vg.data(), nullptr, current.data(), 2 * remaining);
+        *evaluations += 2 * remaining;
+
+        int stillActive = 0;
+        for (int k = 0; k < remaining; k++) {
+            int i = active[k];
+            double delta = 1.0e-7 * (1.0 + ia[i]);
+            double residual = ia[i] - current[k];
+
+            if (residual > 0.0) {
+                hi[i] = ia[i];
+            } else {
+                lo[i] = ia[i];
+            }
+
+            double derivative = (ia[i] + delta - current[remaining + k] - residual) / delta;
+            double next = ia[i] - residual / derivative;
+            if (!(next >= lo[i] && next <= hi[i])) {
+                ia[i] = 0.5 * (lo[i] + hi[i]);
+                active[stillActive++] = i;
+                continue;
+            }
+
+            bool converged = std::abs(next - ia[i]) <= SWEEP_TOLERANCE * (1.0 + ia[i]) || hi[i] - lo[i] <= SWEEP_TOLERANCE;
+            ia[i] = next;
+            if (!converged) {
+                active[stillActive++] = i;
+            }
+        }
+        remaining = stillActive;
+    }
+
+    *unconverged += remaining;
+
+    // gm and 1 / rp by central differences about the solution, in one batch
+    for (int i = 0; i < count; i++) {
+        double vak = vb[i] - (ra[i] + rk[i]) * ia[i];
+        double vgk = -rk[i] * ia[i];
+        va[i] = vak;
+        vg[i] = vgk + SWEEP_STEP;
+        va[count + i] = vak;
+        vg[count + i] = vgk - SWEEP_STEP;
+    }
+    device->anodeCurrents(va.data(), vg.data(), nullptr, current.data(), 2 * count);
+    std::vector<double> gm(count);
+    for (int i = 0; i < count; i++) {
+        gm[i] = (current[i] - current[count + i]) / (2.0 * SWEEP_STEP);
+    }
+
+    for (int i = 0; i < count; i++) {
+        va[i] += SWEEP_STEP;
+        vg[i] -= SWEEP_STEP;
+        va[count + i] -= SWEEP_STEP;
+        vg[count + i] += SWEEP_STEP;
+    }
+    device->anodeCurrents(va.data(), vg.data(), nullptr, current.data(), 2 * count);
+    *evaluations += 4 * count;
+
+    double paMax = device->getPaMax();
+    for (int i = 0; i < count; i++) {
+        size_t row = (size_t) (first + i);
+        double gp = (current[i] - current[count + i]) / (2.0 * SWEEP_STEP);
+        double vk = rk[i] * ia[i];
+        double anode = vb[i] - ra[i] * ia[i];
+        double gain = gm[i] * ra[i] / (1.0 + gp * ra[i]);
+        double dissipation = (anode - vk) * ia[i] / 1000.0;
+
+        columns[SWEEP_VB][row] = vb[i];
+        columns[SWEEP_RA][row] = ra[i] * 1000.0;
+        columns[SWEEP_RK][row] = rk[i] * 1000.0;
+        columns[SWEEP_IA][row] = ia[i];
+        columns[SWEEP_VA][row] = anode;
+        columns[SWEEP_VK][row] = vk;
+        columns[SWEEP_GM][row] = gm[i];
+        columns[SWEEP_RP][row] = gp > 0.0 ? 1000.0 / gp : INFINITY;
+        columns[SWEEP_GAIN][row] = gain;
+        columns[SWEEP_GAIN_UNBYPASSED][row] = gm[i] * ra[i] / (1.0 + gp * (ra[i] + rk[i]) + gm[i] * rk[i]);
+        columns[SWEEP_HEADROOM][row] = qMin(vb[i] - anode, gain * vk);
+        columns[SWEEP_DISSIPATION][row] = dissipation;
+        columns[SWEEP_DISSIPATION_RATIO][row] = paMax > 0.0 ? dissipation / paMax : 0.0;
+    }
+}
+
+/**
+ * @brief CommonCathodeSweep::getPointCount
+ * @return The number of points in the grid
+ */
+qint64 CommonCathodeSweep::getPointCount() const
+{
+    return (qint64) ranges[TRI_CC_VB].steps * ranges[TRI_CC_RA].steps * ranges[TRI_CC_RK].steps;
+}
+
+/**
+ * @brief CommonCathodeSweep::getColumn
+ * @param column The eSweepColumn
+ * @return The values of the column from the last run(), one per grid point
+ */
+const std::vector<double> &CommonCathodeSweep::getColumn(int column) const
+{
+    return columns[column];
+}
+
+/**
+ * @brief CommonCathodeSweep::getColumnName
+ * @param column The eSweepColumn
+ * @return The name of the column, with its unit
+ */
+QString CommonCathodeSweep::getColumnName(int column)
+{
+    switch (column) {
+    case SWEEP_VB:
+        return "vb (V)";
+    case SWEEP_RA:
+        return "ra (ohm)";
+    case SWEEP_RK:
+        return "rk (ohm)";
+    case SWEEP_IA:
+        return "ia (mA)";
+    case SWEEP_VA:
+        return "va (V)";
+    case SWEEP_VK:
+        return "vk (V)";
+    case SWEEP_GM:
+        return "gm (mA/V)";
+    case SWEEP_RP:
+        return "rp (ohm)";
+    case SWEEP_GAIN:
+        return "gain";
+    case SWEEP_GAIN_UNBYPASSED:
+        return "gain unbypassed";
+    case SWEEP_HEADROOM:
+        return "headroom (V)";
+    case SWEEP_DISSIPATION:
+        return "dissipation (W)";
+    case SWEEP_DISSIPATION_RATIO:
+        return "dissipation / paMax";
+    default:
+        return QString();
+    }
+}
+
+double CommonCathodeSweep::getWallTime() const
+{
+    return wallTime;
+}
+
+qint64 CommonCathodeSweep::getEvaluations() const
+{
+    return evaluations;
+}
+
+qint64 CommonCathodeSweep::getUnconverged() const
+{
+    return unconverged;
+}
+
+/**
+ * @brief CommonCathodeSweep::save writes the result of the last run() column by column
+ * @param fileName The file to write
+ * @return true if the file was written
+ *
+ * The file holds the number of rows and columns, the column names and then each column in turn as a
+ * contiguous run of doubles, so that a reader can load just the columns it needs.
+ */
+bool CommonCathodeSweep::save(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("Unable to write %s", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << (quint32) SWEEP_MAGIC << (qint32) SWEEP_VERSION;
+    stream << (qint64) columns[0].size() << (qint32) SWEEP_COLUMNS;
+
+    for (int c = 0; c < SWEEP_COLUMNS; c++) {
+        stream << getColumnName(c);
+    }
+
+    for (int c = 0; c < SWEEP_COLUMNS; c++) {
+        const std::vector<double> &column = columns[c];
+        for (size_t i = 0; i < column.size(); i++) {
+            stream << column[i];
+        }
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief CommonCathodeSweep::writeCsv writes the result of the last run() as CSV, one row per point
+ * @param fileName The file to write
+ * @return true if the file was written
+ */
+bool CommonCathodeSweep::writeCsv(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning("Unable to write %s", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    QTextStream stream(&file);
+    for (int c = 0; c < SWEEP_COLUMNS; c++) {
+        stream << (c > 0 ? "," : "") << getColumnName(c);
+    }
+    stream << "\n";
+
+    for (size_t i = 0; i < columns[0].size(); i++) {
+        for (int c = 0; c < SWEEP_COLUMNS; c++) {
+            stream << (c > 0 ? "," : "") << columns[c][i];
+        }
+        stream << "\n";
+    }
+
+    return true;
+}
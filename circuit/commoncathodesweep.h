@@ -0,0 +1,115 @@
+#pragma once
+
+#include <QString>
+
+#include <vector>
+
+#include "../model/device.h"
+#include "triodecommoncathode.h"
+
+/**
+ * @brief The SweepRange struct
+ *
+ * The values taken by one parameter in a sweep: steps values from start to stop inclusive, evenly
+ * spaced or (for resistors, say) spaced by a constant ratio.
+ */
+struct SweepRange {
+    double start = 0.0;
+    double stop = 0.0;
+    int steps = 1;
+    bool logarithmic = false;
+
+    double value(int index) const;
+};
+
+/**
+ * @brief The eSweepColumn enum
+ *
+ * The columns of the result of a CommonCathodeSweep, one row per point of the grid.
+ */
+enum eSweepColumn {
+    SWEEP_VB,
+    SWEEP_RA,
+    SWEEP_RK,
+    SWEEP_IA,
+    SWEEP_VA,
+    SWEEP_VK,
+    SWEEP_GM,
+    SWEEP_RP,
+    SWEEP_GAIN,
+    SWEEP_GAIN_UNBYPASSED,
+    SWEEP_HEADROOM,
+    SWEEP_DISSIPATION,
+    SWEEP_DISSIPATION_RATIO,
+    SWEEP_COLUMNS
+};
+
+/**
+ * @brief The CommonCathodeSweep class
+ *
+ * Evaluates a TriodeCommonCathode stage over every combination of supply voltage, anode resistor and
+ * cathode resistor in a grid, giving for each point the operating point, the small signal parameters
+ * of the device there, the gain with and without a cathode bypass capacitor, the output headroom and
+ * the anode dissipation, also relative to Device::getPaMax().
+ *
+ * The grid is split into chunks that are solved on a thread pool. Within a chunk every point is solved
+ * at once by a safeguarded Newton iteration (as in StageSolver) whose model evaluations are made
+ * through the batch path, Device::anodeCurrents, for all of the points that have not yet converged.
+ * The results are held by column, in grid order with the cathode resistor varying fastest.
+ */
+class CommonCathodeSweep
+{
+public:
+    CommonCathodeSweep(Device *device);
+
+    /**
+     * @brief setRange
+     * @param index The parameter to sweep: TRI_CC_VB, TRI_CC_RA or TRI_CC_RK
+     * @param range Its values, in volts or ohms
+     */
+    void setRange(int index, const SweepRange &range);
+    const SweepRange &getRange(int index) const;
+    /**
+     * @brief setThreadCount
+     * @param newThreadCount The number of chunks solved at once, or 0 for one per core
+     */
+    void setThreadCount(int newThreadCount);
+
+    qint64 run();
+
+    qint64 getPointCount() const;
+    const std::vector<double> &getColumn(int column) const;
+    static QString getColumnName(int column);
+
+    /**
+     * @brief getWallTime
+     * @return The time in ms taken by the last run()
+     */
+    double getWallTime() const;
+    /**
+     * @brief getEvaluations
+     * @return The number of anode current evaluations made by the last run()
+     */
+    qint64 getEvaluations() const;
+    /**
+     * @brief getUnconverged
+     * @return The number of points of the last run() whose operating point did not converge
+     */
+    qint64 getUnconverged() const;
+
+    bool save(const QString &fileName) const;
+    bool writeCsv(const QString &fileName) const;
+
+private:
+    void solveChunk(qint64 first, int count, qint64 *evaluations, qint64 *unconverged);
+
+    Device *device;
+    SweepRange ranges[TRI_CC_RA + 1];
+    int threadCount = 0;
+
+    std::vector<double> columns[SWEEP_COLUMNS];
+
+    double wallTime = 0.0;
+    qint64 evaluations = 0;
+    qint64 unconverged = 0;
+};
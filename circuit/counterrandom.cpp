@@ -0,0 +1,93 @@
+#include "counterrandom.h"
+
+#include <cmath>
+
+/**
+ * @brief PHILOX_ROUNDS The number of rounds, which is the smallest that passes the BigCrush tests
+ */
+#define PHILOX_ROUNDS 10
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+CounterRandom::CounterRandom(quint64 seed)
+{
+    key[0] = (quint32) seed;
+    key[1] = (quint32) (seed >> 32);
+}
+
+void CounterRandom::setCounter(quint64 newTrial)
+{
+    trial = newTrial;
+    block = 0;
+    used = 4;
+    hasSpare = false;
+}
+
+/**
+ * @brief CounterRandom::uniform
+ * @return A number drawn uniformly from the open interval (0, 1), with 53 bits of resolution
+ */
+double CounterRandom::uniform()
+{
+    if (used > 2) {
+        generate();
+    }
+
+    quint32 high = output[used++] >> 5;
+    quint32 low = output[used++] >> 6;
+
+    return (high * 67108864.0 + low + 0.5) / 9007199254740992.0;
+}
+
+/**
+ * @brief CounterRandom::normal
+ * @return A number drawn from the standard normal distribution
+ *
+ * Uses the Box-Muller transform, which gives two independent numbers from two uniform ones; the second
+ * is returned by the next call.
+ */
+double CounterRandom::normal()
+{
+    if (hasSpare) {
+        hasSpare = false;
+        return spare;
+    }
+
+    double radius = std::sqrt(-2.0 * std::log(uniform()));
+    double angle = 2.0 * M_PI * uniform();
+
+    spare = radius * std::sin(angle);
+    hasSpare = true;
+
+    return radius * std::cos(angle);
+}
+
+/**
+ * @brief CounterRandom::generate hashes the counter (trial, block) to the next four outputs
+ */
+void CounterRandom::generate()
+{
+    quint32 counter[4] = { block++, 0, (quint32) trial, (quint32) (trial >> 32) };
+    quint32 roundKey[2] = { key[0], key[1] };
+
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+        quint64 product0 = (quint64) PHILOX_M0 * counter[0];
+        quint64 product1 = (quint64) PHILOX_M1 * counter[2];
+
+        counter[0] = (quint32) (product1 >> 32) ^ counter[1] ^ roundKey[0];
+        counter[1] = (quint32) product1;
+        counter[2] = (quint32) (product0 >> 32) ^ counter[3] ^ roundKey[1];
+        counter[3] = (quint32) product0;
+
+        roundKey[0] += PHILOX_W0;
+        roundKey[1] += PHILOX_W1;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        output[i] = counter[i];
+    }
+    used = 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QtGlobal>
+
+/**
+ * @brief The CounterRandom class
+ *
+ * A counter-based random number generator (Philox4x32-10). Each block of four 32 bit outputs is a
+ * keyed hash of a counter, so that the numbers drawn for one trial depend only on the seed and the
+ * trial's index: a generator per thread gives the same results whichever thread solves each trial and
+ * however many threads there are.
+ */
+class CounterRandom
+{
+public:
+    CounterRandom(quint64 seed = 0);
+
+    /**
+     * @brief setCounter restarts the sequence of numbers for a trial
+     * @param trial The index of the trial
+     */
+    void setCounter(quint64 trial);
+
+    double uniform();
+    double normal();
+
+private:
+    void generate();
+
+    quint32 key[2];
+    quint64 trial = 0;
+    quint32 block = 0;
+
+    quint32 output[4];
+    int used = 4;
+
+    double spare = 0.0;
+    bool hasSpare = false;
+};
@@ -0,0 +1,144 @@
+#include "dependencygraph.h"
+
+DependencyGraph::DependencyGraph()
+{
+
+}
+
+/**
+ * @brief DependencyGraph::addInput
+ * @param name The name of the input, for reporting
+ * @return The node of the input
+ */
+int DependencyGraph::addInput(const QString &name)
+{
+    Node node;
+    node.name = name;
+    node.input = true;
+    nodes.append(node);
+
+    return nodes.size() - 1;
+}
+
+/**
+ * @brief DependencyGraph::addResult
+ * @param name The name of the result, for reporting
+ * @param dependencies The inputs and results it is computed from, all of which must already be in the graph
+ * @return The node of the result, which is stale until it is first computed
+ */
+int DependencyGraph::addResult(const QString &name, const QVector<int> &dependencies)
+{
+    Node node;
+    node.name = name;
+    node.stale = true;
+    nodes.append(node);
+
+    int index = nodes.size() - 1;
+    for (int i = 0; i < dependencies.size(); i++) {
+        nodes[dependencies.at(i)].dependents.append(index);
+    }
+
+    return index;
+}
+
+/**
+ * @brief DependencyGraph::invalidate marks a node and everything that depends on it as stale
+ * @param node The input that has changed, or a result that must be recomputed
+ */
+void DependencyGraph::invalidate(int node)
+{
+    QVector<bool> visited(nodes.size(), false);
+    QVector<int> pending;
+    pending.append(node);
+
+    while (!pending.isEmpty()) {
+        int index = pending.takeLast();
+        if (visited[index]) {
+            continue;
+        }
+        visited[index] = true;
+
+        Node &current = nodes[index];
+        current.stale = !current.input;
+        for (int i = 0; i < current.dependents.size(); i++) {
+            pending.append(current.dependents.at(i));
+        }
+    }
+}
+
+/**
+ * @brief DependencyGraph::isStale
+ * @param node A result
+ * @return true if the result has been invalidated since it was last computed
+ */
+bool DependencyGraph::isStale(int node) const
+{
+    return nodes.at(node).stale;
+}
+
+/**
+ * @brief DependencyGraph::needsRecompute
+ * @param node A result that is about to be used
+ * @return true if the result is stale, in which case the caller must recompute it, it is counted as
+ * recomputed and is marked as up to date; otherwise the recomputation is counted as skipped
+ */
+bool DependencyGraph::needsRecompute(int node)
+{
+    Node &current = nodes[node];
+    if (current.stale) {
+        current.stale = false;
+        current.recomputations++;
+        return true;
+    }
+
+    current.skips++;
+    return false;
+}
+
+int DependencyGraph::getNodeCount() const
+{
+    return nodes.size();
+}
+
+const QString &DependencyGraph::getName(int node) const
+{
+    return nodes.at(node).name;
+}
+
+qint64 DependencyGraph::getRecomputations(int node) const
+{
+    return nodes.at(node).recomputations;
+}
+
+qint64 DependencyGraph::getSkips(int node) const
+{
+    return nodes.at(node).skips;
+}
+
+qint64 DependencyGraph::getTotalRecomputations() const
+{
+    qint64 total = 0;
+    for (int i = 0; i < nodes.size(); i++) {
+        total += nodes.at(i).recomputations;
+    }
+
+    return total;
+}
+
+qint64 DependencyGraph::getTotalSkips() const
+{
+    qint64 total = 0;
+    for (int i = 0; i < nodes.size(); i++) {
+        total += nodes.at(i).skips;
+    }
+
+    return total;
+}
+
+void DependencyGraph::resetCounters()
+{
+    for (int i = 0; i < nodes.size(); i++) {
+        nodes[i].recomputations = 0;
+        nodes[i].skips = 0;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief The DependencyGraph class
+ *
+ * Tracks which derived results of a circuit (load lines, the operating point, ...) are out of date.
+ * Inputs (circuit parameters, the device) and results are nodes; each result names the nodes it is
+ * computed from. Invalidating a node marks every result that depends on it, directly or through other
+ * results, as stale, so that an edit recomputes only what it affects.
+ *
+ * The owner asks needsRecompute() before computing a result, which counts either a recomputation or a
+ * skipped one, so that the counters show how much work the graph saved.
+ */
+class DependencyGraph
+{
+public:
+    DependencyGraph();
+
+    int addInput(const QString &name);
+    int addResult(const QString &name, const QVector<int> &dependencies);
+
+    void invalidate(int node);
+    bool isStale(int node) const;
+    bool needsRecompute(int node);
+
+    int getNodeCount() const;
+    const QString &getName(int node) const;
+    qint64 getRecomputations(int node) const;
+    qint64 getSkips(int node) const;
+    qint64 getTotalRecomputations() const;
+    qint64 getTotalSkips() const;
+    void resetCounters();
+
+private:
+    /**
+     * @brief The Node struct
+     */
+    struct Node {
+        QString name;
+        /**
+         * @brief dependents The results computed directly from this node
+         */
+        QVector<int> dependents;
+        bool input = false;
+        bool stale = false;
+        qint64 recomputations = 0;
+        qint64 skips = 0;
+    };
+
+    QVector<Node> nodes;
+};
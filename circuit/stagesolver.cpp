@@ -0,0 +1,111 @@
+#include "stagesolver.h"
+
+#include <cmath>
+
+/**
+ * @brief STAGE_ITERATIONS The most model evaluations used by one solve
+ */
+#define STAGE_ITERATIONS 50
+
+/**
+ * @brief StageSolver::StageSolver
+ * @param device The device whose current model is solved
+ * @param tolerance The Newton step (in mA, relative to 1 + ia) below which the current is accepted
+ */
+StageSolver::StageSolver(Device *device, double tolerance) :
+    device(device), tolerance(tolerance)
+{
+
+}
+
+/**
+ * @brief StageSolver::solve solves the stage equation for the anode current
+ * @param vg The grid voltage
+ * @param vth The Thevenin voltage at the anode
+ * @param rth The Thevenin resistance at the anode, in kilohms
+ * @param vkth The Thevenin voltage at the cathode
+ * @param rkth The Thevenin resistance at the cathode, in kilohms
+ * @param ia The anode current to start from, in mA
+ * @return The anode current in mA, or 0 if the supply does not exceed the cathode voltage
+ *
+ * The solution is accepted after the first Newton step smaller than the tolerance. As the error after
+ * a Newton step is of the order of the square of the step, the accepted current is usually far more
+ * accurate than the tolerance. A bisection step is never accepted, however small.
+ */
+double StageSolver::solve(double vg, double vth, double rth, double vkth, double rkth, double ia)
+{
+    iterations = 0;
+    converged = false;
+
+    double lo = 0.0;
+    double hi = (vth - vkth) / (rth + rkth);
+    if (!(hi > 0.0) || device == nullptr) {
+        converged = true;
+        return 0.0;
+    }
+
+    ia = qBound(lo, ia, hi);
+
+    while (iterations < STAGE_ITERATIONS) {
+        double vk = vkth + rkth * ia;
+        double va = vth - rth * ia;
+
+        double dIaDva;
+        double dIaDvg1;
+        double residual = ia - device->anodeCurrentGradient(va - vk, vg - vk, 0.0, &dIaDva, &dIaDvg1);
+        iterations++;
+
+        if (residual > 0.0) {
+            hi = ia;
+        } else {
+            lo = ia;
+        }
+
+        double derivative = 1.0 + (rth + rkth) * dIaDva + rkth * dIaDvg1;
+        double next = ia - residual / derivative;
+        if (!(next >= lo && next <= hi)) {
+            ia = 0.5 * (lo + hi);
+            continue;
+        }
+
+        converged = std::abs(next - ia) <= tolerance * (1.0 + ia);
+        ia = next;
+        if (converged) {
+            break;
+        }
+    }
+
+    evaluations += iterations;
+
+    return ia;
+}
+
+void StageSolver::setDevice(Device *newDevice)
+{
+    device = newDevice;
+}
+
+void StageSolver::setTolerance(double newTolerance)
+{
+    tolerance = newTolerance;
+}
+
+int StageSolver::getIterations() const
+{
+    return iterations;
+}
+
+bool StageSolver::isConverged() const
+{
+    return converged;
+}
+
+qint64 StageSolver::getEvaluations() const
+{
+    return evaluations;
+}
+
+void StageSolver::resetEvaluations()
+{
+    evaluations = 0;
+}
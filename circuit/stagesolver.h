@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include "../model/device.h"
+
+/**
+ * @brief The StageSolver class
+ *
+ * Solves for the anode current of a triode whose anode and cathode each see a linear circuit, reduced
+ * to a Thevenin source: va = vth - rth * ia at the anode and vk = vkth + rkth * ia at the cathode
+ * (resistances in kilohms, currents in mA). This covers the DC operating point of common cathode and
+ * cathode follower stages (with the capacitors open) and, with the capacitors replaced by their
+ * companion models, each time step of a transient simulation.
+ *
+ * The residual ia - f(va - vk, vg - vk) increases with ia, is negative at ia = 0 and is positive where
+ * the anode reaches the cathode, which brackets the root. It is solved by Newton's method on the
+ * analytic gradient of the model, with steps that leave the bracket replaced by bisection, so that it
+ * converges from any starting current and, from a good one, in one or two model evaluations.
+ */
+class StageSolver
+{
+public:
+    StageSolver(Device *device = nullptr, double tolerance = 1.0e-9);
+
+    double solve(double vg, double vth, double rth, double vkth, double rkth, double ia = 0.0);
+
+    void setDevice(Device *newDevice);
+    /**
+     * @brief setTolerance
+     * @param newTolerance The Newton step (in mA, relative to 1 + ia) below which the current is accepted
+     */
+    void setTolerance(double newTolerance);
+
+    /**
+     * @brief getIterations
+     * @return The number of model evaluations made by the last solve()
+     */
+    int getIterations() const;
+    /**
+     * @brief isConverged
+     * @return true if the last solve() met the tolerance within its iteration limit
+     */
+    bool isConverged() const;
+    /**
+     * @brief getEvaluations
+     * @return The number of model evaluations made by every solve() since the last resetEvaluations()
+     */
+    qint64 getEvaluations() const;
+    void resetEvaluations();
+
+private:
+    Device *device;
+    double tolerance;
+
+    int iterations = 0;
+    bool converged = false;
+    qint64 evaluations = 0;
+};
@@ -1,6 +1,124 @@
 #include "triodeaccathodefollower.h"
+#include "stagesolver.h"
+
+#include <cmath>
 
 TriodeACCathodeFollower::TriodeACCathodeFollower()
 {
+    parameter[TRI_ACCF_VB] = new Parameter("Supply Voltage:", 300.0);
+    parameter[TRI_ACCF_RK] = new Parameter("Bias Resistor:", 1000.0);
+    parameter[TRI_ACCF_RA] = new Parameter("Anode Resistor:", 0.0);
+    parameter[TRI_ACCF_RL] = new Parameter("Cathode Load Resistor:", 47000.0);
+    parameter[TRI_ACCF_IA] = new Parameter("Anode Current:", 0.0);
+    parameter[TRI_ACCF_VK] = new Parameter("Cathode Voltage:", 0.0);
+    parameter[TRI_ACCF_ZO] = new Parameter("Output Impedance:", 0.0);
+    parameter[TRI_ACCF_HEADROOM] = new Parameter("Headroom (Vpk):", 0.0);
+
+    vbNode = dependencies.addInput("Supply Voltage");
+    rkNode = dependencies.addInput("Bias Resistor");
+    raNode = dependencies.addInput("Anode Resistor");
+    rlNode = dependencies.addInput("Cathode Load Resistor");
+    anodeLineNode = dependencies.addResult("Anode Load Line", { vbNode, raNode, rkNode, rlNode });
+    cathodeLineNode = dependencies.addResult("Cathode Load Line", { rkNode, deviceNode });
+    operatingPointNode = dependencies.addResult("Operating Point", { vbNode, raNode, rkNode, rlNode, deviceNode });
+}
+
+void TriodeACCathodeFollower::updateUI(QLabel *labels[], QLineEdit *values[])
+{
+    for (int i = 0; i <= TRI_ACCF_HEADROOM; i++) {
+        updateParameter(labels[i], values[i], parameter[i]);
+    }
+}
+
+/**
+ * @brief TriodeACCathodeFollower::plotAnodeLoadLine draws the DC load line, in terms of the anode to
+ * cathode voltage, which sees all three resistors in series
+ */
+void TriodeACCathodeFollower::plotAnodeLoadLine(Plot *plot)
+{
+    double r = parameter[TRI_ACCF_RA]->getValue() + parameter[TRI_ACCF_RK]->getValue() + parameter[TRI_ACCF_RL]->getValue();
+
+    plotLoadLine(plot, parameter[TRI_ACCF_VB]->getValue(), r);
+}
+
+/**
+ * @brief TriodeACCathodeFollower::plotCathodeLoadLine draws the bias line vg = -rk * ia
+ */
+void TriodeACCathodeFollower::plotCathodeLoadLine(Plot *plot)
+{
+    plotBiasLine(plot, 0.0, parameter[TRI_ACCF_RK]->getValue());
+}
+
+/**
+ * @brief TriodeACCathodeFollower::solveOperatingPoint finds the DC operating point, output impedance
+ * and headroom of the stage
+ * @param device The device
+ * @return true if the solver converged
+ *
+ * Relative to the grid (at Rl * ia) the cathode is at Rk * ia and the anode at vb - (Ra + Rl) * ia,
+ * which a StageSolver solves directly. The output impedance is that of the cathode, (rp + Ra) / (mu +
+ * 1), in parallel with Rk + Rl. The output can swing down by the cathode voltage before the valve cuts
+ * off and up until the grid reaches the cathode, where the current is found by a second solve with the
+ * grid and cathode tied; the headroom is the smaller of the two, or zero if the grid is already positive.
+ */
+bool TriodeACCathodeFollower::solveOperatingPoint(Device *device)
+{
+    double vb = parameter[TRI_ACCF_VB]->getValue();
+    double ra = parameter[TRI_ACCF_RA]->getValue() / 1000.0;
+    double rk = parameter[TRI_ACCF_RK]->getValue() / 1000.0;
+    double rl = parameter[TRI_ACCF_RL]->getValue() / 1000.0;
+    double r = rk + rl;
+
+    StageSolver solver(device);
+    double ia = solver.solve(0.0, vb, ra + rl, 0.0, rk, parameter[TRI_ACCF_IA]->getValue());
+    bool converged = solver.isConverged();
+    operatingPointIterations = solver.getIterations();
+
+    double vk = ia * r;
+    double gp;
+    double gm;
+    device->anodeCurrentGradient(vb - ia * (ra + r), -ia * rk, 0.0, &gp, &gm);
+    double zk = gp + gm > 0.0 ? (1.0 + gp * ra) / (gp + gm) : INFINITY;
+    double zo = std::isinf(zk) ? r : zk * r / (zk + r);
 
+    double iaSaturation = solver.solve(0.0, vb, ra + r, 0.0, 0.0, ia);
+    converged = converged && solver.isConverged();
+    operatingPointIterations += solver.getIterations();
+
+    parameter[TRI_ACCF_IA]->setValue(ia);
+    parameter[TRI_ACCF_VK]->setValue(vk);
+    parameter[TRI_ACCF_ZO]->setValue(zo * 1000.0);
+    parameter[TRI_ACCF_HEADROOM]->setValue(qMax(0.0, qMin(vk, (iaSaturation - ia) * r)));
+
+    return converged;
 }
+
+/**
+ * @brief TriodeACCathodeFollower::getOperatingPointIterations
+ * @return The number of model evaluations made by the last solveOperatingPoint()
+ */
+int TriodeACCathodeFollower::getOperatingPointIterations() const
+{
+    return operatingPointIterations;
+}
+
+void TriodeACCathodeFollower::update(int index)
+{
+    switch (index) {
+    case TRI_ACCF_VB:
+        dependencies.invalidate(vbNode);
+        break;
+    case TRI_ACCF_RK:
+        dependencies.invalidate(rkNode);
+        break;
+    case TRI_ACCF_RA:
+        dependencies.invalidate(raNode);
+        break;
+    case TRI_ACCF_RL:
+        dependencies.invalidate(rlNode);
+        break;
+    default: // Results of the operating point, which nothing depends on
+        break;
+    }
+}
+
@@ -2,8 +2,48 @@
 
 #include "circuit.h"
 
+enum eTriodeACCathodeFollowerParameter {
+    TRI_ACCF_VB,
+    TRI_ACCF_RK,
+    TRI_ACCF_RA,
+    TRI_ACCF_RL,
+    TRI_ACCF_IA,
+    TRI_ACCF_VK,
+    TRI_ACCF_ZO,
+    TRI_ACCF_HEADROOM
+};
+
+/**
+ * @brief The TriodeACCathodeFollower class
+ *
+ * A capacitively coupled cathode follower that biases itself: the cathode returns to ground through the
+ * bias resistor Rk and the load resistor Rl in series, and the grid leak returns to their junction, so
+ * the grid sits Rk * ia below the cathode. The output is taken from the cathode. The anode resistor Ra
+ * may be zero.
+ */
 class TriodeACCathodeFollower : public Circuit
 {
 public:
     TriodeACCathodeFollower();
+
+    virtual void updateUI(QLabel *labels[], QLineEdit *values[]);
+
+    virtual bool solveOperatingPoint(Device *device);
+    int getOperatingPointIterations() const;
+
+protected:
+    /**
+     * @brief operatingPointIterations The number of model evaluations made by the last solveOperatingPoint()
+     */
+    int operatingPointIterations = 0;
+
+    int vbNode;
+    int rkNode;
+    int raNode;
+    int rlNode;
+
+    virtual void plotAnodeLoadLine(Plot *plot);
+    virtual void plotCathodeLoadLine(Plot *plot);
+
+    virtual void update(int index);
 };
@@ -1,4 +1,5 @@
 #include "triodecommoncathode.h"
+#include "stagesolver.h"
 
 TriodeCommonCathode::TriodeCommonCathode()
 {
@@ -7,6 +8,13 @@ TriodeCommonCathode::TriodeCommonCathode()
     parameter[TRI_CC_RA] = new Parameter("Anode Resistor:", 100000.0);
     parameter[TRI_CC_IA] = new Parameter("Anode Current:", 0.0);
     parameter[TRI_CC_VK] = new Parameter("Bias Point (Vk):", 0.0);
+
+    vbNode = dependencies.addInput("Supply Voltage");
+    rkNode = dependencies.addInput("Cathode Resistor");
+    raNode = dependencies.addInput("Anode Resistor");
+    anodeLineNode = dependencies.addResult("Anode Load Line", { vbNode, raNode });
+    cathodeLineNode = dependencies.addResult("Cathode Load Line", { rkNode, deviceNode });
+    operatingPointNode = dependencies.addResult("Operating Point", { vbNode, raNode, rkNode, deviceNode });
 }
 
 void TriodeCommonCathode::updateUI(QLabel *labels[], QLineEdit *values[])
@@ -16,78 +24,63 @@ void TriodeCommonCathode::updateUI(QLabel *labels[], QLineEdit *values[])
     }
 }
 
-void TriodeCommonCathode::plot(Plot *plot, Device *device)
+void TriodeCommonCathode::plotAnodeLoadLine(Plot *plot)
 {
-    QList<QGraphicsItem *> all;
-    QList<QGraphicsItem *> cll;
-
-    if (anodeLoadLine != nullptr) {
-        plot->getScene()->removeItem(anodeLoadLine);
-    }
-
-    if (cathodeLoadLine != nullptr) {
-        plot->getScene()->removeItem(cathodeLoadLine);
-    }
+    plotLoadLine(plot, parameter[TRI_CC_VB]->getValue(), parameter[TRI_CC_RA]->getValue());
+}
 
-    QPen modelPen;
-    modelPen.setColor(QColor::fromRgb(0, 0, 255));
+void TriodeCommonCathode::plotCathodeLoadLine(Plot *plot)
+{
+    plotBiasLine(plot, 0.0, parameter[TRI_CC_RK]->getValue());
+}
 
+/**
+ * @brief TriodeCommonCathode::solveOperatingPoint finds the DC operating point of the stage
+ * @param device The device
+ * @return true if the solver converged
+ *
+ * Sets TRI_CC_IA and TRI_CC_VK to the intersection of the anode load line va = vb - ra * ia with the
+ * cathode resistor line vg = -rk * ia, which is solved directly by a StageSolver (starting from the
+ * current operating point) rather than found on the plotted load lines, so that no scene is needed.
+ */
+bool TriodeCommonCathode::solveOperatingPoint(Device *device)
+{
     double vb = parameter[TRI_CC_VB]->getValue();
     double ra = parameter[TRI_CC_RA]->getValue();
     double rk = parameter[TRI_CC_RK]->getValue();
 
-    double ia = vb * 1000.0 / ra;
-
-    all.append(plot->createSegment(0.0, ia, vb, 0, modelPen));
+    StageSolver solver(device);
+    double ia = solver.solve(0.0, vb, ra / 1000.0, 0.0, rk / 1000.0, parameter[TRI_CC_IA]->getValue());
+    operatingPointIterations = solver.getIterations();
 
-    anodeLoadLine = plot->getScene()->createItemGroup(all);
+    parameter[TRI_CC_IA]->setValue(ia);
+    parameter[TRI_CC_VK]->setValue(ia * rk / 1000.0);
 
-    modelPen.setColor(QColor::fromRgb(0, 255, 0));
-
-    double vaBias = 0.0;
-    double vgBias = 0.0;
-    double iaBias = 0.0;
-
-    double vgMax = device->getVg1Max();
-
-    double iaMinErr = device->getIaMax();
-    double vg = vgMax / 1000.0;
-    ia = vg * 1000.0 / rk;
-    double va = device->anodeVoltage(ia, -vg);;
-    for (int j = 2; j < 1001; j++) {
-        vg = vgMax * j / 1000.0;
-        double iaNext = vg * 1000.0 / rk;
-        double vaNext = device->anodeVoltage(iaNext, -vg);
-        cll.append(plot->createSegment(va, ia, vaNext, iaNext, modelPen));
-        ia = iaNext;
-        va = vaNext;
-
-        double iaLoadLine = (vb - va) * 1000.0 / ra;
-        double iaErr = abs(iaLoadLine - ia);
-        if (iaErr < iaMinErr) {
-            iaMinErr = iaErr;
-            vaBias = va;
-            vgBias = vg;
-            iaBias = ia;
-        }
-    }
-
-    parameter[TRI_CC_VK]->setValue(vgBias);
-    parameter[TRI_CC_IA]->setValue(iaBias);
+    return solver.isConverged();
+}
 
-    cathodeLoadLine = plot->getScene()->createItemGroup(cll);
+/**
+ * @brief TriodeCommonCathode::getOperatingPointIterations
+ * @return The number of model evaluations made by the last solveOperatingPoint()
+ */
+int TriodeCommonCathode::getOperatingPointIterations() const
+{
+    return operatingPointIterations;
 }
 
 void TriodeCommonCathode::update(int index)
 {
     switch (index) {
     case TRI_CC_VB:
+        dependencies.invalidate(vbNode);
         break;
     case TRI_CC_RK:
+        dependencies.invalidate(rkNode);
         break;
     case TRI_CC_RA:
+        dependencies.invalidate(raNode);
         break;
-    case TRI_CC_IA:
+    case TRI_CC_IA: // Results of the operating point, which nothing depends on
         break;
     case TRI_CC_VK:
         break;
@@ -95,3 +88,4 @@ void TriodeCommonCathode::update(int index)
         break;
     }
 }
+
@@ -16,9 +16,22 @@ public:
     TriodeCommonCathode();
 
     virtual void updateUI(QLabel *labels[], QLineEdit *values[]);
-    virtual void plot(Plot *plot, Device *device);
+
+    virtual bool solveOperatingPoint(Device *device);
+    int getOperatingPointIterations() const;
 
 protected:
+    /**
+     * @brief operatingPointIterations The number of model evaluations made by the last solveOperatingPoint()
+     */
+    int operatingPointIterations = 0;
+
+    int vbNode;
+    int rkNode;
+    int raNode;
+
+    virtual void plotAnodeLoadLine(Plot *plot);
+    virtual void plotCathodeLoadLine(Plot *plot);
 
     virtual void update(int index);
 };
@@ -1,6 +1,123 @@
 #include "triodedccathodefollower.h"
+#include "stagesolver.h"
+
+#include <cmath>
 
 TriodeDCCathodeFollower::TriodeDCCathodeFollower()
 {
+    parameter[TRI_DCCF_VB] = new Parameter("Supply Voltage:", 300.0);
+    parameter[TRI_DCCF_VG] = new Parameter("Grid Voltage:", 150.0);
+    parameter[TRI_DCCF_RK] = new Parameter("Cathode Resistor:", 100000.0);
+    parameter[TRI_DCCF_RA] = new Parameter("Anode Resistor:", 0.0);
+    parameter[TRI_DCCF_IA] = new Parameter("Anode Current:", 0.0);
+    parameter[TRI_DCCF_VK] = new Parameter("Cathode Voltage:", 0.0);
+    parameter[TRI_DCCF_ZO] = new Parameter("Output Impedance:", 0.0);
+    parameter[TRI_DCCF_HEADROOM] = new Parameter("Headroom (Vpk):", 0.0);
+
+    vbNode = dependencies.addInput("Supply Voltage");
+    vgNode = dependencies.addInput("Grid Voltage");
+    rkNode = dependencies.addInput("Cathode Resistor");
+    raNode = dependencies.addInput("Anode Resistor");
+    anodeLineNode = dependencies.addResult("Anode Load Line", { vbNode, raNode, rkNode });
+    cathodeLineNode = dependencies.addResult("Cathode Load Line", { vgNode, rkNode, deviceNode });
+    operatingPointNode = dependencies.addResult("Operating Point", { vbNode, vgNode, raNode, rkNode, deviceNode });
+}
+
+void TriodeDCCathodeFollower::updateUI(QLabel *labels[], QLineEdit *values[])
+{
+    for (int i = 0; i <= TRI_DCCF_HEADROOM; i++) {
+        updateParameter(labels[i], values[i], parameter[i]);
+    }
+}
+
+/**
+ * @brief TriodeDCCathodeFollower::plotAnodeLoadLine draws the DC load line, in terms of the anode to
+ * cathode voltage, which sees the anode and cathode resistors in series
+ */
+void TriodeDCCathodeFollower::plotAnodeLoadLine(Plot *plot)
+{
+    double r = parameter[TRI_DCCF_RA]->getValue() + parameter[TRI_DCCF_RK]->getValue();
+
+    plotLoadLine(plot, parameter[TRI_DCCF_VB]->getValue(), r);
+}
+
+/**
+ * @brief TriodeDCCathodeFollower::plotCathodeLoadLine draws the bias line vg - vk = vg - rk * ia
+ */
+void TriodeDCCathodeFollower::plotCathodeLoadLine(Plot *plot)
+{
+    plotBiasLine(plot, parameter[TRI_DCCF_VG]->getValue(), parameter[TRI_DCCF_RK]->getValue());
+}
+
+/**
+ * @brief TriodeDCCathodeFollower::solveOperatingPoint finds the DC operating point, output impedance
+ * and headroom of the stage
+ * @param device The device
+ * @return true if the solver converged
+ *
+ * With the grid at Vg, the cathode at Rk * ia and the anode at vb - Ra * ia, the operating point is
+ * solved directly by a StageSolver. The output impedance is that of the cathode, (rp + Ra) / (mu + 1),
+ * in parallel with Rk. The output can swing down by the cathode voltage before the valve cuts off and
+ * up until the grid reaches the cathode, where the current is found by a second solve with the grid and
+ * cathode tied; the headroom is the smaller of the two, or zero if the grid is already positive.
+ */
+bool TriodeDCCathodeFollower::solveOperatingPoint(Device *device)
+{
+    double vb = parameter[TRI_DCCF_VB]->getValue();
+    double vg = parameter[TRI_DCCF_VG]->getValue();
+    double ra = parameter[TRI_DCCF_RA]->getValue() / 1000.0;
+    double rk = parameter[TRI_DCCF_RK]->getValue() / 1000.0;
+
+    StageSolver solver(device);
+    double ia = solver.solve(vg, vb, ra, 0.0, rk, parameter[TRI_DCCF_IA]->getValue());
+    bool converged = solver.isConverged();
+    operatingPointIterations = solver.getIterations();
+
+    double vk = ia * rk;
+    double gp;
+    double gm;
+    device->anodeCurrentGradient(vb - ia * (ra + rk), vg - vk, 0.0, &gp, &gm);
+    double zk = gp + gm > 0.0 ? (1.0 + gp * ra) / (gp + gm) : INFINITY;
+    double zo = std::isinf(zk) ? rk : zk * rk / (zk + rk);
 
+    double iaSaturation = solver.solve(0.0, vb, ra + rk, 0.0, 0.0, ia);
+    converged = converged && solver.isConverged();
+    operatingPointIterations += solver.getIterations();
+
+    parameter[TRI_DCCF_IA]->setValue(ia);
+    parameter[TRI_DCCF_VK]->setValue(vk);
+    parameter[TRI_DCCF_ZO]->setValue(zo * 1000.0);
+    parameter[TRI_DCCF_HEADROOM]->setValue(qMax(0.0, qMin(vk, (iaSaturation - ia) * rk)));
+
+    return converged;
 }
+
+/**
+ * @brief TriodeDCCathodeFollower::getOperatingPointIterations
+ * @return The number of model evaluations made by the last solveOperatingPoint()
+ */
+int TriodeDCCathodeFollower::getOperatingPointIterations() const
+{
+    return operatingPointIterations;
+}
+
+void TriodeDCCathodeFollower::update(int index)
+{
+    switch (index) {
+    case TRI_DCCF_VB:
+        dependencies.invalidate(vbNode);
+        break;
+    case TRI_DCCF_VG:
+        dependencies.invalidate(vgNode);
+        break;
+    case TRI_DCCF_RK:
+        dependencies.invalidate(rkNode);
+        break;
+    case TRI_DCCF_RA:
+        dependencies.invalidate(raNode);
+        break;
+    default: // Results of the operating point, which nothing depends on
+        break;
+    }
+}
+
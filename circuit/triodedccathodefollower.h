@@ -2,8 +2,47 @@
 
 #include "circuit.h"
 
+enum eTriodeDCCathodeFollowerParameter {
+    TRI_DCCF_VB,
+    TRI_DCCF_VG,
+    TRI_DCCF_RK,
+    TRI_DCCF_RA,
+    TRI_DCCF_IA,
+    TRI_DCCF_VK,
+    TRI_DCCF_ZO,
+    TRI_DCCF_HEADROOM
+};
+
+/**
+ * @brief The TriodeDCCathodeFollower class
+ *
+ * A cathode follower whose grid is coupled directly to the anode of the stage before it, so that the
+ * grid sits at that anode's DC voltage Vg and the cathode resistor Rk (to ground) sets the current. The
+ * output is taken from the cathode. The anode resistor Ra may be zero.
+ */
 class TriodeDCCathodeFollower : public Circuit
 {
 public:
     TriodeDCCathodeFollower();
+
+    virtual void updateUI(QLabel *labels[], QLineEdit *values[]);
+
+    virtual bool solveOperatingPoint(Device *device);
+    int getOperatingPointIterations() const;
+
+protected:
+    /**
+     * @brief operatingPointIterations The number of model evaluations made by the last solveOperatingPoint()
+     */
+    int operatingPointIterations = 0;
+
+    int vbNode;
+    int vgNode;
+    int rkNode;
+    int raNode;
+
+    virtual void plotAnodeLoadLine(Plot *plot);
+    virtual void plotCathodeLoadLine(Plot *plot);
+
+    virtual void update(int index);
 };
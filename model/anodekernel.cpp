@@ -0,0 +1,114 @@
+#include "anodekernel.h"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ANODE_KERNEL_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef ANODE_KERNEL_SIMD
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace avx2 {
+typedef __m256d V;
+typedef __m256i I;
+static const int width = 4;
+
+static inline V load(const double *p) { return _mm256_loadu_pd(p); }
+static inline void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+static inline V broadcast(double x) { return _mm256_set1_pd(x); }
+static inline V sqrtVector(V x) { return _mm256_sqrt_pd(x); }
+
+#include "anodekernelsimd.h"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace avx512 {
+typedef __m512d V;
+typedef __m512i I;
+static const int width = 8;
+
+static inline V load(const double *p) { return _mm512_loadu_pd(p); }
+static inline void store(double *p, V v) { _mm512_storeu_pd(p, v); }
+static inline V broadcast(double x) { return _mm512_set1_pd(x); }
+static inline V sqrtVector(V x) { return _mm512_sqrt_pd(x); }
+
+#include "anodekernelsimd.h"
+}
+#pragma GCC pop_options
+
+#endif
+
+int AnodeKernel::kernel = AnodeKernel::supportedKernel();
+
+/**
+ * @brief AnodeKernel::improvedKoren evaluates the Improved Koren anode current for arrays of samples
+ * @param parameters The model parameters
+ * @param va The anode voltages
+ * @param vg1 The grid voltages
+ * @param ia Receives the anode currents in mA
+ * @param count The number of samples
+ */
+void AnodeKernel::improvedKoren(const ImprovedKorenTriodeParameters<double> &parameters, const double *va, const double *vg1, double *ia, int count)
+{
+    int done = 0;
+
+#ifdef ANODE_KERNEL_SIMD
+    if (kernel == KERNEL_AVX512) {
+        done = avx512::improvedKoren(parameters, va, vg1, ia, count);
+    } else if (kernel == KERNEL_AVX2) {
+        done = avx2::improvedKoren(parameters, va, vg1, ia, count);
+    }
+#endif
+
+    improvedKorenScalar(parameters, va + done, vg1 + done, ia + done, count - done);
+}
+
+/**
+ * @brief AnodeKernel::getKernel
+ * @return The eAnodeKernel in use
+ */
+int AnodeKernel::getKernel()
+{
+    return kernel;
+}
+
+/**
+ * @brief AnodeKernel::setKernel selects a kernel, e.g. to compare the vector and scalar kernels
+ * @param newKernel The eAnodeKernel to use, which is limited to the best the processor supports
+ */
+void AnodeKernel::setKernel(int newKernel)
+{
+    kernel = newKernel < supportedKernel() ? newKernel : supportedKernel();
+}
+
+/**
+ * @brief AnodeKernel::supportedKernel
+ * @return The best eAnodeKernel that the processor supports
+ */
+int AnodeKernel::supportedKernel()
+{
+#ifdef ANODE_KERNEL_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        return KERNEL_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return KERNEL_AVX2;
+    }
+#endif
+
+    return KERNEL_SCALAR;
+}
+
+void AnodeKernel::improvedKorenScalar(const ImprovedKorenTriodeParameters<double> &p, const double *va, const double *vg1, double *ia, int count)
+{
+    for (int i = 0; i < count; i++) {
+        ia[i] = improvedKorenTriodeCurrent(p, va[i], vg1[i]);
+    }
+}
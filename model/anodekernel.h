@@ -0,0 +1,44 @@
+#pragma once
+
+#include "triodekernel.h"
+
+/**
+ * @brief The eAnodeKernel enum
+ *
+ * The instruction sets for which batch anode current kernels exist.
+ */
+enum eAnodeKernel {
+    KERNEL_SCALAR,
+    KERNEL_AVX2,
+    KERNEL_AVX512
+};
+
+/**
+ * @brief The AnodeKernel class
+ *
+ * Evaluates the Improved Koren (and so Koren, with kvb2 and vct of zero) anode current for arrays of anode and grid voltages.
+ * On x86 processors with AVX2 and FMA, or AVX-512, the samples are evaluated 4 or 8 at a time using
+ * vector implementations of exp, log and a numerically stable softplus; otherwise, or for the last
+ * few samples, a scalar loop is used. The kernel is chosen at runtime from the processor's features.
+ *
+ * Accuracy: the vector exp and log are accurate to a few units in the last place, so the vector
+ * kernels agree with the scalar kernel to a relative error below 1e-13 wherever the current exceeds
+ * 1e-12 mA (below that, both return values that are negligible). The vector exp and log follow
+ * std::exp and std::log at the ends of their ranges (subnormal results and arguments, overflow to
+ * infinity, NaN), so the kernels also agree on zero, subnormal and infinite currents. Unlike the
+ * original scalar korenCurrent, both kernels evaluate softplus without overflow for large arguments.
+ */
+class AnodeKernel
+{
+public:
+    static void improvedKoren(const ImprovedKorenTriodeParameters<double> &parameters, const double *va, const double *vg1, double *ia, int count);
+
+    static int getKernel();
+    static void setKernel(int newKernel);
+    static int supportedKernel();
+
+private:
+    static void improvedKorenScalar(const ImprovedKorenTriodeParameters<double> &parameters, const double *va, const double *vg1, double *ia, int count);
+
+    static int kernel;
+};
@@ -0,0 +1,148 @@
+/*
+ * The body of the vector anode current kernels, included once for each instruction set by
+ * anodekernel.cpp inside a namespace that defines:
+ *
+ *     V, I             the double and 64 bit integer vector types
+ *     width            the number of lanes
+ *     load, store      unaligned vector loads and stores
+ *     broadcast        a vector with every lane set to a value
+ *     sqrtVector       the lane wise square root
+ *
+ * The arithmetic uses the GCC vector extensions so that it is written only once.
+ */
+
+/*
+ * exp(x), which like std::exp gives subnormal results down to about -745, 0 below that and infinity
+ * above about 709.78. The scale 2^n is applied as two powers of two, each of which is a normal number,
+ * so that the result is only rounded once even where it is subnormal.
+ */
+static inline V expVector(V x)
+{
+    const V shift = broadcast(6755399441055744.0); // 1.5 * 2^52, rounds to an integer when added
+    const V minimum = broadcast(-746.0);
+    const V maximum = broadcast(710.0);
+
+    V xc = x < minimum ? minimum : x;
+    xc = xc > maximum ? maximum : xc;
+
+    V kd = xc * 1.4426950408889634 + shift;
+    V n = kd - shift;
+    V r = xc - n * 6.93147180369123816490e-01 - n * 1.90821492927058770002e-10; // Cody-Waite ln2 split
+
+    V p = broadcast(1.0 / 6227020800.0); // Taylor series to r^13, |r| <= ln2 / 2
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    I exponent = (I) kd - (I) shift;
+    I half = exponent >> 1;
+    V scale = (V) ((half + 1023) << 52);
+    V remainder = (V) ((exponent - half + 1023) << 52);
+    V result = p * scale * remainder;
+
+    result = x < minimum ? broadcast(0.0) : result;
+
+    return x != x ? x : result; // NaN propagates
+}
+
+/*
+ * Natural logarithm of positive, finite x; subnormal x is scaled by 2^52 first
+ */
+static inline V logVector(V x)
+{
+    const V shift = broadcast(6755399441055744.0);
+
+    I subnormal = (I) (x < 2.2250738585072014e-308); // -1 where true
+    x = subnormal ? x * 4503599627370496.0 : x;
+
+    I bits = (I) x;
+    I exponent = (bits >> 52) - 1023 - (subnormal & 52);
+    V m = (V) ((bits & 0x000FFFFFFFFFFFFFLL) | 0x3FF0000000000000LL); // Mantissa in [1, 2)
+
+    I large = (I) (m > 1.4142135623730951);
+    m = large ? m * 0.5 : m;
+    exponent = exponent - large; // The comparison is -1 where true
+
+    V f = m - 1.0;
+    V s = f / (f + 2.0); // log(1 + f) = 2 atanh(s), |s| <= 0.1716
+    V z = s * s;
+
+    V p = broadcast(1.0 / 21.0);
+    p = p * z + 1.0 / 19.0;
+    p = p * z + 1.0 / 17.0;
+    p = p * z + 1.0 / 15.0;
+    p = p * z + 1.0 / 13.0;
+    p = p * z + 1.0 / 11.0;
+    p = p * z + 1.0 / 9.0;
+    p = p * z + 1.0 / 7.0;
+    p = p * z + 1.0 / 5.0;
+    p = p * z + 1.0 / 3.0;
+    p = p * z + 1.0;
+
+    V e = (V) (exponent + (I) shift) - shift;
+
+    return e * 6.93147180369123816490e-01 + (2.0 * s * p + e * 1.90821492927058770002e-10);
+}
+
+/*
+ * softplus(x) = max(x, 0) + log1p(exp(-|x|)), with log1p(t) computed as log(u) * t / (u - 1) for
+ * u = 1 + t, which is accurate even when t is tiny
+ */
+static inline V softplusVector(V x)
+{
+    const V zero = broadcast(0.0);
+
+    V absolute = x < zero ? -x : x;
+    V t = expVector(-absolute);
+    V u = t + 1.0;
+    V difference = u - 1.0;
+    V log1p = difference == zero ? t : logVector(u) * t / (difference == zero ? broadcast(1.0) : difference);
+
+    return (x > zero ? x : zero) + log1p;
+}
+
+/*
+ * The vector form of improvedKorenTriodeCurrent
+ */
+static inline int improvedKoren(const ImprovedKorenTriodeParameters<double> &c, const double *va, const double *vg1, double *ia, int count)
+{
+    const V kvb = broadcast(c.kvb);
+    const V kvb2 = broadcast(c.kvb2);
+    const V vct = broadcast(c.vct);
+    const V kp = broadcast(c.kp);
+    const V inverseKp = broadcast(1.0 / c.kp);
+    const V inverseMu = broadcast(1.0 / c.mu);
+    const V inverseKg = broadcast(1.0 / c.kg);
+    const V alpha = broadcast(c.alpha);
+    const V zero = broadcast(0.0);
+    const V infinity = broadcast(INFINITY);
+
+    int i = 0;
+    for (; i + width <= count; i += width) {
+        V a = load(va + i);
+        V g = load(vg1 + i);
+
+        V x1 = sqrtVector(kvb + a * a + a * kvb2);
+        V x2 = kp * (inverseMu + (g + vct) / x1);
+        V et = a * inverseKp * softplusVector(x2);
+
+        // As for pow(et, alpha) in the scalar kernel: zero (or NaN) et gives no current and infinite et infinite current
+        V safe = et > zero && et < infinity ? et : broadcast(1.0);
+        V current = expVector(alpha * logVector(safe)) * inverseKg;
+        current = et < infinity ? current : infinity * inverseKg;
+
+        store(ia + i, et > zero ? current : zero);
+    }
+
+    return i;
+}
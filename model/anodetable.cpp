@@ -0,0 +1,379 @@
+#include "anodetable.h"
+
+#include <QDataStream>
+#include <QFile>
+
+#include <cmath>
+
+#define TABLE_MAGIC 0x414E5442 // "ANTB"
+#define TABLE_VERSION 1
+
+AnodeTable::AnodeTable()
+{
+
+}
+
+/**
+ * @brief AnodeTable::build tabulates a model
+ * @param model The fitted model
+ * @param vaMax The largest anode voltage in the table
+ * @param vg1Max The magnitude of the most negative grid voltage in the table
+ * @param maxError The largest acceptable error in mA
+ * @param interpolation One of eTableInterpolation
+ * @param maxNodes The largest table to build
+ * @return true if the error bound was met, otherwise the table is the largest within maxNodes
+ *
+ * Starting from a 33 x 17 grid, the number of grid steps in va, vg or both is doubled (according to
+ * where the largest error was found) until the error at the midpoints, and then at every point used
+ * by measureError(), is within maxError.
+ */
+bool AnodeTable::build(Model *model, double vaMax, double vg1Max, double maxError, int interpolation, int maxNodes)
+{
+    this->interpolation = interpolation;
+
+    int newVaCount = 33;
+    int newVgCount = 17;
+
+    while (true) {
+        setGeometry(vaMax, vg1Max, newVaCount, newVgCount);
+
+        sample(model);
+        computeSlopes();
+
+        double vaError = probe(model, 0.5, 0.0);
+        double vgError = probe(model, 0.0, 0.5);
+        double centreError = probe(model, 0.5, 0.5);
+        this->maxError = qMax(centreError, qMax(vaError, vgError));
+
+        if (this->maxError <= maxError) {
+            this->maxError = measureError(model); // Confirm at the other points within the cells too
+            if (this->maxError <= maxError) {
+                return true;
+            }
+        }
+
+        bool refineVa = vaError >= vgError || centreError > qMax(vaError, vgError);
+        bool refineVg = vgError >= vaError || centreError > qMax(vaError, vgError);
+        int nextVaCount = refineVa ? 2 * (vaCount - 1) + 1 : vaCount;
+        int nextVgCount = refineVg ? 2 * (vgCount - 1) + 1 : vgCount;
+
+        if ((qint64) nextVaCount * nextVgCount > maxNodes) {
+            qWarning("Anode table limited to %d x %d nodes with an error of %g mA", vaCount, vgCount, this->maxError);
+            return false;
+        }
+
+        newVaCount = nextVaCount;
+        newVgCount = nextVgCount;
+    }
+}
+
+/**
+ * @brief AnodeTable::anodeCurrents interpolates the anode current for arrays of samples
+ * @param va The anode voltages
+ * @param vg1 The grid voltages
+ * @param ia Receives the anode currents in mA
+ * @param count The number of samples
+ */
+void AnodeTable::anodeCurrents(const double *va, const double *vg1, double *ia, int count) const
+{
+    for (int i = 0; i < count; i++) {
+        ia[i] = anodeCurrent(va[i], vg1[i]);
+    }
+}
+
+/**
+ * @brief AnodeTable::save writes the table to a file
+ * @param fileName The file to write
+ * @return true if the table was written
+ */
+bool AnodeTable::save(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("Unable to write %s", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << (quint32) TABLE_MAGIC << (qint32) TABLE_VERSION;
+    stream << (qint32) interpolation << (qint32) vaCount << (qint32) vgCount;
+    stream << vaMax << vg1Max << maxError;
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        stream << nodes[i].f << nodes[i].fx << nodes[i].fy << nodes[i].fxy;
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief AnodeTable::load reads a table written by save()
+ * @param fileName The file to read
+ * @return true if the table was read, otherwise the table is unchanged
+ *
+ * The header is checked before anything is allocated: the interpolation must be one of
+ * eTableInterpolation, each axis must have at least two nodes with no more than TABLE_MAX_NODES in all,
+ * the ranges must be positive and finite and the file must be long enough to hold every node.
+ */
+bool AnodeTable::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+
+    quint32 magic;
+    qint32 version;
+    stream >> magic >> version;
+    if (magic != TABLE_MAGIC || version != TABLE_VERSION) {
+        return false;
+    }
+
+    qint32 newInterpolation;
+    qint32 newVaCount;
+    qint32 newVgCount;
+    double newVaMax;
+    double newVg1Max;
+    double newMaxError;
+    stream >> newInterpolation >> newVaCount >> newVgCount >> newVaMax >> newVg1Max >> newMaxError;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    if (newInterpolation != TABLE_CUBIC && newInterpolation != TABLE_MONOTONE) {
+        qWarning("Anode table %s has an unknown interpolation", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    qint64 nodeCount = (qint64) newVaCount * newVgCount;
+    if (newVaCount < 2 || newVgCount < 2 || nodeCount > TABLE_MAX_NODES) {
+        qWarning("Anode table %s has an invalid size of %d x %d nodes", fileName.toLocal8Bit().constData(), newVaCount, newVgCount);
+        return false;
+    }
+
+    if (!(newVaMax > 0.0) || !(newVg1Max > 0.0) || std::isinf(newVaMax) || std::isinf(newVg1Max)) {
+        qWarning("Anode table %s has an invalid range", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    if (file.size() - file.pos() < nodeCount * 4 * (qint64) sizeof(double)) {
+        qWarning("Anode table %s is truncated", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    std::vector<Node> newNodes((size_t) nodeCount);
+    for (size_t i = 0; i < newNodes.size(); i++) {
+        stream >> newNodes[i].f >> newNodes[i].fx >> newNodes[i].fy >> newNodes[i].fxy;
+    }
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    interpolation = newInterpolation;
+    maxError = newMaxError;
+    setGeometry(newVaMax, newVg1Max, newVaCount, newVgCount);
+    nodes.swap(newNodes);
+
+    return true;
+}
+
+/**
+ * @brief AnodeTable::measureError compares the table with a model between the nodes
+ * @param model The model the table was built from
+ * @param rmsError Receives the root mean square error in mA
+ * @return The largest error in mA found at seven points within each cell
+ */
+double AnodeTable::measureError(Model *model, double *rmsError) const
+{
+    const double offsets[7][2] = {
+        { 0.5, 0.0 }, { 0.0, 0.5 }, { 0.5, 0.5 }, { 0.25, 0.25 }, { 0.75, 0.75 }, { 0.25, 0.75 }, { 0.75, 0.25 }
+    };
+
+    double error = 0.0;
+    double sumSquares = 0.0;
+    qint64 samples = 0;
+
+    for (int k = 0; k < 7; k++) {
+        error = qMax(error, probe(model, offsets[k][0], offsets[k][1], &sumSquares, &samples));
+    }
+
+    if (rmsError != nullptr) {
+        *rmsError = samples > 0 ? std::sqrt(sumSquares / samples) : 0.0;
+    }
+
+    return error;
+}
+
+int AnodeTable::getVaCount() const
+{
+    return vaCount;
+}
+
+int AnodeTable::getVgCount() const
+{
+    return vgCount;
+}
+
+int AnodeTable::getInterpolation() const
+{
+    return interpolation;
+}
+
+double AnodeTable::getVaMax() const
+{
+    return vaMax;
+}
+
+double AnodeTable::getVg1Max() const
+{
+    return vg1Max;
+}
+
+double AnodeTable::getMaxError() const
+{
+    return maxError;
+}
+
+/**
+ * @brief AnodeTable::getMemorySize
+ * @return The size of the table in bytes
+ */
+qint64 AnodeTable::getMemorySize() const
+{
+    return (qint64) nodes.size() * sizeof(Node);
+}
+
+/**
+ * @brief AnodeTable::sample evaluates the model at every node, one row of constant vg at a time
+ */
+void AnodeTable::sample(Model *model)
+{
+    std::vector<double> va(vaCount);
+    std::vector<double> vg(vaCount);
+    std::vector<double> ia(vaCount);
+
+    for (int i = 0; i < vaCount; i++) {
+        va[i] = i / vaScale;
+    }
+
+    for (int j = 0; j < vgCount; j++) {
+        std::fill(vg.begin(), vg.end(), j / vgScale - vg1Max);
+        model->anodeCurrents(va.data(), vg.data(), nullptr, ia.data(), vaCount);
+
+        for (int i = 0; i < vaCount; i++) {
+            nodes[(size_t) j * vaCount + i].f = ia[i];
+        }
+    }
+}
+
+/**
+ * @brief AnodeTable::computeSlopes sets the derivatives at every node from the node values
+ */
+void AnodeTable::computeSlopes()
+{
+    for (int j = 0; j < vgCount; j++) {
+        for (int i = 0; i < vaCount; i++) {
+            Node &node = nodes[(size_t) j * vaCount + i];
+
+            double previous = i > 0 ? node.f - (&node - 1)->f : (&node + 1)->f - node.f;
+            double next = i < vaCount - 1 ? (&node + 1)->f - node.f : previous;
+            node.fx = slope(previous, next, interpolation);
+
+            previous = j > 0 ? node.f - (&node - vaCount)->f : (&node + vaCount)->f - node.f;
+            next = j < vgCount - 1 ? (&node + vaCount)->f - node.f : previous;
+            node.fy = slope(previous, next, interpolation);
+        }
+    }
+
+    for (int j = 0; j < vgCount; j++) {
+        for (int i = 0; i < vaCount; i++) {
+            Node &node = nodes[(size_t) j * vaCount + i];
+
+            if (interpolation == TABLE_MONOTONE) {
+                node.fxy = 0.0;
+            } else {
+                double previous = j > 0 ? node.fx - (&node - vaCount)->fx : (&node + vaCount)->fx - node.fx;
+                double next = j < vgCount - 1 ? (&node + vaCount)->fx - node.fx : previous;
+                node.fxy = slope(previous, next, TABLE_CUBIC);
+            }
+        }
+    }
+}
+
+void AnodeTable::setGeometry(double vaMax, double vg1Max, int vaCount, int vgCount)
+{
+    this->vaMax = vaMax;
+    this->vg1Max = vg1Max;
+    this->vaCount = vaCount;
+    this->vgCount = vgCount;
+
+    vaScale = (vaCount - 1) / vaMax;
+    vgScale = (vgCount - 1) / vg1Max;
+    vaLast = vaCount - 1;
+    vgLast = vgCount - 1;
+
+    nodes.assign((size_t) vaCount * vgCount, Node());
+}
+
+/**
+ * @brief AnodeTable::probe compares the table with the model at the same point within every cell
+ * @param tOffset The position within each cell in va, as a fraction of a grid step
+ * @param uOffset The position within each cell in vg
+ * @param sumSquares If not NULL, the sum of the squared errors is added to it
+ * @param samples If not NULL, the number of points compared is added to it
+ * @return The largest absolute error in mA
+ */
+double AnodeTable::probe(Model *model, double tOffset, double uOffset, double *sumSquares, qint64 *samples) const
+{
+    int cells = vaCount - 1;
+    std::vector<double> va(cells);
+    std::vector<double> vg(cells);
+    std::vector<double> ia(cells);
+
+    for (int i = 0; i < cells; i++) {
+        va[i] = (i + tOffset) / vaScale;
+    }
+
+    double error = 0.0;
+    for (int j = 0; j < vgCount - 1; j++) {
+        std::fill(vg.begin(), vg.end(), (j + uOffset) / vgScale - vg1Max);
+        model->anodeCurrents(va.data(), vg.data(), nullptr, ia.data(), cells);
+
+        for (int i = 0; i < cells; i++) {
+            double difference = std::abs(anodeCurrent(va[i], vg[i]) - ia[i]);
+            error = qMax(error, difference);
+            if (sumSquares != nullptr) {
+                *sumSquares += difference * difference;
+            }
+        }
+        if (samples != nullptr) {
+            *samples += cells;
+        }
+    }
+
+    return error;
+}
+
+/**
+ * @brief AnodeTable::slope
+ * @param previous The change in value over the preceding grid step
+ * @param next The change in value over the following grid step
+ * @param interpolation One of eTableInterpolation
+ * @return The slope at the node, per grid step
+ */
+double AnodeTable::slope(double previous, double next, int interpolation)
+{
+    if (interpolation == TABLE_CUBIC) {
+        return 0.5 * (previous + next);
+    }
+
+    if (previous * next <= 0.0) { // A local extremum (or a flat step) is given a zero slope
+        return 0.0;
+    }
+
+    return 2.0 * previous * next / (previous + next); // Harmonic mean
+}
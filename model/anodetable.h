@@ -0,0 +1,143 @@
+#pragma once
+
+#include <QString>
+
+#include <vector>
+
+#include "model.h"
+
+/**
+ * @brief TABLE_MAX_NODES The largest table that build() will make by default or load() will read
+ */
+#define TABLE_MAX_NODES (1 << 22)
+
+/**
+ * @brief The eTableInterpolation enum
+ *
+ * The interpolation used between the nodes of an AnodeTable.
+ */
+enum eTableInterpolation {
+    TABLE_CUBIC,
+    TABLE_MONOTONE
+};
+
+/**
+ * @brief The AnodeTable class
+ *
+ * A precomputed table of the anode current of a fitted Model over [0, vaMax] x [-vg1Max, 0] for
+ * evaluation at audio rate. The current is interpolated with bicubic Hermite patches whose nodal
+ * slopes are either central differences (TABLE_CUBIC, i.e. Catmull-Rom) or Fritsch-Butland limited
+ * slopes with no twist (TABLE_MONOTONE), which suppress the overshoot of the cubic slopes at the
+ * sharp bend near cut-off where the current would otherwise dip below zero.
+ *
+ * Each node holds its value, both slopes and the cross derivative together, so a lookup reads four
+ * adjacent 32 byte nodes from two rows of the table. Inputs outside the table are clamped to its edges.
+ *
+ * The grid is refined by build() until the error, measured against the model at the midpoints of the
+ * cell edges, the cell centres and the quarter points of the cells, is within the requested bound.
+ */
+class AnodeTable
+{
+public:
+    AnodeTable();
+
+    bool build(Model *model, double vaMax, double vg1Max, double maxError = 1.0e-3, int interpolation = TABLE_MONOTONE, int maxNodes = TABLE_MAX_NODES);
+
+    /**
+     * @brief anodeCurrent
+     * @param va The anode voltage
+     * @param vg1 The grid voltage
+     * @return The interpolated anode current in mA
+     */
+    inline double anodeCurrent(double va, double vg1) const
+    {
+        double x = va * vaScale;
+        double y = (vg1 + vg1Max) * vgScale;
+        x = x < 0.0 ? 0.0 : (x > vaLast ? vaLast : x);
+        y = y < 0.0 ? 0.0 : (y > vgLast ? vgLast : y);
+
+        int i = (int) x;
+        int j = (int) y;
+        i = i < vaCount - 1 ? i : vaCount - 2;
+        j = j < vgCount - 1 ? j : vgCount - 2;
+
+        double t = x - i;
+        double u = y - j;
+
+        double t2 = t * t;
+        double t3 = t2 * t;
+        double u2 = u * u;
+        double u3 = u2 * u;
+
+        double a0 = 2.0 * t3 - 3.0 * t2 + 1.0; // Hermite basis in va
+        double a1 = t3 - 2.0 * t2 + t;
+        double a2 = 3.0 * t2 - 2.0 * t3;
+        double a3 = t3 - t2;
+
+        double b0 = 2.0 * u3 - 3.0 * u2 + 1.0; // and in vg
+        double b1 = u3 - 2.0 * u2 + u;
+        double b2 = 3.0 * u2 - 2.0 * u3;
+        double b3 = u3 - u2;
+
+        const Node *n00 = &nodes[(size_t) j * vaCount + i];
+        const Node *n10 = n00 + 1;
+        const Node *n01 = n00 + vaCount;
+        const Node *n11 = n01 + 1;
+
+        return b0 * (a0 * n00->f + a1 * n00->fx + a2 * n10->f + a3 * n10->fx) +
+               b1 * (a0 * n00->fy + a1 * n00->fxy + a2 * n10->fy + a3 * n10->fxy) +
+               b2 * (a0 * n01->f + a1 * n01->fx + a2 * n11->f + a3 * n11->fx) +
+               b3 * (a0 * n01->fy + a1 * n01->fxy + a2 * n11->fy + a3 * n11->fxy);
+    }
+
+    void anodeCurrents(const double *va, const double *vg1, double *ia, int count) const;
+
+    bool save(const QString &fileName) const;
+    bool load(const QString &fileName);
+
+    double measureError(Model *model, double *rmsError = nullptr) const;
+
+    int getVaCount() const;
+    int getVgCount() const;
+    int getInterpolation() const;
+    double getVaMax() const;
+    double getVg1Max() const;
+    /**
+     * @brief getMaxError
+     * @return The largest error found by build(), in mA
+     */
+    double getMaxError() const;
+    qint64 getMemorySize() const;
+
+private:
+    /**
+     * @brief The Node struct
+     *
+     * The current at a node and its derivatives, scaled to one grid step in each direction.
+     */
+    struct Node {
+        double f;
+        double fx;
+        double fy;
+        double fxy;
+    };
+
+    void sample(Model *model);
+    void computeSlopes();
+    void setGeometry(double vaMax, double vg1Max, int vaCount, int vgCount);
+    double probe(Model *model, double tOffset, double uOffset, double *sumSquares = nullptr, qint64 *samples = nullptr) const;
+
+    static double slope(double previous, double next, int interpolation);
+
+    std::vector<Node> nodes;
+    int vaCount = 0;
+    int vgCount = 0;
+    int interpolation = TABLE_MONOTONE;
+    double vaMax = 0.0;
+    double vg1Max = 0.0;
+    double vaScale = 0.0;
+    double vgScale = 0.0;
+    double vaLast = 0.0;
+    double vgLast = 0.0;
+    double maxError = 0.0;
+};
@@ -0,0 +1,322 @@
+#include "anodevoltagetable.h"
+#include "model.h"
+
+#include <cmath>
+
+/**
+ * @brief CURRENT_RANGE The ratio of the largest to the smallest current in a table
+ */
+#define CURRENT_RANGE 1.0e4
+
+AnodeVoltageTable::AnodeVoltageTable()
+{
+
+}
+
+/**
+ * @brief AnodeVoltageTable::build tabulates the inverse of a model
+ * @param model The fitted model
+ * @param iaMax The largest anode current in the table, in mA
+ * @param vg1Max The magnitude of the most negative grid voltage in the table
+ * @param maxError The largest acceptable error in the anode voltage, in V
+ * @param maxNodes The largest table to build
+ * @return true if the error bound was met, otherwise the table is the largest within maxNodes and
+ * contains() is false everywhere so that every query is solved directly
+ *
+ * The nodes are solved with Model::solveAnodeVoltage, each starting from its neighbour. Starting
+ * from a 17 x 17 grid, the number of grid steps in ia, vg or both is doubled (according to where the
+ * largest error was found) until the error at the midpoints, and then at every point used by
+ * measureError(), is within maxError.
+ */
+bool AnodeVoltageTable::build(Model *model, double iaMax, double vg1Max, double maxError, int maxNodes)
+{
+    targetError = maxError;
+    accurate = false;
+
+    int newIaCount = 17;
+    int newVgCount = 17;
+
+    while (true) {
+        setGeometry(iaMax, vg1Max, newIaCount, newVgCount);
+
+        sample(model);
+        computeSlopes();
+
+        double iaError = probe(model, 0.5, 0.0);
+        double vgError = probe(model, 0.0, 0.5);
+        double centreError = probe(model, 0.5, 0.5);
+        this->maxError = qMax(centreError, qMax(iaError, vgError));
+
+        if (this->maxError <= maxError) {
+            this->maxError = measureError(model);
+            if (this->maxError <= maxError) {
+                accurate = true;
+                return true;
+            }
+        }
+
+        bool refineIa = iaError >= vgError || centreError > qMax(iaError, vgError);
+        bool refineVg = vgError >= iaError || centreError > qMax(iaError, vgError);
+        int nextIaCount = refineIa ? 2 * (iaCount - 1) + 1 : iaCount;
+        int nextVgCount = refineVg ? 2 * (vgCount - 1) + 1 : vgCount;
+
+        if ((qint64) nextIaCount * nextVgCount > maxNodes) {
+            qWarning("Anode voltage table limited to %d x %d nodes with an error of %g V", iaCount, vgCount, this->maxError);
+            return false;
+        }
+
+        newIaCount = nextIaCount;
+        newVgCount = nextVgCount;
+    }
+}
+
+/**
+ * @brief AnodeVoltageTable::measureError compares the table with the model between the nodes
+ * @param model The model the table was built from
+ * @param rmsError Receives the root mean square error in V
+ * @return The largest error in V found at seven points within each cell
+ */
+double AnodeVoltageTable::measureError(Model *model, double *rmsError) const
+{
+    const double offsets[7][2] = {
+        { 0.5, 0.0 }, { 0.0, 0.5 }, { 0.5, 0.5 }, { 0.25, 0.25 }, { 0.75, 0.75 }, { 0.25, 0.75 }, { 0.75, 0.25 }
+    };
+
+    double error = 0.0;
+    double sumSquares = 0.0;
+    qint64 samples = 0;
+
+    for (int k = 0; k < 7; k++) {
+        error = qMax(error, probe(model, offsets[k][0], offsets[k][1], &sumSquares, &samples));
+    }
+
+    if (rmsError != nullptr) {
+        *rmsError = samples > 0 ? std::sqrt(sumSquares / samples) : 0.0;
+    }
+
+    return error;
+}
+
+bool AnodeVoltageTable::isAccurate() const
+{
+    return accurate;
+}
+
+int AnodeVoltageTable::getIaCount() const
+{
+    return iaCount;
+}
+
+int AnodeVoltageTable::getVgCount() const
+{
+    return vgCount;
+}
+
+double AnodeVoltageTable::getIaMax() const
+{
+    return iaMax;
+}
+
+double AnodeVoltageTable::getVg1Max() const
+{
+    return vg1Max;
+}
+
+double AnodeVoltageTable::getTargetError() const
+{
+    return targetError;
+}
+
+double AnodeVoltageTable::getMaxError() const
+{
+    return maxError;
+}
+
+/**
+ * @brief AnodeVoltageTable::getMemorySize
+ * @return The size of the table in bytes
+ */
+qint64 AnodeVoltageTable::getMemorySize() const
+{
+    return (qint64) nodes.size() * sizeof(Node);
+}
+
+/**
+ * @brief AnodeVoltageTable::sample solves the model at every node, one row of constant vg at a time
+ *
+ * The slopes of the inverse follow from the gradient of the model at the solution:
+ * dva / dlog(ia) = ia / (dia / dva) and dva / dvg1 = -(dia / dvg1) / (dia / dva). Where the
+ * current does not depend on va (at the va = 0 limit) the slopes are marked as unknown.
+ */
+void AnodeVoltageTable::sample(Model *model)
+{
+    for (int j = 0; j < vgCount; j++) {
+        double vg1 = j / vgScale - vg1Max;
+        double va = 0.0;
+
+        for (int i = 0; i < iaCount; i++) {
+            double ia = currentAt(i);
+            va = model->solveAnodeVoltage(ia, vg1, 0.0, va);
+
+            double dIaDva;
+            double dIaDvg1;
+            model->anodeCurrentGradient(va, vg1, 0.0, &dIaDva, &dIaDvg1);
+
+            Node &node = nodes[(size_t) j * iaCount + i];
+            node.f = va;
+            if (dIaDva > 0.0) {
+                node.fx = ia / dIaDva / iaScale;
+                node.fy = -dIaDvg1 / dIaDva / vgScale;
+            } else {
+                node.fx = NAN;
+                node.fy = NAN;
+            }
+        }
+    }
+}
+
+/**
+ * @brief AnodeVoltageTable::computeSlopes limits the slopes at every node and sets the cross derivatives
+ *
+ * Neighbours at the va = 0 limit are treated as lying beyond the edge of the table, so that the
+ * corner in the inverse there does not limit the slopes of the nodes next to it.
+ */
+void AnodeVoltageTable::computeSlopes()
+{
+    for (int j = 0; j < vgCount; j++) {
+        for (int i = 0; i < iaCount; i++) {
+            Node &node = nodes[(size_t) j * iaCount + i];
+            if (node.f <= 0.0) {
+                node.fx = 0.0;
+                node.fy = 0.0;
+                continue;
+            }
+
+            bool hasPrevious = i > 0 && (&node - 1)->f > 0.0;
+            bool hasNext = i < iaCount - 1 && (&node + 1)->f > 0.0;
+            double previous = hasPrevious ? node.f - (&node - 1)->f : NAN;
+            double next = hasNext ? (&node + 1)->f - node.f : NAN;
+            node.fx = limit(node.fx, hasPrevious ? previous : next, hasNext ? next : previous);
+
+            hasPrevious = j > 0 && (&node - iaCount)->f > 0.0;
+            hasNext = j < vgCount - 1 && (&node + iaCount)->f > 0.0;
+            previous = hasPrevious ? node.f - (&node - iaCount)->f : NAN;
+            next = hasNext ? (&node + iaCount)->f - node.f : NAN;
+            node.fy = limit(node.fy, hasPrevious ? previous : next, hasNext ? next : previous);
+        }
+    }
+
+    for (int j = 0; j < vgCount; j++) {
+        for (int i = 0; i < iaCount; i++) {
+            Node &node = nodes[(size_t) j * iaCount + i];
+
+            bool hasPrevious = j > 0 && (&node - iaCount)->f > 0.0;
+            bool hasNext = j < vgCount - 1 && (&node + iaCount)->f > 0.0;
+            if (node.f <= 0.0 || !(hasPrevious || hasNext)) {
+                node.fxy = 0.0;
+            } else if (hasPrevious && hasNext) {
+                node.fxy = 0.5 * ((&node + iaCount)->fx - (&node - iaCount)->fx);
+            } else if (hasNext) {
+                node.fxy = (&node + iaCount)->fx - node.fx;
+            } else {
+                node.fxy = node.fx - (&node - iaCount)->fx;
+            }
+        }
+    }
+}
+
+void AnodeVoltageTable::setGeometry(double iaMax, double vg1Max, int iaCount, int vgCount)
+{
+    this->iaMin = iaMax / CURRENT_RANGE;
+    this->iaMax = iaMax;
+    this->vg1Max = vg1Max;
+    this->iaCount = iaCount;
+    this->vgCount = vgCount;
+
+    iaScale = (iaCount - 1) / std::log(CURRENT_RANGE);
+    vgScale = (vgCount - 1) / vg1Max;
+    iaLast = iaCount - 1;
+    vgLast = vgCount - 1;
+
+    nodes.assign((size_t) iaCount * vgCount, Node());
+}
+
+/**
+ * @brief AnodeVoltageTable::currentAt
+ * @param x A position along the ia axis of the table, in grid steps
+ * @return The anode current at that position
+ */
+double AnodeVoltageTable::currentAt(double x) const
+{
+    return iaMin * std::exp(x / iaScale);
+}
+
+/**
+ * @brief AnodeVoltageTable::probe compares the table with the model at the same point within every cell
+ * @param tOffset The position within each cell along the ia axis, as a fraction of a grid step
+ * @param uOffset The position within each cell in vg
+ * @param sumSquares If not NULL, the sum of the squared errors is added to it
+ * @param samples If not NULL, the number of points compared is added to it
+ * @return The largest absolute error in V, excluding the cells at the va = 0 limit (see contains())
+ */
+double AnodeVoltageTable::probe(Model *model, double tOffset, double uOffset, double *sumSquares, qint64 *samples) const
+{
+    double error = 0.0;
+
+    for (int j = 0; j < vgCount - 1; j++) {
+        double vg1 = (j + uOffset) / vgScale - vg1Max;
+
+        for (int i = 0; i < iaCount - 1; i++) {
+            const Node *n00 = &nodes[(size_t) j * iaCount + i];
+            if (n00->f <= 0.0 || (n00 + 1)->f <= 0.0 || (n00 + iaCount)->f <= 0.0 || (n00 + iaCount + 1)->f <= 0.0) {
+                continue;
+            }
+
+            double ia = currentAt(i + tOffset);
+            double va = anodeVoltage(ia, vg1);
+            double difference = std::abs(va - model->solveAnodeVoltage(ia, vg1, 0.0, va));
+            error = qMax(error, difference);
+            if (sumSquares != nullptr) {
+                *sumSquares += difference * difference;
+            }
+            if (samples != nullptr) {
+                (*samples)++;
+            }
+        }
+    }
+
+    return error;
+}
+
+/**
+ * @brief AnodeVoltageTable::limit
+ * @param slope The slope at the node, per grid step, or NAN if it is unknown
+ * @param previous The change in value over the preceding grid step
+ * @param next The change in value over the following grid step
+ * @return The slope limited to three times the smaller secant, so that the patches either side of the
+ * node are monotone, or the harmonic mean of the secants if the slope is unknown
+ *
+ * A node with no neighbour with which to form a secant keeps its slope (or 0 if it is unknown).
+ */
+double AnodeVoltageTable::limit(double slope, double previous, double next)
+{
+    if (std::isnan(previous)) {
+        return std::isfinite(slope) ? slope : 0.0;
+    }
+
+    if (previous * next <= 0.0) { // A local extremum (or a flat step) is given a zero slope
+        return 0.0;
+    }
+
+    if (!std::isfinite(slope)) {
+        return 2.0 * previous * next / (previous + next);
+    }
+
+    if (slope * previous <= 0.0) {
+        return 0.0;
+    }
+
+    double bound = 3.0 * qMin(std::abs(previous), std::abs(next));
+
+    return std::abs(slope) > bound ? (slope > 0.0 ? bound : -bound) : slope;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <cmath>
+#include <vector>
+
+class Model;
+
+/**
+ * @brief The AnodeVoltageTable class
+ *
+ * A precomputed table of the inverse of a fitted Model, i.e. the anode voltage that gives an anode
+ * current ia at a grid voltage vg1, over [iaMax / 10^4, iaMax] x [-vg1Max, 0]. It answers the repeated
+ * inverse queries of load line and bias calculations in constant time instead of with an iterative
+ * search.
+ *
+ * The table is indexed by log(ia) rather than ia because, below cut-off, the anode voltage climbs
+ * steeply from zero as the current leaves zero. It is interpolated with bicubic Hermite patches whose
+ * slopes are the exact derivatives of the inverse (from the model's analytic gradient), limited to
+ * three times the adjacent secants (Fritsch-Carlson) so that the nodes of each row are joined
+ * monotonically.
+ *
+ * The table does not track the model; its owner rebuilds it when the model parameters change (see
+ * Model::invalidateInverseTable).
+ */
+class AnodeVoltageTable
+{
+public:
+    AnodeVoltageTable();
+
+    bool build(Model *model, double iaMax, double vg1Max, double maxError = 0.01, int maxNodes = 1 << 18);
+
+    /**
+     * @brief contains
+     * @return true if (ia, vg1) lies within the table, the table met its error bound and the voltage
+     * is not at the va = 0 limit (which is left to the solver because the inverse has a corner there)
+     */
+    inline bool contains(double ia, double vg1) const
+    {
+        if (!accurate || !(ia >= iaMin && ia <= iaMax && vg1 >= -vg1Max && vg1 <= 0.0)) {
+            return false;
+        }
+
+        int i;
+        int j;
+        double t;
+        double u;
+        const Node *n00 = cell(ia, vg1, &i, &j, &t, &u);
+
+        return n00->f > 0.0 && (n00 + 1)->f > 0.0 && (n00 + iaCount)->f > 0.0 && (n00 + iaCount + 1)->f > 0.0;
+    }
+
+    /**
+     * @brief anodeVoltage
+     * @param ia The anode current in mA
+     * @param vg1 The grid voltage
+     * @return The interpolated anode voltage, with inputs outside the table clamped to its edges
+     */
+    inline double anodeVoltage(double ia, double vg1) const
+    {
+        int i;
+        int j;
+        double t;
+        double u;
+        const Node *n00 = cell(ia, vg1, &i, &j, &t, &u);
+
+        double t2 = t * t;
+        double t3 = t2 * t;
+        double u2 = u * u;
+        double u3 = u2 * u;
+
+        double a0 = 2.0 * t3 - 3.0 * t2 + 1.0; // Hermite basis in log(ia)
+        double a1 = t3 - 2.0 * t2 + t;
+        double a2 = 3.0 * t2 - 2.0 * t3;
+        double a3 = t3 - t2;
+
+        double b0 = 2.0 * u3 - 3.0 * u2 + 1.0; // and in vg
+        double b1 = u3 - 2.0 * u2 + u;
+        double b2 = 3.0 * u2 - 2.0 * u3;
+        double b3 = u3 - u2;
+
+        const Node *n10 = n00 + 1;
+        const Node *n01 = n00 + iaCount;
+        const Node *n11 = n01 + 1;
+
+        return b0 * (a0 * n00->f + a1 * n00->fx + a2 * n10->f + a3 * n10->fx) +
+               b1 * (a0 * n00->fy + a1 * n00->fxy + a2 * n10->fy + a3 * n10->fxy) +
+               b2 * (a0 * n01->f + a1 * n01->fx + a2 * n11->f + a3 * n11->fx) +
+               b3 * (a0 * n01->fy + a1 * n01->fxy + a2 * n11->fy + a3 * n11->fxy);
+    }
+
+    double measureError(Model *model, double *rmsError = nullptr) const;
+
+    bool isAccurate() const;
+    int getIaCount() const;
+    int getVgCount() const;
+    double getIaMax() const;
+    double getVg1Max() const;
+    /**
+     * @brief getTargetError
+     * @return The error bound requested from build(), in V
+     */
+    double getTargetError() const;
+    /**
+     * @brief getMaxError
+     * @return The largest error found by build(), in V
+     */
+    double getMaxError() const;
+    qint64 getMemorySize() const;
+
+private:
+    /**
+     * @brief The Node struct
+     *
+     * The anode voltage at a node and its derivatives, scaled to one grid step in each direction.
+     */
+    struct Node {
+        double f;
+        double fx;
+        double fy;
+        double fxy;
+    };
+
+    /**
+     * @brief cell finds the cell containing a point
+     * @return The node at the lower corner of the cell, with its indexes and the position of the point
+     * within the cell in *t and *u
+     */
+    inline const Node *cell(double ia, double vg1, int *i, int *j, double *t, double *u) const
+    {
+        double x = ia > iaMin ? std::log(ia / iaMin) * iaScale : 0.0;
+        double y = (vg1 + vg1Max) * vgScale;
+        x = x > iaLast ? iaLast : x;
+        y = y < 0.0 ? 0.0 : (y > vgLast ? vgLast : y);
+
+        *i = (int) x;
+        *j = (int) y;
+        *i = *i < iaCount - 1 ? *i : iaCount - 2;
+        *j = *j < vgCount - 1 ? *j : vgCount - 2;
+
+        *t = x - *i;
+        *u = y - *j;
+
+        return &nodes[(size_t) *j * iaCount + *i];
+    }
+
+    void sample(Model *model);
+    void computeSlopes();
+    void setGeometry(double iaMax, double vg1Max, int iaCount, int vgCount);
+    double currentAt(double x) const;
+    double probe(Model *model, double tOffset, double uOffset, double *sumSquares = nullptr, qint64 *samples = nullptr) const;
+
+    static double limit(double slope, double previous, double next);
+
+    std::vector<Node> nodes;
+    int iaCount = 0;
+    int vgCount = 0;
+    double iaMin = 0.0;
+    double iaMax = 0.0;
+    double vg1Max = 0.0;
+    double iaScale = 0.0;
+    double vgScale = 0.0;
+    double iaLast = 0.0;
+    double vgLast = 0.0;
+    double targetError = 0.0;
+    double maxError = 0.0;
+    /**
+     * @brief accurate true if the table was built within its error bound
+     */
+    bool accurate = false;
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "ceres/ceres.h"
+
+#include "samplestore.h"
+
+/**
+ * @brief The BatchCostFunction class
+ *
+ * A cost function that evaluates a contiguous range of samples in a SampleStore (usually one grid
+ * voltage curve), producing one residual per sample. The samples are read directly from the store's
+ * arrays rather than being copied. Every parameter block is a single value and the Jacobian for each
+ * parameter block is therefore a column of N values that is written contiguously.
+ *
+ * The Evaluator supplies the model specific maths through a static, inlinable function:
+ *
+ *     static const int parameterCount;
+ *     static bool evaluate(const double *parameters, double va, double vg1, double vg2, double ia,
+ *                          double *residual, double *gradient);
+ *
+ * where gradient (if not NULL) receives the derivative of the residual w.r.t. each parameter.
+ */
+template <typename Evaluator>
+class BatchCostFunction : public ceres::CostFunction
+{
+public:
+    BatchCostFunction(const SampleStore *store, qint64 begin, int count) : store(store), begin(begin), count(count)
+    {
+        set_num_residuals(count);
+        mutable_parameter_block_sizes()->assign(Evaluator::parameterCount, 1);
+    }
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const
+    {
+        double values[Evaluator::parameterCount];
+        for (int j = 0; j < Evaluator::parameterCount; j++) {
+            values[j] = parameters[j][0];
+        }
+
+        const int n = count;
+        const double *va = store->va(begin);
+        const double *ia = store->ia(begin);
+        const double *vg1 = store->vg1(begin);
+        const double *vg2 = store->vg2(begin);
+
+        if (jacobians == NULL) {
+            for (int i = 0; i < n; i++) {
+                if (!Evaluator::evaluate(values, va[i], vg1[i], vg2[i], ia[i], residuals + i, NULL)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        double gradient[Evaluator::parameterCount];
+        for (int i = 0; i < n; i++) {
+            if (!Evaluator::evaluate(values, va[i], vg1[i], vg2[i], ia[i], residuals + i, gradient)) {
+                return false;
+            }
+
+            for (int j = 0; j < Evaluator::parameterCount; j++) {
+                if (jacobians[j] != NULL) {
+                    jacobians[j][i] = gradient[j];
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    const SampleStore *store;
+    const qint64 begin;
+    const int count;
+};
+
+/**
+ * @brief The AnalyticCostFunction class
+ *
+ * Single sample cost function built on the same Evaluator as BatchCostFunction so that the per sample
+ * and batched residual blocks share one implementation of the model and its derivatives.
+ */
+template <typename Evaluator, int... ParameterBlockSizes>
+class AnalyticCostFunction : public ceres::SizedCostFunction<1, ParameterBlockSizes...>
+{
+public:
+    AnalyticCostFunction(double va, double ia, double vg1, double vg2) : va_(va), ia_(ia), vg1_(vg1), vg2_(vg2) {}
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const
+    {
+        double values[Evaluator::parameterCount];
+        for (int j = 0; j < Evaluator::parameterCount; j++) {
+            values[j] = parameters[j][0];
+        }
+
+        double gradient[Evaluator::parameterCount];
+        if (!Evaluator::evaluate(values, va_, vg1_, vg2_, ia_, residuals, jacobians != NULL ? gradient : NULL)) {
+            return false;
+        }
+
+        if (jacobians != NULL) {
+            for (int j = 0; j < Evaluator::parameterCount; j++) {
+                if (jacobians[j] != NULL) {
+                    jacobians[j][0] = gradient[j];
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    const double va_;
+    const double ia_;
+    const double vg1_;
+    const double vg2_;
+};
+
+/**
+ * @brief The PentodeResiduals struct
+ *
+ * The residuals of one pentode sample, the anode current followed by the screen current, shared by
+ * PentodeBatchCostFunction and PentodeCostFunction. The Evaluator supplies the model as a single
+ * template that returns both currents:
+ *
+ *     static const int parameterCount;
+ *     template <typename T>
+ *     static T currents(const T *parameters, const T &va, const T &vg1, const T &vg2, T *ig2);
+ *
+ * The derivatives are found by evaluating the same template with ceres::Jet parameters (forward mode
+ * automatic differentiation), which costs one pass per sample for both residuals and all of the
+ * parameters. A screen current that was not measured (NAN) gives a zero residual with a zero gradient,
+ * so that anode only data can be fitted with the same cost functions.
+ */
+template <typename Evaluator>
+struct PentodeResiduals {
+    static const int parameterCount = Evaluator::parameterCount;
+
+    /**
+     * @brief evaluate
+     * @param parameters The parameter values
+     * @param residual Receives the anode and screen current residuals
+     * @param gradient If not NULL, receives the derivatives of the anode current residual w.r.t. each
+     * parameter followed by those of the screen current residual
+     * @return false if either modelled current is not finite
+     */
+    static inline bool evaluate(const double *parameters, double va, double vg1, double vg2, double ia, double ig2, double *residual, double *gradient)
+    {
+        bool measured = !std::isnan(ig2);
+
+        if (gradient == NULL) {
+            double ig2Model;
+            double iaModel = Evaluator::currents(parameters, va, vg1, vg2, &ig2Model);
+            residual[0] = ia - iaModel;
+            residual[1] = measured ? ig2 - ig2Model : 0.0;
+
+            return std::isfinite(iaModel) && std::isfinite(ig2Model);
+        }
+
+        typedef ceres::Jet<double, parameterCount> Jet;
+
+        Jet values[parameterCount];
+        for (int j = 0; j < parameterCount; j++) {
+            values[j] = Jet(parameters[j], j);
+        }
+
+        Jet ig2Model;
+        Jet iaModel = Evaluator::currents(values, Jet(va), Jet(vg1), Jet(vg2), &ig2Model);
+        residual[0] = ia - iaModel.a;
+        residual[1] = measured ? ig2 - ig2Model.a : 0.0;
+
+        for (int j = 0; j < parameterCount; j++) {
+            gradient[j] = -iaModel.v[j];
+            gradient[parameterCount + j] = measured ? -ig2Model.v[j] : 0.0;
+        }
+
+        return std::isfinite(iaModel.a) && std::isfinite(ig2Model.a);
+    }
+};
+
+/**
+ * @brief The PentodeBatchCostFunction class
+ *
+ * The pentode equivalent of BatchCostFunction: a contiguous range of samples (usually one curve at a
+ * fixed grid and screen voltage) with two residuals per sample, the anode current and the screen
+ * current, so that both are fitted jointly with shared parameters. The residuals of sample i are at
+ * 2i and 2i + 1.
+ */
+template <typename Evaluator>
+class PentodeBatchCostFunction : public ceres::CostFunction
+{
+public:
+    PentodeBatchCostFunction(const SampleStore *store, qint64 begin, int count) : store(store), begin(begin), count(count)
+    {
+        set_num_residuals(2 * count);
+        mutable_parameter_block_sizes()->assign(Evaluator::parameterCount, 1);
+    }
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const
+    {
+        const int m = Evaluator::parameterCount;
+
+        double values[Evaluator::parameterCount];
+        for (int j = 0; j < m; j++) {
+            values[j] = parameters[j][0];
+        }
+
+        const int n = count;
+        const double *va = store->va(begin);
+        const double *ia = store->ia(begin);
+        const double *vg1 = store->vg1(begin);
+        const double *vg2 = store->vg2(begin);
+        const double *ig2 = store->ig2(begin);
+
+        if (jacobians == NULL) {
+            for (int i = 0; i < n; i++) {
+                if (!PentodeResiduals<Evaluator>::evaluate(values, va[i], vg1[i], vg2[i], ia[i], ig2[i], residuals + 2 * i, NULL)) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        double gradient[2 * Evaluator::parameterCount];
+        for (int i = 0; i < n; i++) {
+            if (!PentodeResiduals<Evaluator>::evaluate(values, va[i], vg1[i], vg2[i], ia[i], ig2[i], residuals + 2 * i, gradient)) {
+                return false;
+            }
+
+            for (int j = 0; j < m; j++) {
+                if (jacobians[j] != NULL) {
+                    jacobians[j][2 * i] = gradient[j];
+                    jacobians[j][2 * i + 1] = gradient[m + j];
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    const SampleStore *store;
+    const qint64 begin;
+    const int count;
+};
+
+/**
+ * @brief The PentodeCostFunction class
+ *
+ * Single sample cost function built on the same Evaluator as PentodeBatchCostFunction.
+ */
+template <typename Evaluator, int... ParameterBlockSizes>
+class PentodeCostFunction : public ceres::SizedCostFunction<2, ParameterBlockSizes...>
+{
+public:
+    PentodeCostFunction(double va, double ia, double vg1, double vg2, double ig2) : va_(va), ia_(ia), vg1_(vg1), vg2_(vg2), ig2_(ig2) {}
+
+    virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const
+    {
+        const int m = Evaluator::parameterCount;
+
+        double values[Evaluator::parameterCount];
+        for (int j = 0; j < m; j++) {
+            values[j] = parameters[j][0];
+        }
+
+        double gradient[2 * Evaluator::parameterCount];
+        if (!PentodeResiduals<Evaluator>::evaluate(values, va_, vg1_, vg2_, ia_, ig2_, residuals, jacobians != NULL ? gradient : NULL)) {
+            return false;
+        }
+
+        if (jacobians != NULL) {
+            for (int j = 0; j < m; j++) {
+                if (jacobians[j] != NULL) {
+                    jacobians[j][0] = gradient[j];
+                    jacobians[j][1] = gradient[m + j];
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    const double va_;
+    const double ia_;
+    const double vg1_;
+    const double vg2_;
+    const double ig2_;
+};
@@ -0,0 +1,205 @@
+#include "batchfitter.h"
+#include "measurementloader.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cmath>
+
+BatchFitter::BatchFitter(const QString &inputDirectory, const QString &outputDirectory) :
+    inputDirectory(inputDirectory), outputDirectory(outputDirectory)
+{
+
+}
+
+/**
+ * @brief BatchFitter::setThreadCount sets the number of devices fitted at once
+ * @param newThreadCount The number of worker threads, or 0 to use every core
+ */
+void BatchFitter::setThreadCount(int newThreadCount)
+{
+    threadCount = newThreadCount;
+}
+
+/**
+ * @brief BatchFitter::run fits every measurement file in the input directory
+ * @return A record of the outcome for each file, in the order the files were queued
+ */
+QVector<BatchFitRecord> BatchFitter::run()
+{
+    QDir input(inputDirectory);
+    QFileInfoList files = input.entryInfoList(QStringList() << "*.csv" << "*.txt", QDir::Files);
+
+    std::stable_sort(files.begin(), files.end(), [](const QFileInfo &a, const QFileInfo &b) {
+        return a.size() > b.size(); // Largest first
+    });
+
+    QDir().mkpath(outputDirectory);
+
+    int workers = threadCount > 0 ? threadCount : qMax(1, QThread::idealThreadCount());
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+
+    QVector<BatchFitRecord> records(files.size());
+    for (int i = 0; i < files.size(); i++) {
+        QFileInfo file = files.at(i);
+        BatchFitRecord *record = &records[i];
+        pool.start([this, file, record]() {
+            *record = fitFile(file);
+        });
+    }
+
+    pool.waitForDone();
+
+    writeSummary(records, QDir(outputDirectory).filePath("summary.csv"));
+
+    return records;
+}
+
+/**
+ * @brief BatchFitter::writeSummary writes a CSV report of a batch
+ * @param records The records returned by run()
+ * @param fileName The file to write
+ * @return true if the report was written
+ */
+bool BatchFitter::writeSummary(const QVector<BatchFitRecord> &records, const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning("Unable to write %s", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream << "device,samples,model,rms,screenRms,cost,iterations,fitTime,totalTime,status\n";
+
+    for (int i = 0; i < records.size(); i++) {
+        const BatchFitRecord &record = records.at(i);
+        stream << record.name << ","
+               << record.samples << ","
+               << record.best.modelName << ","
+               << record.best.rms << ","
+               << record.best.screenRms << ","
+               << record.best.cost << ","
+               << record.best.iterations << ","
+               << record.best.wallTime << ","
+               << record.wallTime << ","
+               << (record.success ? QString("ok") : record.error) << "\n";
+    }
+
+    return true;
+}
+
+/**
+ * @brief BatchFitter::readMeasurement reads a measurement file and identifies the kind of device measured
+ * @param fileName The measurement file (CSV or uTracer log, see MeasurementLoader)
+ * @param store Receives the samples
+ * @param deviceType Receives MODEL_PENTODE if every sample has a screen voltage, or MODEL_TRIODE if none has
+ * @param error Receives a description of any failure
+ * @return true if at least one sample was read and the file is a supported triode or pentode measurement
+ */
+bool BatchFitter::readMeasurement(const QString &fileName, SampleStore *store, int *deviceType, QString *error)
+{
+    if (!MeasurementLoader::load(fileName, store, error, 1)) { // Devices are already fitted in parallel
+        return false;
+    }
+
+    qint64 screened = 0;
+    for (qint64 i = store->first(); i < store->end(); i++) {
+        if (*store->vg2(i) != 0.0) {
+            screened++;
+        }
+    }
+
+    if (screened != 0 && screened != store->size()) {
+        *error = QString("Unsupported measurement: %1 of %2 samples have a screen voltage").arg(screened).arg(store->size());
+        return false;
+    }
+
+    *deviceType = screened != 0 ? MODEL_PENTODE : MODEL_TRIODE;
+
+    return true;
+}
+
+/**
+ * @brief BatchFitter::addMeasurement adds the samples read by readMeasurement to a device
+ * @param device The device to add the samples to
+ * @param store The samples
+ *
+ * The device's axis limits are set from the range of the data.
+ */
+void BatchFitter::addMeasurement(Device *device, const SampleStore &store)
+{
+    double vaMax = 0.0;
+    double iaMax = 0.0;
+    double vg1Max = 0.0;
+    double vg2Max = 0.0;
+    double ig2Max = 0.0;
+    for (qint64 i = store.first(); i < store.end(); i++) {
+        vaMax = qMax(vaMax, *store.va(i));
+        iaMax = qMax(iaMax, *store.ia(i));
+        vg1Max = qMax(vg1Max, std::abs(*store.vg1(i)));
+        vg2Max = qMax(vg2Max, *store.vg2(i));
+        if (!std::isnan(*store.ig2(i))) {
+            ig2Max = qMax(ig2Max, *store.ig2(i));
+        }
+    }
+
+    device->addSamples(store);
+
+    device->setVaMax(vaMax);
+    device->setIaMax(iaMax);
+    device->setVg1Max(vg1Max);
+    if (device->getDeviceType() == MODEL_PENTODE) {
+        device->setVg2Max(vg2Max);
+        device->setIg2Max(ig2Max);
+    }
+}
+
+BatchFitRecord BatchFitter::fitFile(const QFileInfo &file)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    BatchFitRecord record;
+    record.name = file.completeBaseName();
+    record.fileName = file.absoluteFilePath();
+
+    SampleStore store;
+    int deviceType = MODEL_TRIODE;
+
+    if (readMeasurement(record.fileName, &store, &deviceType, &record.error)) {
+        record.samples = (int) store.size();
+
+        Device device(deviceType);
+        device.setName(record.name);
+        addMeasurement(&device, store);
+
+        QVector<FitResult> results = device.solveAll(1); // One core per device; the pool provides the parallelism
+        record.best = results.first();
+
+        QJsonObject json;
+        device.toJson(json);
+
+        QFile output(QDir(outputDirectory).filePath(record.name + ".json"));
+        if (output.open(QIODevice::WriteOnly)) {
+            output.write(QJsonDocument(json).toJson());
+            record.success = record.best.usable;
+            if (!record.success) {
+                record.error = "No usable fit";
+            }
+        } else {
+            record.error = output.errorString();
+        }
+    }
+
+    record.wallTime = timer.nsecsElapsed() / 1.0e6;
+
+    return record;
+}
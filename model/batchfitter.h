@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QFileInfo>
+#include <QString>
+#include <QVector>
+
+#include "device.h"
+#include "fitresult.h"
+
+/**
+ * @brief The BatchFitRecord struct
+ *
+ * The outcome of fitting the device described by one measurement file.
+ */
+struct BatchFitRecord {
+    /**
+     * @brief name The device name (the base name of the measurement file)
+     */
+    QString name;
+    /**
+     * @brief fileName The measurement file
+     */
+    QString fileName;
+    /**
+     * @brief samples The number of samples read from the file
+     */
+    int samples = 0;
+    /**
+     * @brief best The fit of the best model for the device
+     */
+    FitResult best;
+    /**
+     * @brief wallTime The total time in ms to read, fit and write the device
+     */
+    double wallTime = 0.0;
+    /**
+     * @brief success True if the device was fitted and its model written
+     */
+    bool success = false;
+    /**
+     * @brief error A description of the failure if success is false
+     */
+    QString error;
+};
+
+/**
+ * @brief The BatchFitter class
+ *
+ * Fits every measurement file (CSV or uTracer log) in a directory without any UI, writing the toJson output of each fitted
+ * Device to the output directory together with a summary report (summary.csv). Each file is fitted
+ * as a pentode if its screen voltage is nonzero and as a triode otherwise; a file that mixes the two is
+ * reported as unsupported rather than fitted.
+ *
+ * Each device is a task on a shared thread pool. Idle workers take the next task from the queue, so a
+ * large sweep only ever occupies one worker while the small ones flow past it. Tasks are queued
+ * largest file first so that the biggest sweeps do not end up running alone at the end of the batch.
+ */
+class BatchFitter
+{
+public:
+    BatchFitter(const QString &inputDirectory, const QString &outputDirectory);
+
+    void setThreadCount(int newThreadCount);
+
+    QVector<BatchFitRecord> run();
+    bool writeSummary(const QVector<BatchFitRecord> &records, const QString &fileName);
+
+    static bool readMeasurement(const QString &fileName, SampleStore *store, int *deviceType, QString *error);
+    static void addMeasurement(Device *device, const SampleStore &store);
+
+private:
+    QString inputDirectory;
+    QString outputDirectory;
+    int threadCount = 0;
+
+    BatchFitRecord fitFile(const QFileInfo &file);
+};
@@ -0,0 +1,17 @@
+#include "derkepentode.h"
+
+DerkEPentode::DerkEPentode()
+{
+    exponential = true;
+    jsonKey = "derkE";
+}
+
+QString DerkEPentode::getName()
+{
+    return QString("DerkE Pentode");
+}
+
+int DerkEPentode::getType()
+{
+    return DERKE_PENTODE;
+}
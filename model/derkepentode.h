@@ -0,0 +1,18 @@
+#pragma once
+
+#include "derkpentode.h"
+
+/**
+ * @brief The DerkEPentode class
+ *
+ * The Derk pentode with the exponential screen current recovery term exp(-(beta * va)^1.5), which
+ * suits devices whose screen current falls more sharply with anode voltage at the knee.
+ */
+class DerkEPentode : public DerkPentode
+{
+public:
+    DerkEPentode();
+
+    virtual QString getName();
+    virtual int getType();
+};
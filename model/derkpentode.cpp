@@ -0,0 +1,247 @@
+#include "derkpentode.h"
+
+/**
+ * @brief The DerkPentodeEvaluator struct
+ *
+ * The Derk (Exponential false) and DerkE (Exponential true) pentodes for PentodeBatchCostFunction and
+ * PentodeCostFunction. The parameters are, in order, Kg1, Kp, alpha, mu, Kg2, A, alphaS and beta.
+ */
+template <bool Exponential>
+struct DerkPentodeEvaluator {
+    static const int parameterCount = 8;
+
+    template <typename T>
+    static inline T currents(const T *parameters, const T &va, const T &vg1, const T &vg2, T *ig2)
+    {
+        const DerkPentodeParameters<T> p = { parameters[0], parameters[1], parameters[2], parameters[3], parameters[4], parameters[5], parameters[6], parameters[7] };
+
+        return current(p, va, vg1, vg2, ig2);
+    }
+
+    template <typename T>
+    static inline T current(const DerkPentodeParameters<T> &p, const T &va, const T &vg1, const T &vg2, T *ig2)
+    {
+        T recovery = Exponential ? derkERecovery(p.beta, va) : derkRecovery(p.beta, va);
+
+        return derkPentodeCurrent(p, va, vg1, vg2, recovery, ig2);
+    }
+};
+
+typedef PentodeCostFunction<DerkPentodeEvaluator<false>, 1, 1, 1, 1, 1, 1, 1, 1> DerkPentodeCostFunction;
+typedef PentodeCostFunction<DerkPentodeEvaluator<true>, 1, 1, 1, 1, 1, 1, 1, 1> DerkEPentodeCostFunction;
+
+/**
+ * @brief derkCurrents evaluates the anode (or screen) currents for arrays of samples
+ * @param screen If true, the screen currents are written to currents, otherwise the anode currents
+ *
+ * The parameters are bound once for the whole array and, without screen voltages, the currents are zero.
+ */
+template <bool Exponential>
+static void derkCurrents(const DerkPentodeParameters<double> &p, const double *va, const double *vg1, const double *vg2, double *currents, int count, bool screen)
+{
+    for (int i = 0; i < count; i++) {
+        double ig2;
+        double ia = DerkPentodeEvaluator<Exponential>::current(p, va[i], vg1[i], vg2 != nullptr ? vg2[i] : 0.0, &ig2);
+        currents[i] = screen ? ig2 : ia;
+    }
+}
+
+DerkPentode::DerkPentode()
+{
+    parameter[PENT_KG1] = new Parameter("Kg1:", 0.65);
+    parameter[PENT_KP] = new Parameter("Kp:", 60.0);
+    parameter[PENT_ALPHA] = new Parameter("Alpha:", 1.35);
+    parameter[PENT_MU] = new Parameter("Mu:", 11.0);
+    parameter[PENT_KG2] = new Parameter("Kg2:", 4.2);
+    parameter[PENT_A] = new Parameter("A:", 0.0005);
+    parameter[PENT_ALPHA_S] = new Parameter("AlphaS:", 5.0);
+    parameter[PENT_BETA] = new Parameter("Beta:", 0.1);
+}
+
+/**
+ * @brief DerkPentode::createCostFunction
+ *
+ * The pentode cost functions already differentiate the model automatically (see PentodeResiduals),
+ * so the automatic differentiation reference mode uses the same cost function.
+ */
+CostFunction *DerkPentode::createCostFunction(double va, double ia, double vg1, double vg2, double ig2)
+{
+    if (exponential) {
+        return new DerkEPentodeCostFunction(va, ia, vg1, vg2, ig2);
+    }
+
+    return new DerkPentodeCostFunction(va, ia, vg1, vg2, ig2);
+}
+
+CostFunction *DerkPentode::createBatchCostFunction(qint64 begin, int count)
+{
+    if (exponential) {
+        return new PentodeBatchCostFunction<DerkPentodeEvaluator<true>>(&samples, begin, count);
+    }
+
+    return new PentodeBatchCostFunction<DerkPentodeEvaluator<false>>(&samples, begin, count);
+}
+
+std::vector<double *> DerkPentode::parameterBlocks()
+{
+    return {
+        parameter[PENT_KG1]->getPointer(),
+        parameter[PENT_KP]->getPointer(),
+        parameter[PENT_ALPHA]->getPointer(),
+        parameter[PENT_MU]->getPointer(),
+        parameter[PENT_KG2]->getPointer(),
+        parameter[PENT_A]->getPointer(),
+        parameter[PENT_ALPHA_S]->getPointer(),
+        parameter[PENT_BETA]->getPointer()
+    };
+}
+
+double DerkPentode::anodeCurrent(double va, double vg1, double vg2)
+{
+    double ia;
+    anodeCurrents(&va, &vg1, &vg2, &ia, 1);
+
+    return ia;
+}
+
+void DerkPentode::anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count)
+{
+    if (exponential) {
+        derkCurrents<true>(derkPentodeParameters(), va, vg1, vg2, ia, count, false);
+    } else {
+        derkCurrents<false>(derkPentodeParameters(), va, vg1, vg2, ia, count, false);
+    }
+}
+
+double DerkPentode::screenCurrent(double va, double vg1, double vg2)
+{
+    double ig2;
+    screenCurrents(&va, &vg1, &vg2, &ig2, 1);
+
+    return ig2;
+}
+
+void DerkPentode::screenCurrents(const double *va, const double *vg1, const double *vg2, double *ig2, int count)
+{
+    if (exponential) {
+        derkCurrents<true>(derkPentodeParameters(), va, vg1, vg2, ig2, count, true);
+    } else {
+        derkCurrents<false>(derkPentodeParameters(), va, vg1, vg2, ig2, count, true);
+    }
+}
+
+/**
+ * @brief DerkPentode::derkPentodeParameters
+ * @return A snapshot of the parameters for use with derkPentodeCurrent
+ */
+DerkPentodeParameters<double> DerkPentode::derkPentodeParameters() const
+{
+    DerkPentodeParameters<double> p;
+    p.kg1 = parameter[PENT_KG1]->getValue();
+    p.kp = parameter[PENT_KP]->getValue();
+    p.alpha = parameter[PENT_ALPHA]->getValue();
+    p.mu = parameter[PENT_MU]->getValue();
+    p.kg2 = parameter[PENT_KG2]->getValue();
+    p.a = parameter[PENT_A]->getValue();
+    p.alphaS = parameter[PENT_ALPHA_S]->getValue();
+    p.beta = parameter[PENT_BETA]->getValue();
+
+    return p;
+}
+
+void DerkPentode::fromJson(QJsonObject source)
+{
+    if (source.contains("kg1") && source["kg1"].isDouble()) {
+        parameter[PENT_KG1]->setValue(source["kg1"].toDouble());
+    }
+
+    if (source.contains("kp") && source["kp"].isDouble()) {
+        parameter[PENT_KP]->setValue(source["kp"].toDouble());
+    }
+
+    if (source.contains("alpha") && source["alpha"].isDouble()) {
+        parameter[PENT_ALPHA]->setValue(source["alpha"].toDouble());
+    }
+
+    if (source.contains("mu") && source["mu"].isDouble()) {
+        parameter[PENT_MU]->setValue(source["mu"].toDouble());
+    }
+
+    if (source.contains("kg2") && source["kg2"].isDouble()) {
+        parameter[PENT_KG2]->setValue(source["kg2"].toDouble());
+    }
+
+    if (source.contains("a") && source["a"].isDouble()) {
+        parameter[PENT_A]->setValue(source["a"].toDouble());
+    }
+
+    if (source.contains("alphaS") && source["alphaS"].isDouble()) {
+        parameter[PENT_ALPHA_S]->setValue(source["alphaS"].toDouble());
+    }
+
+    if (source.contains("beta") && source["beta"].isDouble()) {
+        parameter[PENT_BETA]->setValue(source["beta"].toDouble());
+    }
+
+    scheduleInverseTable();
+}
+
+void DerkPentode::toJson(QJsonObject &destination, double vg1Max, double vg2Max)
+{
+    QJsonObject model;
+    model["kg1"] = parameter[PENT_KG1]->getValue();
+    model["kp"] = parameter[PENT_KP]->getValue();
+    model["alpha"] = parameter[PENT_ALPHA]->getValue();
+    model["mu"] = parameter[PENT_MU]->getValue();
+    model["kg2"] = parameter[PENT_KG2]->getValue();
+    model["a"] = parameter[PENT_A]->getValue();
+    model["alphaS"] = parameter[PENT_ALPHA_S]->getValue();
+    model["beta"] = parameter[PENT_BETA]->getValue();
+
+    QJsonObject pentode;
+    pentode["vg1Max"] = vg1Max;
+    pentode["vg2Max"] = vg2Max;
+    pentode[jsonKey] = model;
+
+    destination["pentode"] = pentode;
+}
+
+void DerkPentode::updateUI(QLabel *labels[], QLineEdit *values[])
+{
+    int i = 0;
+
+    updateParameter(labels[i], values[i], parameter[PENT_MU]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_KG1]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_KG2]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_ALPHA]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_KP]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_A]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_ALPHA_S]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_BETA]); i++;
+}
+
+QString DerkPentode::getName()
+{
+    return QString("Derk Pentode");
+}
+
+int DerkPentode::getType()
+{
+    return DERK_PENTODE;
+}
+
+void DerkPentode::setOptions()
+{
+    options.max_num_iterations = 100;
+
+    setLowerBound(parameter[PENT_KG1], 0.0000001); // Kg1 > 0
+    setLowerBound(parameter[PENT_KG2], 0.0000001); // Kg2 > 0
+    setLimits(parameter[PENT_KP], 1.0, 1000.0); // 1.0 <= Kp <= 1000.0
+    setLimits(parameter[PENT_ALPHA], 1.0, 2.0); // 1.0 <= alpha <= 2.0
+    setLimits(parameter[PENT_MU], 1.0, 1000.0); // 1.0 <= mu <= 1000.0
+    setLimits(parameter[PENT_A], 0.0, 1.0); // 0.0 <= A <= 1.0
+    setLimits(parameter[PENT_ALPHA_S], 0.0, 100.0); // 0.0 <= alphaS <= 100.0
+    setLimits(parameter[PENT_BETA], 0.0, 10.0); // 0.0 <= beta <= 10.0
+    options.linear_solver_type = ceres::CGNR;
+    options.preconditioner_type = ceres::JACOBI;
+}
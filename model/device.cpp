@@ -1,20 +1,33 @@
 #include "device.h"
 
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+
 Device::Device(int _modelDeviceType) : deviceType(_modelDeviceType)
 {
     if (deviceType == MODEL_TRIODE) {
         modelType = IMPROVED_KOREN_TRIODE;
+
+        models.append(ModelFactory::createModel(IMPROVED_KOREN_TRIODE));
+        models.append(ModelFactory::createModel(KOREN_TRIODE));
+        models.append(ModelFactory::createModel(SIMPLE_TRIODE));
+        currentModel = models.first();
+    } else if (deviceType == MODEL_PENTODE) {
+        modelType = DERKE_PENTODE;
+
+        models.append(ModelFactory::createModel(DERKE_PENTODE));
+        models.append(ModelFactory::createModel(DERK_PENTODE));
+        models.append(ModelFactory::createModel(KOREN_PENTODE));
+        currentModel = models.first();
     }
+
+    configureInverseTables();
 }
 
 Device::Device(QJsonDocument modelDocument)
 {
-    vaMax = 400.0;
-    iaMax = 6.0;
-    vg1Max = 4.0;
-    vg2Max = vaMax;
-    paMax = 1.25;
-
     if (modelDocument.isObject()) {
         QJsonObject modelObject = modelDocument.object();
 
@@ -61,6 +74,80 @@ Device::Device(QJsonDocument modelDocument)
                 models.append(newModel);
             }
         }
+
+        if (modelObject.contains("pentode") && modelObject["pentode"].isObject()) {
+            QJsonObject pentode = modelObject["pentode"].toObject();
+
+            deviceType = MODEL_PENTODE;
+
+            if (pentode.contains("vg1Max") && pentode["vg1Max"].isDouble()) {
+                vg1Max = pentode["vg1Max"].toDouble();
+            }
+
+            if (pentode.contains("vg2Max") && pentode["vg2Max"].isDouble()) {
+                vg2Max = pentode["vg2Max"].toDouble();
+            }
+
+            if (pentode.contains("ig2Max") && pentode["ig2Max"].isDouble()) {
+                ig2Max = pentode["ig2Max"].toDouble();
+            }
+
+            if (pentode.contains("derkE") && pentode["derkE"].isObject()) {
+                Model *newModel = new DerkEPentode();
+                newModel->fromJson(pentode["derkE"].toObject());
+                models.append(newModel);
+            }
+
+            if (pentode.contains("derk") && pentode["derk"].isObject()) {
+                Model *newModel = new DerkPentode();
+                newModel->fromJson(pentode["derk"].toObject());
+                models.append(newModel);
+            }
+
+            if (pentode.contains("koren") && pentode["koren"].isObject()) {
+                Model *newModel = new KorenPentode();
+                newModel->fromJson(pentode["koren"].toObject());
+                models.append(newModel);
+            }
+        }
+
+        if (!models.isEmpty()) {
+            currentModel = models.first();
+            modelType = currentModel->getType();
+        }
+    }
+
+    configureInverseTables();
+}
+
+Device::~Device()
+{
+    qDeleteAll(models);
+}
+
+/**
+ * @brief Device::addSample adds a measured sample to every model of the device
+ * @param va The anode voltage
+ * @param ia The anode current in mA
+ * @param vg1 The grid voltage
+ * @param vg2 For pentodes only, the screen grid voltage
+ * @param ig2 For pentodes only, the screen current in mA, or NAN if it was not measured
+ */
+void Device::addSample(double va, double ia, double vg1, double vg2, double ig2)
+{
+    for (int i = 0; i < models.size(); i++) {
+        models.at(i)->addSample(va, ia, vg1, vg2, ig2);
+    }
+}
+
+/**
+ * @brief Device::addSamples adds every sample held by a SampleStore to every model of the device
+ * @param samples The samples to add, e.g. as read by MeasurementLoader
+ */
+void Device::addSamples(const SampleStore &samples)
+{
+    for (int i = 0; i < models.size(); i++) {
+        models.at(i)->addSamples(samples);
     }
 }
 
@@ -71,6 +158,161 @@ void Device::solve()
     }
 }
 
+/**
+ * @brief Device::solveAsync fits the current model on the global thread pool without blocking
+ * @param progress Called (on the worker thread) at the end of every iteration
+ * @param timeout The time in ms by which the fit must finish, or -1 for no deadline
+ * @return A handle with which to watch, cancel or wait for the fit, or a null handle if there is no
+ * current model
+ *
+ * The device must not be solved or modified until the fit has finished.
+ */
+QSharedPointer<FitHandle> Device::solveAsync(const IterationHook &progress, qint64 timeout)
+{
+    if (currentModel == nullptr) {
+        return QSharedPointer<FitHandle>();
+    }
+
+    return FitHandle::start(currentModel, progress, timeout);
+}
+
+/**
+ * @brief Device::solveAll fits every model of the device concurrently and selects the best
+ * @param cores The number of cores to use, or 0 to use all of them
+ * @return The fit results ranked from best (lowest cost) to worst
+ *
+ * Each model owns its own Problem so the models are fitted in parallel on a thread pool. The available
+ * cores are shared out between the concurrent fits (and used by Ceres within each fit) so that the
+ * total number of threads never exceeds the core count. The model with the lowest final cost among
+ * those with a usable solution becomes the current model.
+ */
+QVector<FitResult> Device::solveAll(int cores)
+{
+    QVector<FitResult> results(models.size());
+
+    if (models.isEmpty()) {
+        return results;
+    }
+
+    if (cores <= 0) {
+        cores = qMax(1, QThread::idealThreadCount());
+    }
+    int concurrentFits = qMin((int) models.size(), cores);
+    int threadsPerFit = qMax(1, cores / concurrentFits);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(concurrentFits);
+
+    for (int i = 0; i < models.size(); i++) {
+        Model *model = models.at(i);
+        FitResult *result = &results[i];
+        model->setThreadCount(threadsPerFit);
+        pool.start([model, result]() {
+            *result = model->solve();
+        });
+    }
+
+    pool.waitForDone();
+
+    int best = -1;
+    for (int i = 0; i < results.size(); i++) {
+        if (results.at(i).usable && (best < 0 || results.at(i).cost < results.at(best).cost)) {
+            best = i;
+        }
+    }
+
+    if (best >= 0) {
+        currentModel = models.at(best);
+        modelType = currentModel->getType();
+    }
+
+    std::stable_sort(results.begin(), results.end(), [](const FitResult &a, const FitResult &b) {
+        if (a.usable != b.usable) {
+            return a.usable;
+        }
+        return a.cost < b.cost;
+    });
+
+    return results;
+}
+
+/**
+ * @brief Device::solveCascade fits the triode models in order of complexity, seeding each from the last
+ * @param compareColdStart If true, each model is also fitted from its default parameters for comparison
+ * @return The results of the cascade and, optionally, of the cold starts
+ *
+ * The models are fitted Simple, then Koren, then Improved Koren, with each model seeded from the
+ * converged parameters of the models before it. The final (most complex) model becomes the current
+ * model. When compareColdStart is set, each model is first fitted from its default parameters and
+ * then reset to them before the warm start, so both fits use the same data and the same problem.
+ */
+CascadeResult Device::solveCascade(bool compareColdStart)
+{
+    CascadeResult result;
+
+    QList<Model *> chain;
+    for (int i = 0; i < models.size(); i++) {
+        if (models.at(i)->getType() <= IMPROVED_KOREN_TRIODE) {
+            chain.append(models.at(i));
+        }
+    }
+
+    if (chain.isEmpty()) {
+        return result;
+    }
+
+    std::stable_sort(chain.begin(), chain.end(), [](Model *a, Model *b) {
+        return a->getType() < b->getType();
+    });
+
+    for (int i = 0; i < chain.size(); i++) {
+        Model *model = chain.at(i);
+
+        if (compareColdStart) {
+            QVector<double> defaults = model->getParameterValues();
+            result.coldStart.append(model->solve());
+            model->setParameterValues(defaults);
+        }
+
+        for (int j = 0; j < i; j++) {
+            model->seedFrom(chain.at(j));
+        }
+
+        // Koren does not fit Vct, so Improved Koren must start from the Vct that Simple fitted
+        if (model->getType() == IMPROVED_KOREN_TRIODE && chain.first()->getType() == SIMPLE_TRIODE) {
+            double seeded = model->getParameterValues().at(TRI_VCT);
+            double fitted = chain.first()->getParameterValues().at(TRI_VCT);
+            if (seeded != fitted) {
+                qWarning("Cascade seeded %s with Vct %g rather than the %g fitted by %s",
+                         model->getName().toLocal8Bit().constData(), seeded, fitted,
+                         chain.first()->getName().toLocal8Bit().constData());
+            }
+        }
+
+        result.cascade.append(model->solve());
+    }
+
+    currentModel = chain.last();
+    modelType = currentModel->getType();
+
+    if (compareColdStart) {
+        int cascadeIterations = 0;
+        double cascadeTime = 0.0;
+        for (int i = 0; i < result.cascade.size(); i++) {
+            cascadeIterations += result.cascade.at(i).iterations;
+            cascadeTime += result.cascade.at(i).wallTime;
+        }
+
+        result.iterationsSaved = result.coldStart.last().iterations - cascadeIterations;
+        result.timeSaved = result.coldStart.last().wallTime - cascadeTime;
+
+        qInfo("Cascade saved %d iterations and %.1f ms against a cold start of %s",
+              result.iterationsSaved, result.timeSaved, currentModel->getName().toLocal8Bit().constData());
+    }
+
+    return result;
+}
+
 double Device::anodeCurrent(double va, double vg1, double vg2)
 {
     if (currentModel != nullptr) {
@@ -80,18 +322,111 @@ double Device::anodeCurrent(double va, double vg1, double vg2)
     return 0.0;
 }
 
-double Device::anodeVoltage(double ia, double vg1, double vg2)
+void Device::anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count)
+{
+    if (currentModel != nullptr) {
+        currentModel->anodeCurrents(va, vg1, vg2, ia, count);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        ia[i] = 0.0;
+    }
+}
+
+/**
+ * @brief Device::anodeCurrentGradient calculates the anode current of the current model and its derivatives
+ * @return The anode current in mA, or 0 (with zero derivatives) if there is no current model
+ */
+double Device::anodeCurrentGradient(double va, double vg1, double vg2, double *dIaDva, double *dIaDvg1)
+{
+    if (currentModel != nullptr) {
+        return currentModel->anodeCurrentGradient(va, vg1, vg2, dIaDva, dIaDvg1);
+    }
+
+    *dIaDva = 0.0;
+    *dIaDvg1 = 0.0;
+
+    return 0.0;
+}
+
+double Device::anodeVoltage(double ia, double vg1, double vg2, double vaGuess)
+{
+    if (currentModel != nullptr) {
+        return currentModel->anodeVoltage(ia, vg1, vg2, vaGuess);
+    }
+
+    return 0.0;
+}
+
+void Device::anodeVoltages(const double *ia, const double *vg1, const double *vg2, double *va, int count)
+{
+    if (currentModel != nullptr) {
+        currentModel->anodeVoltages(ia, vg1, vg2, va, count);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        va[i] = 0.0;
+    }
+}
+
+double Device::gridVoltage(double ia, double va, double vg2, double vg1Guess)
 {
     if (currentModel != nullptr) {
-        return currentModel->anodeVoltage(ia, vg1, vg2);
+        return currentModel->gridVoltage(ia, va, vg2, vg1Guess);
     }
 
     return 0.0;
 }
 
+double Device::screenCurrent(double va, double vg1, double vg2)
+{
+    if (currentModel != nullptr) {
+        return currentModel->screenCurrent(va, vg1, vg2);
+    }
+
+    return 0.0;
+}
+
+/**
+ * @brief Device::toJson writes the device limits and the parameters of every model to a Json object
+ * @param destination The Json object to write to
+ *
+ * The models each write their own section of the "triode" (or "pentode") object and these are merged
+ * so that the output can be read back by Device(QJsonDocument).
+ */
+void Device::toJson(QJsonObject &destination)
+{
+    destination["name"] = name;
+    destination["vaMax"] = vaMax;
+    destination["iaMax"] = iaMax;
+    destination["paMax"] = paMax;
+
+    QString section = deviceType == MODEL_PENTODE ? "pentode" : "triode";
+
+    QJsonObject device;
+    for (int i = 0; i < models.size(); i++) {
+        QJsonObject modelObject;
+        models.at(i)->toJson(modelObject, vg1Max, vg2Max);
+
+        QJsonObject modelSection = modelObject[section].toObject();
+        QStringList keys = modelSection.keys();
+        for (int j = 0; j < keys.size(); j++) {
+            device[keys.at(j)] = modelSection[keys.at(j)];
+        }
+    }
+
+    if (deviceType == MODEL_PENTODE) {
+        device["ig2Max"] = ig2Max;
+    }
+
+    destination[section] = device;
+}
+
 void Device::updateUI(QLabel *labels[], QLineEdit *values[])
 {
-    for (int i=0; i < 7; i++) { // Parameters all initially hidden
+    for (int i=0; i < 8; i++) { // Parameters all initially hidden
         values[i]->setVisible(false);
         labels[i]->setVisible(false);
     }
@@ -114,6 +449,7 @@ void Device::updateModelSelect(QComboBox *select)
 void Device::selectModel(int index)
 {
     currentModel = models.at(index);
+    modelType = currentModel->getType();
 }
 
 void Device::anodeAxes(Plot *plot)
@@ -142,17 +478,23 @@ QGraphicsItemGroup *Device::anodePlot(Plot *plot)
 
     double vg1 = 0.0;
 
+    double va[101];
+    double vg[101];
+    double vs[101];
+    double ia[101];
+    for (int j = 0; j < 101; j++) {
+        va[j] = (vaMax * j) / 100.0;
+        vs[j] = vg2Max; // Pentode curves are plotted at the maximum screen voltage
+    }
+
     while (vg1 < vg1Max) { // vg1 will be made -ve in order to calculate ia
-        double va = 0.0;
-        double ia = currentModel->anodeCurrent(va, -vg1);
+        for (int j = 0; j < 101; j++) {
+            vg[j] = -vg1;
+        }
+        currentModel->anodeCurrents(va, vg, deviceType == MODEL_PENTODE ? vs : nullptr, ia, 101);
 
         for (int j=1; j < 101; j++) {
-            double vaNext = (vaMax * j) / 100.0;
-            double iaNext = currentModel->anodeCurrent(vaNext, -vg1);
-            segments.append(plot->createSegment(va, ia, vaNext, iaNext, modelPen));
-
-            va = vaNext;
-            ia = iaNext;
+            segments.append(plot->createSegment(va[j - 1], ia[j - 1], va[j], ia[j], modelPen));
         }
 
         vg1 += vgInterval;
@@ -168,6 +510,35 @@ QGraphicsItemGroup *Device::transferPlot(Plot *plot)
     return plot->getScene()->createItemGroup(segments);
 }
 
+/**
+ * @brief Device::samplePlot plots the measured samples held by the current model
+ * @param plot The plot to draw on
+ * @return The group of plotted segments
+ *
+ * The samples are read directly from the model's SampleStore and consecutive samples with the same
+ * grid voltage are joined to draw each measured curve.
+ */
+QGraphicsItemGroup *Device::samplePlot(Plot *plot)
+{
+    QList<QGraphicsItem *> segments;
+
+    if (currentModel == nullptr) {
+        return plot->getScene()->createItemGroup(segments);
+    }
+
+    QPen samplePen;
+    samplePen.setColor(QColor::fromRgb(0, 0, 0));
+
+    const SampleStore &samples = currentModel->getSamples();
+    for (qint64 i = samples.first() + 1; i < samples.end(); i++) {
+        if (*samples.vg1(i) == *samples.vg1(i - 1) && *samples.vg2(i) == *samples.vg2(i - 1)) {
+            segments.append(plot->createSegment(*samples.va(i - 1), *samples.ia(i - 1), *samples.va(i), *samples.ia(i), samplePen));
+        }
+    }
+
+    return plot->getScene()->createItemGroup(segments);
+}
+
 double Device::interval(double maxValue)
 {
     double interval = 0.5;
@@ -212,14 +583,31 @@ QString Device::getName()
     return name;
 }
 
+void Device::setName(const QString &newName)
+{
+    name = newName;
+}
+
 int Device::getModelType() const
 {
     return modelType;
 }
 
-void Device::setModelType(int newModelType)
+/**
+ * @brief Device::setModelType makes the model of a type the current model
+ * @param newModelType The eModelType
+ * @return true if the device has a model of that type, otherwise the current model is unchanged
+ */
+bool Device::setModelType(int newModelType)
 {
-    modelType = newModelType;
+    for (int i = 0; i < models.size(); i++) {
+        if (models.at(i)->getType() == newModelType) {
+            selectModel(i);
+            return true;
+        }
+    }
+
+    return false;
 }
 
 double Device::getParameter(int index) const
@@ -227,6 +615,31 @@ double Device::getParameter(int index) const
     return 0.0;
 }
 
+/**
+ * @brief Device::getParameterValues
+ * @return A snapshot of the parameters of the current model (see Model::getParameterValues), or an
+ * empty vector if there is no current model
+ */
+QVector<double> Device::getParameterValues() const
+{
+    if (currentModel != nullptr) {
+        return currentModel->getParameterValues();
+    }
+
+    return QVector<double>();
+}
+
+/**
+ * @brief Device::setParameterValues sets the parameters of the current model
+ * @param values A snapshot taken with getParameterValues, possibly from another device with the same model
+ */
+void Device::setParameterValues(const QVector<double> &values)
+{
+    if (currentModel != nullptr) {
+        currentModel->setParameterValues(values);
+    }
+}
+
 double Device::getVaMax() const
 {
     return vaMax;
@@ -247,7 +660,68 @@ double Device::getVg2Max() const
     return vg2Max;
 }
 
+double Device::getIg2Max() const
+{
+    return ig2Max;
+}
+
 double Device::getPaMax() const
 {
     return paMax;
 }
+
+void Device::setVaMax(double newVaMax)
+{
+    vaMax = newVaMax;
+}
+
+void Device::setIaMax(double newIaMax)
+{
+    iaMax = newIaMax;
+    configureInverseTables();
+}
+
+void Device::setVg1Max(double newVg1Max)
+{
+    vg1Max = newVg1Max;
+    configureInverseTables();
+}
+
+void Device::setVg2Max(double newVg2Max)
+{
+    vg2Max = newVg2Max;
+}
+
+void Device::setIg2Max(double newIg2Max)
+{
+    ig2Max = newIg2Max;
+}
+
+/**
+ * @brief Device::setInverseTables selects whether anode voltages are interpolated from inverse tables
+ * @param newInverseTables If true (the default), each model answers anodeVoltage from an
+ * AnodeVoltageTable covering iaMax and vg1Max, otherwise every query is solved directly
+ */
+void Device::setInverseTables(bool newInverseTables)
+{
+    inverseTables = newInverseTables;
+    configureInverseTables();
+}
+
+/**
+ * @brief Device::configureInverseTables
+ *
+ * The tables cover the triode models only, as the pentode models also depend on the screen voltage.
+ * Only the ranges are set here: each table is built from fitted (or loaded) parameters on its first
+ * query, so constructing a Device or changing iaMax or vg1Max does not build tables from defaults.
+ */
+void Device::configureInverseTables()
+{
+    for (int i = 0; i < models.size(); i++) {
+        if (inverseTables && iaMax > 0.0 && vg1Max > 0.0 && models.at(i)->getType() <= IMPROVED_KOREN_TRIODE) {
+            models.at(i)->setInverseTable(iaMax, vg1Max);
+        } else {
+            models.at(i)->clearInverseTable();
+        }
+    }
+}
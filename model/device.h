@@ -8,6 +8,7 @@
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QGraphicsItemGroup>
+#include <QVector>
 
 #include "ceres/ceres.h"
 #include "glog/logging.h"
@@ -19,6 +20,12 @@
 #include "simpletriode.h"
 #include "korentriode.h"
 #include "improvedkorentriode.h"
+#include "korenpentode.h"
+#include "derkpentode.h"
+#include "derkepentode.h"
+#include "modelfactory.h"
+#include "fitresult.h"
+#include "fithandle.h"
 
 enum eModelDeviceType {
     MODEL_TRIODE,
@@ -38,13 +45,28 @@ class Device : UIBridge
 public:
     Device(int _modelDeviceType);
     Device(QJsonDocument model);
+    ~Device();
 
     double getParameter(int index) const;
+    QVector<double> getParameterValues() const;
+    void setParameterValues(const QVector<double> &values);
 
+    void addSample(double va, double ia, double vg1, double vg2 = 0.0, double ig2 = NAN);
+    void addSamples(const SampleStore &samples);
     void solve();
+    QSharedPointer<FitHandle> solveAsync(const IterationHook &progress = IterationHook(), qint64 timeout = -1);
+    QVector<FitResult> solveAll(int cores = 0);
+    CascadeResult solveCascade(bool compareColdStart = false);
 
     double anodeCurrent(double va, double vg1, double vg2 = 0);
-    double anodeVoltage(double ia, double vg1, double vg2 = 0);
+    void anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count);
+    double anodeCurrentGradient(double va, double vg1, double vg2, double *dIaDva, double *dIaDvg1);
+    double anodeVoltage(double ia, double vg1, double vg2 = 0, double vaGuess = 0);
+    void anodeVoltages(const double *ia, const double *vg1, const double *vg2, double *va, int count);
+    double gridVoltage(double ia, double va, double vg2 = 0, double vg1Guess = 0);
+    double screenCurrent(double va, double vg1, double vg2);
+
+    void toJson(QJsonObject &destination);
 
     void updateUI(QLabel *labels[], QLineEdit *values[]);
     void updateModelSelect(QComboBox *select);
@@ -53,24 +75,36 @@ public:
     void transferAxes(Plot *plot);
     QGraphicsItemGroup *anodePlot(Plot *plot);
     QGraphicsItemGroup *transferPlot(Plot *plot);
+    QGraphicsItemGroup *samplePlot(Plot *plot);
     double interval(double maxValue);
 
     int getModelType() const;
-    void setModelType(int newModelType);
+    bool setModelType(int newModelType);
 
     double getVaMax() const;
     double getIaMax() const;
     double getVg1Max() const;
     double getVg2Max() const;
+    double getIg2Max() const;
     double getPaMax() const;
 
+    void setVaMax(double newVaMax);
+    void setIaMax(double newIaMax);
+    void setVg1Max(double newVg1Max);
+    void setVg2Max(double newVg2Max);
+    void setIg2Max(double newIg2Max);
+    void setInverseTables(bool newInverseTables);
+
     int getDeviceType() const;
 
     void setDeviceType(int newDeviceType);
 
     QString getName();
+    void setName(const QString &newName);
 
 private:
+    void configureInverseTables();
+
     int deviceType = MODEL_TRIODE;
     int modelType = IMPROVED_KOREN_TRIODE;
 
@@ -79,10 +113,14 @@ private:
 
     QString name;
 
-    double vaMax;
-    double iaMax;
-    double vg1Max;
-    double vg2Max;
-    double ig2Max;
-    double paMax;
+    double vaMax = 400.0;
+    double iaMax = 6.0;
+    double vg1Max = 4.0;
+    double vg2Max = 400.0;
+    double ig2Max = 1.0;
+    double paMax = 1.25;
+    /**
+     * @brief inverseTables If true, the models answer anodeVoltage from AnodeVoltageTables over iaMax and vg1Max
+     */
+    bool inverseTables = true;
 };
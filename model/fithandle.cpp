@@ -0,0 +1,121 @@
+#include "fithandle.h"
+
+FitHandle::FitHandle(Model *model, const IterationHook &progressHook, qint64 timeout) :
+    model(model), progressHook(progressHook), deadline(timeout < 0 ? QDeadlineTimer(QDeadlineTimer::Forever) : QDeadlineTimer(timeout)),
+    cancelled(false), finished(false)
+{
+
+}
+
+/**
+ * @brief FitHandle::start starts fitting a model on a worker pool
+ * @param model The model to fit
+ * @param progress Called (on the worker thread) at the end of every iteration with the cost and parameters
+ * @param timeout The time in ms, from now, by which the fit must finish, or -1 for no deadline
+ * @param pool The pool to run the fit on, or nullptr to use the global pool
+ * @return The handle of the fit
+ *
+ * The deadline includes any time spent waiting for a worker. A fit that reaches it stops with the
+ * best solution found so far.
+ */
+QSharedPointer<FitHandle> FitHandle::start(Model *model, const IterationHook &progress, qint64 timeout, QThreadPool *pool)
+{
+    QSharedPointer<FitHandle> handle(new FitHandle(model, progress, timeout));
+
+    if (pool == nullptr) {
+        pool = QThreadPool::globalInstance();
+    }
+
+    pool->start([handle]() {
+        handle->run();
+    });
+
+    return handle;
+}
+
+/**
+ * @brief FitHandle::cancel asks the fit to stop at the end of its current iteration
+ *
+ * Cancellation is cooperative: the fit is abandoned (and its result is not usable) but the call
+ * returns immediately. Use wait() to know when the model is free again.
+ */
+void FitHandle::cancel()
+{
+    cancelled = true;
+}
+
+bool FitHandle::isCancelled() const
+{
+    return cancelled;
+}
+
+bool FitHandle::isFinished() const
+{
+    return finished;
+}
+
+/**
+ * @brief FitHandle::wait waits for the fit to finish
+ * @param timeout The longest time to wait in ms, or -1 to wait indefinitely
+ * @return true if the fit has finished
+ */
+bool FitHandle::wait(qint64 timeout)
+{
+    QDeadlineTimer waitDeadline(timeout < 0 ? QDeadlineTimer(QDeadlineTimer::Forever) : QDeadlineTimer(timeout));
+
+    QMutexLocker locker(&mutex);
+    while (!finished) {
+        if (!done.wait(&mutex, waitDeadline)) {
+            break;
+        }
+    }
+
+    return finished;
+}
+
+/**
+ * @brief FitHandle::result
+ * @return The result of the fit, which is only meaningful once isFinished() is true
+ */
+FitResult FitHandle::result() const
+{
+    QMutexLocker locker(&mutex);
+    return fitResult;
+}
+
+/**
+ * @brief FitHandle::progress
+ * @return The state of the fit at the end of its latest iteration
+ */
+FitIteration FitHandle::progress() const
+{
+    QMutexLocker locker(&mutex);
+    return latest;
+}
+
+void FitHandle::run()
+{
+    model->setIterationHook([this](const FitIteration &iteration) {
+        {
+            QMutexLocker locker(&mutex);
+            latest = iteration;
+        }
+
+        if (progressHook) {
+            progressHook(iteration);
+        }
+    });
+    model->setCancelFlag(&cancelled);
+    model->setDeadline(deadline);
+
+    FitResult fit = model->solve();
+
+    model->setIterationHook(IterationHook());
+    model->setCancelFlag(nullptr);
+    model->setDeadline(QDeadlineTimer(QDeadlineTimer::Forever));
+
+    QMutexLocker locker(&mutex);
+    fitResult = fit;
+    finished = true;
+    done.wakeAll();
+}
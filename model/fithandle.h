@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QDeadlineTimer>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <atomic>
+
+#include "model.h"
+#include "fitresult.h"
+
+/**
+ * @brief The FitHandle class
+ *
+ * A handle to a fit running on a worker pool, returned by FitHandle::start (or Device::solveAsync).
+ * The caller can watch the progress of the fit, cancel it or wait for its result without blocking
+ * while it runs. The model must not be used by anything else until the fit has finished.
+ */
+class FitHandle
+{
+public:
+    static QSharedPointer<FitHandle> start(Model *model, const IterationHook &progress = IterationHook(),
+                                           qint64 timeout = -1, QThreadPool *pool = nullptr);
+
+    void cancel();
+    bool isCancelled() const;
+    bool isFinished() const;
+
+    bool wait(qint64 timeout = -1);
+    FitResult result() const;
+    FitIteration progress() const;
+
+private:
+    FitHandle(Model *model, const IterationHook &progressHook, qint64 timeout);
+
+    void run();
+
+    Model *model;
+    IterationHook progressHook;
+    QDeadlineTimer deadline;
+
+    std::atomic<bool> cancelled;
+    std::atomic<bool> finished;
+
+    mutable QMutex mutex;
+    QWaitCondition done;
+    FitResult fitResult;
+    FitIteration latest;
+};
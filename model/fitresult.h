@@ -0,0 +1,160 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief The FitResult struct
+ *
+ * Summarises the outcome of fitting a model so that fits of different models to the same data can be
+ * compared and ranked.
+ */
+struct FitResult {
+    /**
+     * @brief modelName The name of the model that was fitted
+     */
+    QString modelName;
+    /**
+     * @brief modelType The eModelType of the model that was fitted
+     */
+    int modelType = -1;
+    /**
+     * @brief initialCost The Ceres cost at the starting parameters
+     */
+    double initialCost = 0.0;
+    /**
+     * @brief cost The final Ceres cost, i.e. half the sum of the squared residuals
+     */
+    double cost = 0.0;
+    /**
+     * @brief rms The root mean square anode current error in mA, over all of the samples
+     */
+    double rms = 0.0;
+    /**
+     * @brief screenRms For pentodes, the root mean square screen current error in mA over the samples
+     * whose screen current was measured (0 if there were none)
+     */
+    double screenRms = 0.0;
+    /**
+     * @brief iterations The number of solver iterations taken
+     */
+    int iterations = 0;
+    /**
+     * @brief residualEvaluations The number of per sample residuals evaluated (with or without Jacobians)
+     */
+    qint64 residualEvaluations = 0;
+    /**
+     * @brief wallTime The elapsed time for the fit in ms
+     */
+    double wallTime = 0.0;
+    /**
+     * @brief residualTime The time in ms spent evaluating residuals alone
+     */
+    double residualTime = 0.0;
+    /**
+     * @brief jacobianTime The time in ms spent evaluating residuals and Jacobians
+     */
+    double jacobianTime = 0.0;
+    /**
+     * @brief linearSolverTime The time in ms spent in the linear solver
+     */
+    double linearSolverTime = 0.0;
+    /**
+     * @brief solver The linear solver and trust region strategy used
+     */
+    QString solver;
+    /**
+     * @brief termination Why the solver stopped (CONVERGENCE, NO_CONVERGENCE, FAILURE, USER_SUCCESS or USER_FAILURE)
+     */
+    QString termination;
+    /**
+     * @brief message The solver's description of why it stopped
+     */
+    QString message;
+    /**
+     * @brief usable True if the solver produced a usable solution
+     */
+    bool usable = false;
+};
+
+/**
+ * @brief The FitIteration struct
+ *
+ * The state of a fit at the end of one solver iteration, as passed to a Model's iteration hook.
+ */
+struct FitIteration {
+    QString modelName;
+    int iteration = 0;
+    double cost = 0.0;
+    double costChange = 0.0;
+    double gradientNorm = 0.0;
+    double stepNorm = 0.0;
+    double trustRegionRadius = 0.0;
+    /**
+     * @brief successful True if the step was accepted
+     */
+    bool successful = false;
+    /**
+     * @brief elapsed The time in ms since the solver started
+     */
+    double elapsed = 0.0;
+    /**
+     * @brief parameters The parameter values at the end of the iteration (all MODEL_PARAMETERS slots)
+     */
+    QVector<double> parameters;
+};
+
+/**
+ * @brief The CascadeResult struct
+ *
+ * Records a cascaded fit in which each model is warm started from the converged parameters of the
+ * simpler models before it. When the cascade is compared against cold starts, coldStart holds the fit
+ * of each model from its default parameters, in the same order as cascade.
+ */
+struct CascadeResult {
+    /**
+     * @brief cascade The warm started fit of each model, simplest first
+     */
+    QVector<FitResult> cascade;
+    /**
+     * @brief coldStart The cold started fit of each model (empty if no comparison was made)
+     */
+    QVector<FitResult> coldStart;
+    /**
+     * @brief iterationsSaved Iterations of a cold fit of the final model less those of the whole cascade
+     */
+    int iterationsSaved = 0;
+    /**
+     * @brief timeSaved Time in ms of a cold fit of the final model less that of the whole cascade
+     */
+    double timeSaved = 0.0;
+};
+
+/**
+ * @brief The MultiStartResult struct
+ *
+ * Records a multi-start fit. The starts are in the order they were seeded, with the model's own
+ * parameter values as the first start.
+ */
+struct MultiStartResult {
+    /**
+     * @brief best The fit of the winning start
+     */
+    FitResult best;
+    /**
+     * @brief bestStart The index of the winning start in starts, or -1 if no start was usable
+     */
+    int bestStart = -1;
+    /**
+     * @brief starts The fit of each start
+     */
+    QVector<FitResult> starts;
+    /**
+     * @brief abandoned The number of starts cut short because they could no longer win
+     */
+    int abandoned = 0;
+    /**
+     * @brief wallTime The elapsed time for the whole multi-start fit in ms
+     */
+    double wallTime = 0.0;
+};
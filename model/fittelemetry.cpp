@@ -0,0 +1,78 @@
+#include "fittelemetry.h"
+
+#include <QJsonDocument>
+
+QMutex FitTelemetry::mutex;
+QFile *FitTelemetry::logFile = nullptr;
+
+/**
+ * @brief FitTelemetry::setLogFile starts (or stops) recording fits
+ * @param fileName The Json lines file to append to, or an empty string to stop recording
+ * @return true if the file was opened (or recording was stopped)
+ */
+bool FitTelemetry::setLogFile(const QString &fileName)
+{
+    QMutexLocker locker(&mutex);
+
+    delete logFile;
+    logFile = nullptr;
+
+    if (fileName.isEmpty()) {
+        return true;
+    }
+
+    logFile = new QFile(fileName);
+    if (!logFile->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qWarning("Unable to write %s", fileName.toLocal8Bit().constData());
+        delete logFile;
+        logFile = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief FitTelemetry::record appends a fit to the log file, if one is set
+ * @param result The fit to record
+ */
+void FitTelemetry::record(const FitResult &result)
+{
+    QMutexLocker locker(&mutex);
+
+    if (logFile == nullptr) {
+        return;
+    }
+
+    logFile->write(QJsonDocument(toJson(result)).toJson(QJsonDocument::Compact));
+    logFile->write("\n", 1);
+    logFile->flush();
+}
+
+/**
+ * @brief FitTelemetry::toJson
+ * @param result A fit
+ * @return The fit as a Json object (times are in ms)
+ */
+QJsonObject FitTelemetry::toJson(const FitResult &result)
+{
+    QJsonObject object;
+    object["model"] = result.modelName;
+    object["modelType"] = result.modelType;
+    object["initialCost"] = result.initialCost;
+    object["cost"] = result.cost;
+    object["rms"] = result.rms;
+    object["screenRms"] = result.screenRms;
+    object["iterations"] = result.iterations;
+    object["residualEvaluations"] = (double) result.residualEvaluations;
+    object["wallTime"] = result.wallTime;
+    object["residualTime"] = result.residualTime;
+    object["jacobianTime"] = result.jacobianTime;
+    object["linearSolverTime"] = result.linearSolverTime;
+    object["solver"] = result.solver;
+    object["termination"] = result.termination;
+    object["message"] = result.message;
+    object["usable"] = result.usable;
+
+    return object;
+}
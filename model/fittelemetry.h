@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QFile>
+#include <QJsonObject>
+#include <QMutex>
+#include <QString>
+
+#include "fitresult.h"
+
+/**
+ * @brief The FitTelemetry class
+ *
+ * Optionally records every fit made by any Model as one line of Json in a log file (Json lines), so
+ * that the fits of a whole batch job can be profiled. Recording is off until a log file is set and
+ * is safe to use from concurrent fits.
+ */
+class FitTelemetry
+{
+public:
+    static bool setLogFile(const QString &fileName);
+    static void record(const FitResult &result);
+    static QJsonObject toJson(const FitResult &result);
+
+private:
+    static QMutex mutex;
+    static QFile *logFile;
+};
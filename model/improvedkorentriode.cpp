@@ -5,8 +5,8 @@ struct ImprovedKorenTriodeResidual {
 
     template <typename T>
     bool operator()(const T* const kg, const T* const kp, const T* const kvb, const T* const kvb2, const T* const vct, const T* const a, const T* const mu, T* residual) const {
-        T e2t = log(1.0 + exp(kp[0] * (1.0 / mu[0] + (vg_ + vct[0]) / sqrt(kvb[0] + va_ * va_ + kvb2[0] * va_))));
-        T ia = pow((va_ / kp[0]) * e2t, a[0]) / kg[0];
+        ImprovedKorenTriodeParameters<T> p = { kg[0], kp[0], kvb[0], kvb2[0], vct[0], a[0], mu[0] };
+        T ia = improvedKorenTriodeCurrent(p, T(va_), T(vg_));
         residual[0] = ia_ - ia;
         return !(isnan(ia) || isinf(ia));
     }
@@ -17,35 +17,126 @@ private:
     const double ia_;
 };
 
+/**
+ * @brief The ImprovedKorenTriodeAnalyticResidual struct
+ *
+ * Analytic equivalent of ImprovedKorenTriodeResidual, shared by the single sample and batched cost
+ * functions. The parameters are, in order, Kg, Kp, Kvb, Kvb2, Vct, alpha and mu. As for the Koren
+ * model, x1, x2, the softplus term and et are computed once and shared by the residual and the
+ * partial derivatives.
+ */
+struct ImprovedKorenTriodeAnalyticResidual {
+    static const int parameterCount = 7;
+
+    static inline bool evaluate(const double *parameters, double va, double vg1, double vg2, double ia, double *residual, double *gradient)
+    {
+        const ImprovedKorenTriodeParameters<double> p = { parameters[0], parameters[1], parameters[2], parameters[3], parameters[4], parameters[5], parameters[6] };
+        const double kg = p.kg;
+        const double kp = p.kp;
+        const double vct = p.vct;
+        const double a = p.alpha;
+        const double mu = p.mu;
+
+        KorenTriodeTerms<double> terms;
+        double iaModel = improvedKorenTriodeCurrent(p, va, vg1, &terms);
+        const double x1 = terms.x1;
+        const double x2 = terms.x2;
+        const double et = terms.et;
+        residual[0] = ia - iaModel;
+
+        if (std::isnan(iaModel) || std::isinf(iaModel)) {
+            return false;
+        }
+
+        if (gradient != NULL) {
+            double dIaDEt = 0.0;
+            double logEt = 0.0;
+            if (et > 0.0) {
+                dIaDEt = a * iaModel / et;
+                logEt = std::log(et);
+            }
+            double dIaDX2 = dIaDEt * va * sigmoid(x2) / kp;
+            double dX2DX1Sq = -kp * (vg1 + vct) / (2.0 * x1 * x1 * x1); // Derivative w.r.t. x1^2
+
+            gradient[0] = iaModel / kg;
+            gradient[1] = -(dIaDX2 * x2 - dIaDEt * et) / kp; // dx2/dkp = x2 / kp
+            gradient[2] = -dIaDX2 * dX2DX1Sq;
+            gradient[3] = -dIaDX2 * dX2DX1Sq * va;
+            gradient[4] = -dIaDX2 * kp / x1;
+            gradient[5] = -iaModel * logEt;
+            gradient[6] = dIaDX2 * kp / (mu * mu);
+        }
+
+        return true;
+    }
+};
+
+typedef AnalyticCostFunction<ImprovedKorenTriodeAnalyticResidual, 1, 1, 1, 1, 1, 1, 1> ImprovedKorenTriodeCostFunction;
+
 ImprovedKorenTriode::ImprovedKorenTriode()
 {
     parameter[TRI_KVB2] = new Parameter("Kvb2:", 30.0);
 }
 
-void ImprovedKorenTriode::addSample(double va, double ia, double vg1, double vg2)
+CostFunction *ImprovedKorenTriode::createCostFunction(double va, double ia, double vg1, double vg2, double ig2)
+{
+    if (jacobianType == JACOBIAN_AUTODIFF) {
+        return new AutoDiffCostFunction<ImprovedKorenTriodeResidual, 1, 1, 1, 1, 1, 1, 1, 1>(
+            new ImprovedKorenTriodeResidual(va, vg1, ia));
+    }
+
+    return new ImprovedKorenTriodeCostFunction(va, ia, vg1, vg2);
+}
+
+CostFunction *ImprovedKorenTriode::createBatchCostFunction(qint64 begin, int count)
+{
+    return new BatchCostFunction<ImprovedKorenTriodeAnalyticResidual>(&samples, begin, count);
+}
+
+std::vector<double *> ImprovedKorenTriode::parameterBlocks()
 {
-    problem.AddResidualBlock(
-        new AutoDiffCostFunction<ImprovedKorenTriodeResidual, 1, 1, 1, 1, 1, 1, 1, 1>(
-            new ImprovedKorenTriodeResidual(va, vg1, ia)),
-        NULL,
+    return {
         parameter[TRI_KG]->getPointer(),
         parameter[TRI_KP]->getPointer(),
         parameter[TRI_KVB]->getPointer(),
         parameter[TRI_KVB2]->getPointer(),
         parameter[TRI_VCT]->getPointer(),
         parameter[TRI_ALPHA]->getPointer(),
-        parameter[TRI_MU]->getPointer());
+        parameter[TRI_MU]->getPointer()
+    };
 }
 
 double ImprovedKorenTriode::anodeCurrent(double va, double vg1, double vg2)
 {
-    return improvedKorenCurrent(va, vg1,
-        parameter[TRI_KP]->getValue(),
-        parameter[TRI_KVB]->getValue(),
-        parameter[TRI_KVB2]->getValue(),
-        parameter[TRI_VCT]->getValue(),
-        parameter[TRI_ALPHA]->getValue(),
-        parameter[TRI_MU]->getValue()) / parameter[TRI_KG]->getValue();
+    return improvedKorenTriodeCurrent(improvedKorenTriodeParameters(), va, vg1);
+}
+
+void ImprovedKorenTriode::anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count)
+{
+    AnodeKernel::improvedKoren(improvedKorenTriodeParameters(), va, vg1, ia, count);
+}
+
+double ImprovedKorenTriode::anodeCurrentGradient(double va, double vg1, double vg2, double *dIaDva, double *dIaDvg1)
+{
+    return improvedKorenTriodeGradient(improvedKorenTriodeParameters(), va, vg1, dIaDva, dIaDvg1);
+}
+
+/**
+ * @brief ImprovedKorenTriode::improvedKorenTriodeParameters
+ * @return A snapshot of the parameters for use with improvedKorenTriodeCurrent
+ */
+ImprovedKorenTriodeParameters<double> ImprovedKorenTriode::improvedKorenTriodeParameters() const
+{
+    ImprovedKorenTriodeParameters<double> p;
+    p.kg = parameter[TRI_KG]->getValue();
+    p.kp = parameter[TRI_KP]->getValue();
+    p.kvb = parameter[TRI_KVB]->getValue();
+    p.kvb2 = parameter[TRI_KVB2]->getValue();
+    p.vct = parameter[TRI_VCT]->getValue();
+    p.alpha = parameter[TRI_ALPHA]->getValue();
+    p.mu = parameter[TRI_MU]->getValue();
+
+    return p;
 }
 
 void ImprovedKorenTriode::fromJson(QJsonObject source)
@@ -93,6 +184,11 @@ QString ImprovedKorenTriode::getName()
     return QString("Improved Koren");
 }
 
+int ImprovedKorenTriode::getType()
+{
+    return IMPROVED_KOREN_TRIODE;
+}
+
 void ImprovedKorenTriode::setOptions()
 {
     KorenTriode::setOptions();
@@ -7,13 +7,20 @@ class ImprovedKorenTriode : public KorenTriode
 public:
     ImprovedKorenTriode();
 
-	virtual void addSample(double va, double ia, double vg1, double vg2 = 0.0);
 	virtual double anodeCurrent(double va, double vg1, double vg2 = 0.0);
+    virtual void anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count);
+    virtual double anodeCurrentGradient(double va, double vg1, double vg2, double *dIaDva, double *dIaDvg1);
     virtual void fromJson(QJsonObject source);
     virtual void toJson(QJsonObject &destination, double vg1Max, double vg2Max = 0);
     virtual void updateUI(QLabel *labels[], QLineEdit *values[]);
     virtual QString getName();
+    virtual int getType();
+
+    ImprovedKorenTriodeParameters<double> improvedKorenTriodeParameters() const;
 
 protected:
 	void setOptions();
+    virtual CostFunction *createCostFunction(double va, double ia, double vg1, double vg2, double ig2);
+    virtual CostFunction *createBatchCostFunction(qint64 begin, int count);
+    virtual std::vector<double *> parameterBlocks();
 };
@@ -0,0 +1,195 @@
+#include "korenpentode.h"
+
+/**
+ * @brief The KorenPentodeEvaluator struct
+ *
+ * The Koren pentode for PentodeBatchCostFunction and PentodeCostFunction. The parameters are, in
+ * order, Kg1, Kp, Kvb, alpha, mu and Kg2.
+ */
+struct KorenPentodeEvaluator {
+    static const int parameterCount = 6;
+
+    template <typename T>
+    static inline T currents(const T *parameters, const T &va, const T &vg1, const T &vg2, T *ig2)
+    {
+        const KorenPentodeParameters<T> p = { parameters[0], parameters[1], parameters[2], parameters[3], parameters[4], parameters[5] };
+
+        return korenPentodeCurrent(p, va, vg1, vg2, ig2);
+    }
+};
+
+typedef PentodeCostFunction<KorenPentodeEvaluator, 1, 1, 1, 1, 1, 1> KorenPentodeCostFunction;
+
+KorenPentode::KorenPentode()
+{
+    parameter[PENT_KG1] = new Parameter("Kg1:", 0.65);
+    parameter[PENT_KP] = new Parameter("Kp:", 60.0);
+    parameter[PENT_KVB] = new Parameter("Kvb:", 24.0);
+    parameter[PENT_ALPHA] = new Parameter("Alpha:", 1.35);
+    parameter[PENT_MU] = new Parameter("Mu:", 11.0);
+    parameter[PENT_KG2] = new Parameter("Kg2:", 4.2);
+}
+
+/**
+ * @brief KorenPentode::createCostFunction
+ *
+ * The pentode cost functions already differentiate the model automatically (see PentodeResiduals),
+ * so the automatic differentiation reference mode uses the same cost function.
+ */
+CostFunction *KorenPentode::createCostFunction(double va, double ia, double vg1, double vg2, double ig2)
+{
+    return new KorenPentodeCostFunction(va, ia, vg1, vg2, ig2);
+}
+
+CostFunction *KorenPentode::createBatchCostFunction(qint64 begin, int count)
+{
+    return new PentodeBatchCostFunction<KorenPentodeEvaluator>(&samples, begin, count);
+}
+
+std::vector<double *> KorenPentode::parameterBlocks()
+{
+    return {
+        parameter[PENT_KG1]->getPointer(),
+        parameter[PENT_KP]->getPointer(),
+        parameter[PENT_KVB]->getPointer(),
+        parameter[PENT_ALPHA]->getPointer(),
+        parameter[PENT_MU]->getPointer(),
+        parameter[PENT_KG2]->getPointer()
+    };
+}
+
+double KorenPentode::anodeCurrent(double va, double vg1, double vg2)
+{
+    return korenPentodeCurrent(korenPentodeParameters(), va, vg1, vg2);
+}
+
+/**
+ * @brief KorenPentode::anodeCurrents calculates the modelled anode current for arrays of samples
+ *
+ * The parameters are read once for the whole array. Without screen voltages the current is zero.
+ */
+void KorenPentode::anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count)
+{
+    const KorenPentodeParameters<double> p = korenPentodeParameters();
+
+    for (int i = 0; i < count; i++) {
+        ia[i] = vg2 != nullptr ? korenPentodeCurrent(p, va[i], vg1[i], vg2[i]) : 0.0;
+    }
+}
+
+double KorenPentode::screenCurrent(double va, double vg1, double vg2)
+{
+    double ig2;
+    korenPentodeCurrent(korenPentodeParameters(), va, vg1, vg2, &ig2);
+
+    return ig2;
+}
+
+void KorenPentode::screenCurrents(const double *va, const double *vg1, const double *vg2, double *ig2, int count)
+{
+    const KorenPentodeParameters<double> p = korenPentodeParameters();
+
+    for (int i = 0; i < count; i++) {
+        korenPentodeCurrent(p, va[i], vg1[i], vg2 != nullptr ? vg2[i] : 0.0, ig2 + i);
+    }
+}
+
+/**
+ * @brief KorenPentode::korenPentodeParameters
+ * @return A snapshot of the parameters for use with korenPentodeCurrent
+ */
+KorenPentodeParameters<double> KorenPentode::korenPentodeParameters() const
+{
+    KorenPentodeParameters<double> p;
+    p.kg1 = parameter[PENT_KG1]->getValue();
+    p.kp = parameter[PENT_KP]->getValue();
+    p.kvb = parameter[PENT_KVB]->getValue();
+    p.alpha = parameter[PENT_ALPHA]->getValue();
+    p.mu = parameter[PENT_MU]->getValue();
+    p.kg2 = parameter[PENT_KG2]->getValue();
+
+    return p;
+}
+
+void KorenPentode::fromJson(QJsonObject source)
+{
+    if (source.contains("kg1") && source["kg1"].isDouble()) {
+        parameter[PENT_KG1]->setValue(source["kg1"].toDouble());
+    }
+
+    if (source.contains("kp") && source["kp"].isDouble()) {
+        parameter[PENT_KP]->setValue(source["kp"].toDouble());
+    }
+
+    if (source.contains("kvb") && source["kvb"].isDouble()) {
+        parameter[PENT_KVB]->setValue(source["kvb"].toDouble());
+    }
+
+    if (source.contains("alpha") && source["alpha"].isDouble()) {
+        parameter[PENT_ALPHA]->setValue(source["alpha"].toDouble());
+    }
+
+    if (source.contains("mu") && source["mu"].isDouble()) {
+        parameter[PENT_MU]->setValue(source["mu"].toDouble());
+    }
+
+    if (source.contains("kg2") && source["kg2"].isDouble()) {
+        parameter[PENT_KG2]->setValue(source["kg2"].toDouble());
+    }
+
+    scheduleInverseTable();
+}
+
+void KorenPentode::toJson(QJsonObject &destination, double vg1Max, double vg2Max)
+{
+    QJsonObject model;
+    model["kg1"] = parameter[PENT_KG1]->getValue();
+    model["kp"] = parameter[PENT_KP]->getValue();
+    model["kvb"] = parameter[PENT_KVB]->getValue();
+    model["alpha"] = parameter[PENT_ALPHA]->getValue();
+    model["mu"] = parameter[PENT_MU]->getValue();
+    model["kg2"] = parameter[PENT_KG2]->getValue();
+
+    QJsonObject pentode;
+    pentode["vg1Max"] = vg1Max;
+    pentode["vg2Max"] = vg2Max;
+    pentode["koren"] = model;
+
+    destination["pentode"] = pentode;
+}
+
+void KorenPentode::updateUI(QLabel *labels[], QLineEdit *values[])
+{
+    int i = 0;
+
+    updateParameter(labels[i], values[i], parameter[PENT_MU]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_KG1]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_KG2]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_ALPHA]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_KP]); i++;
+    updateParameter(labels[i], values[i], parameter[PENT_KVB]); i++;
+}
+
+QString KorenPentode::getName()
+{
+    return QString("Koren Pentode");
+}
+
+int KorenPentode::getType()
+{
+    return KOREN_PENTODE;
+}
+
+void KorenPentode::setOptions()
+{
+    options.max_num_iterations = 100;
+
+    setLowerBound(parameter[PENT_KG1], 0.0000001); // Kg1 > 0
+    setLowerBound(parameter[PENT_KG2], 0.0000001); // Kg2 > 0
+    setLimits(parameter[PENT_KP], 1.0, 1000.0); // 1.0 <= Kp <= 1000.0
+    setLimits(parameter[PENT_KVB], 1.0, 10000.0); // 1.0 <= Kvb <= 10000.0
+    setLimits(parameter[PENT_ALPHA], 1.0, 2.0); // 1.0 <= alpha <= 2.0
+    setLimits(parameter[PENT_MU], 1.0, 1000.0); // 1.0 <= mu <= 1000.0
+    options.linear_solver_type = ceres::CGNR;
+    options.preconditioner_type = ceres::JACOBI;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "model.h"
+
+class KorenPentode : public Model
+{
+public:
+    KorenPentode();
+
+    virtual double anodeCurrent(double va, double vg1, double vg2 = 0.0);
+    virtual void anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count);
+    virtual double screenCurrent(double va, double vg1, double vg2);
+    virtual void screenCurrents(const double *va, const double *vg1, const double *vg2, double *ig2, int count);
+    virtual void fromJson(QJsonObject source);
+    virtual void toJson(QJsonObject &destination, double vg1Max, double vg2Max = 0);
+    virtual void updateUI(QLabel *labels[], QLineEdit *values[]);
+    virtual QString getName();
+    virtual int getType();
+
+    KorenPentodeParameters<double> korenPentodeParameters() const;
+
+protected:
+    void setOptions();
+    virtual CostFunction *createCostFunction(double va, double ia, double vg1, double vg2, double ig2);
+    virtual CostFunction *createBatchCostFunction(qint64 begin, int count);
+    virtual std::vector<double *> parameterBlocks();
+};
@@ -5,8 +5,8 @@ struct KorenTriodeResidual {
 
     template <typename T>
     bool operator()(const T* const kg, const T* const kp, const T* const kvb, const T* const a, const T* const mu, T* residual) const {
-        T e1t = log(1.0 + exp(kp[0] * (1.0 / mu[0] + vg_ / sqrt(kvb[0] + va_ * va_))));
-        T ia = pow((va_ / kp[0]) * e1t, a[0]) / kg[0];
+        KorenTriodeParameters<T> p = { kg[0], kp[0], kvb[0], a[0], mu[0] };
+        T ia = korenTriodeCurrent(p, T(va_), T(vg_));
         residual[0] = ia_ - ia;
         return !(isnan(ia) || isinf(ia));
     }
@@ -17,33 +17,121 @@ private:
     const double ia_;
 };
 
+/**
+ * @brief The KorenTriodeAnalyticResidual struct
+ *
+ * Analytic equivalent of KorenTriodeResidual, shared by the single sample and batched cost functions.
+ * The parameters are, in order, Kg, Kp, Kvb, alpha and mu. The softplus term x3 and its derivative
+ * (the logistic sigmoid of x2) are shared by the residual and all of the partial derivatives.
+ */
+struct KorenTriodeAnalyticResidual {
+    static const int parameterCount = 5;
+
+    static inline bool evaluate(const double *parameters, double va, double vg1, double vg2, double ia, double *residual, double *gradient)
+    {
+        const KorenTriodeParameters<double> p = { parameters[0], parameters[1], parameters[2], parameters[3], parameters[4] };
+        const double kg = p.kg;
+        const double kp = p.kp;
+        const double a = p.alpha;
+        const double mu = p.mu;
+
+        KorenTriodeTerms<double> terms;
+        double iaModel = korenTriodeCurrent(p, va, vg1, &terms);
+        const double x1 = terms.x1;
+        const double x2 = terms.x2;
+        const double et = terms.et;
+        residual[0] = ia - iaModel;
+
+        if (std::isnan(iaModel) || std::isinf(iaModel)) {
+            return false;
+        }
+
+        if (gradient != NULL) {
+            double dIaDEt = 0.0;
+            double logEt = 0.0;
+            if (et > 0.0) {
+                dIaDEt = a * iaModel / et;
+                logEt = std::log(et);
+            }
+            double dEtDX2 = va * sigmoid(x2) / kp; // d(softplus)/dx = sigmoid
+
+            gradient[0] = iaModel / kg;
+            gradient[1] = -dIaDEt * (dEtDX2 * x2 - et) / kp; // dx2/dkp = x2 / kp
+            gradient[2] = dIaDEt * dEtDX2 * kp * vg1 / (2.0 * x1 * x1 * x1); // dx2/dkvb = -kp * vg / (2 * x1^3)
+            gradient[3] = -iaModel * logEt;
+            gradient[4] = dIaDEt * dEtDX2 * kp / (mu * mu); // dx2/dmu = -kp / mu^2
+        }
+
+        return true;
+    }
+};
+
+typedef AnalyticCostFunction<KorenTriodeAnalyticResidual, 1, 1, 1, 1, 1> KorenTriodeCostFunction;
+
 KorenTriode::KorenTriode()
 {
     parameter[TRI_KP] = new Parameter("Kp:", 500.0);
     parameter[TRI_KVB] = new Parameter("Kvb:", 300.0);
 }
 
-void KorenTriode::addSample(double va, double ia, double vg1, double vg2)
+CostFunction *KorenTriode::createCostFunction(double va, double ia, double vg1, double vg2, double ig2)
+{
+    if (jacobianType == JACOBIAN_AUTODIFF) {
+        return new AutoDiffCostFunction<KorenTriodeResidual, 1, 1, 1, 1, 1, 1>(
+            new KorenTriodeResidual(va, vg1, ia));
+    }
+
+    return new KorenTriodeCostFunction(va, ia, vg1, vg2);
+}
+
+CostFunction *KorenTriode::createBatchCostFunction(qint64 begin, int count)
+{
+    return new BatchCostFunction<KorenTriodeAnalyticResidual>(&samples, begin, count);
+}
+
+std::vector<double *> KorenTriode::parameterBlocks()
 {
-    problem.AddResidualBlock(
-        new AutoDiffCostFunction<KorenTriodeResidual, 1, 1, 1, 1, 1, 1>(
-            new KorenTriodeResidual(va, vg1, ia)),
-        NULL,
+    return {
         parameter[TRI_KG]->getPointer(),
         parameter[TRI_KP]->getPointer(),
         parameter[TRI_KVB]->getPointer(),
         parameter[TRI_ALPHA]->getPointer(),
-        parameter[TRI_MU]->getPointer());
+        parameter[TRI_MU]->getPointer()
+    };
 }
 
 double KorenTriode::anodeCurrent(double va, double vg1, double vg2)
 {
-    return korenCurrent(va, vg1,
-        parameter[TRI_KP]->getValue(),
-        parameter[TRI_KVB]->getValue(),
-        parameter[TRI_ALPHA]->getValue(),
-        parameter[TRI_MU]->getValue()) / parameter[TRI_KG]->getValue();
+    return korenTriodeCurrent(korenTriodeParameters(), va, vg1);
+}
+
+void KorenTriode::anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count)
+{
+    const KorenTriodeParameters<double> p = korenTriodeParameters();
+    const ImprovedKorenTriodeParameters<double> improved = { p.kg, p.kp, p.kvb, 0.0, 0.0, p.alpha, p.mu };
+
+    AnodeKernel::improvedKoren(improved, va, vg1, ia, count);
+}
+
+double KorenTriode::anodeCurrentGradient(double va, double vg1, double vg2, double *dIaDva, double *dIaDvg1)
+{
+    return korenTriodeGradient(korenTriodeParameters(), va, vg1, dIaDva, dIaDvg1);
+}
 
+/**
+ * @brief KorenTriode::korenTriodeParameters
+ * @return A snapshot of the parameters for use with korenTriodeCurrent
+ */
+KorenTriodeParameters<double> KorenTriode::korenTriodeParameters() const
+{
+    KorenTriodeParameters<double> p;
+    p.kg = parameter[TRI_KG]->getValue();
+    p.kp = parameter[TRI_KP]->getValue();
+    p.kvb = parameter[TRI_KVB]->getValue();
+    p.alpha = parameter[TRI_ALPHA]->getValue();
+    p.mu = parameter[TRI_MU]->getValue();
+
+    return p;
 }
 
 void KorenTriode::fromJson(QJsonObject source)
@@ -92,6 +180,11 @@ QString KorenTriode::getName()
     return QString("Koren");
 }
 
+int KorenTriode::getType()
+{
+    return KOREN_TRIODE;
+}
+
 void KorenTriode::setOptions()
 {
     SimpleTriode::setOptions();
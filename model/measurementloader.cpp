@@ -0,0 +1,332 @@
+#include "measurementloader.h"
+
+#include <QFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+#include <cctype>
+#include <charconv>
+#include <cstring>
+
+/**
+ * @brief MINIMUM_CHUNK The smallest amount of data (in bytes) worth parsing on a separate thread
+ */
+#define MINIMUM_CHUNK 262144
+
+#define MAXIMUM_FIELDS 32
+
+static inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool isDelimiter(char c)
+{
+    return c == ',' || c == ';' || isSpace(c);
+}
+
+/**
+ * @brief splitFields finds the fields of a line
+ * @return The number of fields found (at most MAXIMUM_FIELDS)
+ *
+ * Whitespace around fields is ignored and a comma or semicolon ends a field, so both CSV (including
+ * empty fields) and whitespace separated logs are handled.
+ */
+static int splitFields(const char *begin, const char *end, const char *fieldBegin[], const char *fieldEnd[])
+{
+    int count = 0;
+    const char *p = begin;
+
+    while (p < end && count < MAXIMUM_FIELDS) {
+        while (p < end && isSpace(*p)) {
+            p++;
+        }
+
+        fieldBegin[count] = p;
+        while (p < end && !isDelimiter(*p)) {
+            p++;
+        }
+        fieldEnd[count] = p;
+        count++;
+
+        while (p < end && isSpace(*p)) {
+            p++;
+        }
+        if (p < end && (*p == ',' || *p == ';')) {
+            p++;
+        }
+    }
+
+    return count;
+}
+
+static inline bool parseNumber(const char *begin, const char *end, double *value)
+{
+    if (begin < end && *begin == '+') {
+        begin++;
+    }
+
+    if (begin == end) {
+        return false;
+    }
+
+    std::from_chars_result result = std::from_chars(begin, end, *value);
+
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+/**
+ * @brief MeasurementLoader::load loads a measurement file
+ * @param fileName The file to load
+ * @param store The store to append the samples to
+ * @param error Receives a description of any failure
+ * @param threads The number of threads to parse with, or 0 to use every core
+ * @return true if at least one sample was loaded
+ */
+bool MeasurementLoader::load(const QString &fileName, SampleStore *store, QString *error, int threads)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error != nullptr) {
+            *error = file.errorString();
+        }
+        return false;
+    }
+
+    qint64 length = file.size();
+    if (length == 0) {
+        if (error != nullptr) {
+            *error = "Empty file";
+        }
+        return false;
+    }
+
+    uchar *mapped = file.map(0, length);
+    if (mapped != nullptr) {
+        bool result = parse((const char *) mapped, length, store, error, threads);
+        file.unmap(mapped);
+        return result;
+    }
+
+    QByteArray contents = file.readAll(); // Mapping is not available, e.g. for some special files
+
+    return parse(contents.constData(), contents.size(), store, error, threads);
+}
+
+/**
+ * @brief MeasurementLoader::parse parses measurement data held in memory
+ * @param data The measurement data (which need not be null terminated)
+ * @param length The length of the data in bytes
+ * @param store The store to append the samples to
+ * @param error Receives a description of any failure
+ * @param threads The number of threads to parse with, or 0 to use every core
+ * @return true if at least one sample was parsed
+ */
+bool MeasurementLoader::parse(const char *data, qint64 length, SampleStore *store, QString *error, int threads)
+{
+    const char *end = data + length;
+    const char *p = data;
+    Columns columns;
+
+    // Look for a header ahead of the data
+    while (p < end) {
+        const char *lineEnd = (const char *) memchr(p, '\n', end - p);
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+
+        const char *q = p;
+        while (q < lineEnd && isSpace(*q)) {
+            q++;
+        }
+
+        if (q == lineEnd || *q == '#') {
+            p = lineEnd < end ? lineEnd + 1 : end;
+            continue;
+        }
+
+        if (isHeader(q, lineEnd)) {
+            columns = parseHeader(q, lineEnd);
+            if (columns.va < 0 || columns.ia < 0 || columns.vg1 < 0) {
+                if (error != nullptr) {
+                    *error = "Header does not identify the va, ia and vg columns";
+                }
+                return false;
+            }
+            p = lineEnd < end ? lineEnd + 1 : end;
+        }
+
+        break;
+    }
+
+    // Split the data into chunks at line boundaries
+    if (threads <= 0) {
+        threads = qMax(1, QThread::idealThreadCount());
+    }
+    qint64 remaining = end - p;
+    int chunks = (int) qBound((qint64) 1, remaining / MINIMUM_CHUNK, (qint64) threads);
+
+    QVector<const char *> boundaries;
+    boundaries.append(p);
+    for (int i = 1; i < chunks; i++) {
+        const char *boundary = p + (remaining * i) / chunks;
+        if (boundary < boundaries.last()) {
+            boundary = boundaries.last();
+        }
+        const char *newline = (const char *) memchr(boundary, '\n', end - boundary);
+        boundaries.append(newline == nullptr ? end : newline + 1);
+    }
+    boundaries.append(end);
+
+    QVector<SampleStore> parts(chunks);
+
+    if (chunks == 1) {
+        parseChunk(boundaries.at(0), boundaries.at(1), columns, &parts[0]);
+    } else {
+        QThreadPool pool;
+        pool.setMaxThreadCount(chunks);
+
+        for (int i = 0; i < chunks; i++) {
+            const char *chunkBegin = boundaries.at(i);
+            const char *chunkEnd = boundaries.at(i + 1);
+            SampleStore *part = &parts[i];
+            pool.start([chunkBegin, chunkEnd, columns, part]() {
+                parseChunk(chunkBegin, chunkEnd, columns, part);
+            });
+        }
+
+        pool.waitForDone();
+    }
+
+    qint64 total = 0;
+    for (int i = 0; i < chunks; i++) {
+        total += parts.at(i).size();
+    }
+
+    if (total == 0) {
+        if (error != nullptr) {
+            *error = "No samples";
+        }
+        return false;
+    }
+
+    store->reserve(store->size() + total);
+    for (int i = 0; i < chunks; i++) {
+        store->append(parts.at(i));
+    }
+
+    return true;
+}
+
+/**
+ * @brief MeasurementLoader::isHeader
+ * @return true if the line starts with a letter (and so is not data)
+ */
+bool MeasurementLoader::isHeader(const char *begin, const char *end)
+{
+    return begin < end && std::isalpha((unsigned char) *begin);
+}
+
+/**
+ * @brief MeasurementLoader::parseHeader identifies the columns from their names
+ * @return The column indexes, with -1 for any column that was not found
+ */
+MeasurementLoader::Columns MeasurementLoader::parseHeader(const char *begin, const char *end)
+{
+    const char *fieldBegin[MAXIMUM_FIELDS];
+    const char *fieldEnd[MAXIMUM_FIELDS];
+    int count = splitFields(begin, end, fieldBegin, fieldEnd);
+
+    Columns columns;
+    columns.va = -1;
+    columns.ia = -1;
+    columns.vg1 = -1;
+    columns.vg2 = -1;
+    columns.ig2 = -1;
+
+    int column = -1;
+    for (int i = 0; i < count; i++) {
+        if (fieldBegin[i] < fieldEnd[i] && (*fieldBegin[i] == '(' || *fieldBegin[i] == '[')) {
+            continue; // Units separated from their column name by whitespace, e.g. "Ia (mA)"
+        }
+        column++;
+
+        QByteArray name;
+        for (const char *c = fieldBegin[i]; c < fieldEnd[i] && *c != '(' && *c != '['; c++) {
+            if (std::isalnum((unsigned char) *c)) {
+                name.append((char) std::tolower((unsigned char) *c));
+            }
+        }
+
+        if (name == "va" || name == "vak" || name == "ua") {
+            columns.va = column;
+        } else if (name == "ia" || name == "iak") {
+            columns.ia = column;
+        } else if (name == "vg" || name == "vg1" || name == "vgk" || name == "ug1") {
+            columns.vg1 = column;
+        } else if (name == "vs" || name == "vg2" || name == "ug2") {
+            columns.vg2 = column;
+        } else if (name == "is" || name == "ig2" || name == "ig2k") {
+            columns.ig2 = column;
+        }
+    }
+
+    columns.required = qMax(columns.va, qMax(columns.ia, columns.vg1)) + 1;
+
+    return columns;
+}
+
+/**
+ * @brief MeasurementLoader::parseChunk parses the data lines between begin and end into a store
+ */
+void MeasurementLoader::parseChunk(const char *begin, const char *end, const Columns &columns, SampleStore *store)
+{
+    const char *fieldBegin[MAXIMUM_FIELDS];
+    const char *fieldEnd[MAXIMUM_FIELDS];
+
+    const char *p = begin;
+    while (p < end) {
+        const char *lineEnd = (const char *) memchr(p, '\n', end - p);
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+
+        const char *lineBegin = p;
+        p = lineEnd < end ? lineEnd + 1 : end;
+
+        while (lineBegin < lineEnd && isSpace(*lineBegin)) {
+            lineBegin++;
+        }
+        if (lineBegin == lineEnd || *lineBegin == '#') {
+            continue;
+        }
+
+        int count = splitFields(lineBegin, lineEnd, fieldBegin, fieldEnd);
+        if (count < columns.required) {
+            continue;
+        }
+
+        double va, ia, vg1;
+        double vg2 = 0.0;
+        if (!parseNumber(fieldBegin[columns.va], fieldEnd[columns.va], &va) ||
+            !parseNumber(fieldBegin[columns.ia], fieldEnd[columns.ia], &ia) ||
+            !parseNumber(fieldBegin[columns.vg1], fieldEnd[columns.vg1], &vg1)) {
+            continue;
+        }
+        if (columns.vg2 >= 0 && columns.vg2 < count) {
+            if (!parseNumber(fieldBegin[columns.vg2], fieldEnd[columns.vg2], &vg2)) {
+                vg2 = 0.0;
+            }
+        }
+
+        double ig2 = NAN;
+        if (columns.ig2 >= 0 && columns.ig2 < count) {
+            if (!parseNumber(fieldBegin[columns.ig2], fieldEnd[columns.ig2], &ig2)) {
+                ig2 = NAN;
+            }
+        }
+
+        store->append(va, ia, vg1, vg2, ig2);
+    }
+}
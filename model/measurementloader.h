@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QString>
+
+#include "samplestore.h"
+
+/**
+ * @brief The MeasurementLoader class
+ *
+ * Loads measured samples from CSV files and uTracer style logs into a SampleStore.
+ *
+ * The file is memory mapped and the data lines are split into chunks (at line boundaries) that are
+ * parsed in parallel, each into its own SampleStore, before being concatenated in file order.
+ *
+ * Fields may be separated by commas, semicolons, tabs or spaces. If the first non-comment line is a
+ * header, the columns are identified by name: va (anode voltage), ia (anode current in mA), vg or vg1
+ * (grid voltage), vs or vg2 (screen voltage) and is or ig2 (screen current in mA), ignoring case and
+ * any units, so that uTracer logs with columns such as "Point  Ia (mA)  Is (mA)  Vg (V)  Va (V)  Vs (V)"
+ * are read correctly. Without a header the columns are taken to be va, ia, vg1 and, optionally, vg2
+ * and ig2. A screen current that is missing or cannot be parsed is stored as NAN (not measured). Lines
+ * starting with # and lines that do not contain a complete sample are skipped.
+ */
+class MeasurementLoader
+{
+public:
+    static bool load(const QString &fileName, SampleStore *store, QString *error = nullptr, int threads = 0);
+    static bool parse(const char *data, qint64 length, SampleStore *store, QString *error = nullptr, int threads = 0);
+
+private:
+    struct Columns {
+        int va = 0;
+        int ia = 1;
+        int vg1 = 2;
+        int vg2 = 3;
+        int ig2 = 4;
+        int required = 3;
+    };
+
+    static bool isHeader(const char *begin, const char *end);
+    static Columns parseHeader(const char *begin, const char *end);
+    static void parseChunk(const char *begin, const char *end, const Columns &columns, SampleStore *store);
+};
@@ -1,96 +1,1216 @@
 #include "model.h"
+#include "modelfactory.h"
+#include "fittelemetry.h"
+#include "solvertuner.h"
+#include "anodevoltagetable.h"
+
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+
+/**
+ * @brief INVERSE_ITERATIONS The most model evaluations made by each of the bracketing and refining
+ * stages of an inverse solution
+ */
+#define INVERSE_ITERATIONS 100
+
+#define ANODE_VOLTAGE_LIMIT 10000.0
+#define GRID_VOLTAGE_LIMIT 1000.0
+
+/**
+ * @brief invertIncreasing solves function(x) = target for a monotonically increasing function
+ * @param function Called as function(x, &derivative) and returns the value at x
+ * @param target The value sought
+ * @param guess The starting point, e.g. the previous solution along a curve
+ * @param step The initial step when searching for a bracket
+ * @param lower The smallest acceptable solution
+ * @param upper The largest acceptable solution
+ * @return The solution, or the limit nearest to it if the target cannot be reached within the limits
+ *
+ * A bracket is found by stepping away from the guess in steps of doubling size (taking the Newton
+ * step first when it heads the right way) and the root is then refined by Newton's method,
+ * falling back to bisection whenever a Newton step would leave the bracket or fails to halve it.
+ * Both stages are bounded by INVERSE_ITERATIONS so the solution always terminates.
+ */
+template <typename Function>
+static double invertIncreasing(Function function, double target, double guess, double step, double lower, double upper)
+{
+    double x = qBound(lower, guess, upper);
+    double derivative;
+    double value = function(x, &derivative) - target;
+    if (value == 0.0 || !std::isfinite(value)) {
+        return x;
+    }
+
+    // Bracket the solution between lo (below the target) and hi (above it)
+    double direction = value < 0.0 ? 1.0 : -1.0;
+    double lo = x;
+    double hi = x;
+    bool bracketed = false;
+
+    double trial = derivative > 0.0 ? x - value / derivative : x;
+    if (!std::isfinite(trial) || direction * (trial - x) <= 0.0) {
+        trial = x + direction * step;
+    }
+
+    for (int i = 0; i < INVERSE_ITERATIONS; i++) {
+        trial = qBound(lower, trial, upper);
+
+        double trialDerivative;
+        double trialValue = function(trial, &trialDerivative) - target;
+        if (trialValue == 0.0) {
+            return trial;
+        }
+
+        if ((trialValue < 0.0) != (value < 0.0)) {
+            lo = qMin(x, trial);
+            hi = qMax(x, trial);
+            bracketed = true;
+        }
+
+        if (bracketed || std::abs(trialValue) < std::abs(value)) {
+            x = trial;
+            value = trialValue;
+            derivative = trialDerivative;
+        }
+
+        if (bracketed) {
+            break;
+        }
+
+        if (trial == lower || trial == upper) {
+            return trial; // The target is out of reach
+        }
+
+        step *= 2.0;
+        trial = x + direction * step;
+    }
+
+    if (!bracketed) {
+        return x;
+    }
+
+    // Refine within the bracket
+    double dx = hi - lo;
+    double dxOld = dx;
+    for (int i = 0; i < INVERSE_ITERATIONS; i++) {
+        double next = x - value / derivative;
+        if (!(derivative > 0.0) || !(next > lo && next < hi) || std::abs(2.0 * value) > std::abs(dxOld * derivative)) {
+            dxOld = dx;
+            dx = 0.5 * (hi - lo);
+            x = lo + dx;
+        } else {
+            dxOld = dx;
+            dx = x - next;
+            x = next;
+        }
+
+        if (std::abs(dx) <= 1.0e-12 * (1.0 + std::abs(x))) {
+            break;
+        }
+
+        value = function(x, &derivative) - target;
+        if (std::abs(value) <= 1.0e-12 * std::abs(target)) {
+            break;
+        }
+
+        if (value < 0.0) {
+            lo = x;
+        } else {
+            hi = x;
+        }
+    }
+
+    return x;
+}
+
+/**
+ * @brief The MultiStartCallback class
+ *
+ * Watches one start of a multi-start fit. The cost of a start never increases from one iteration to
+ * the next, so the lowest cost reached so far by any start is an upper bound on the winning cost. A
+ * start whose cost is still a large factor above that bound once the grace period is over is abandoned.
+ */
+class MultiStartCallback : public ceres::IterationCallback
+{
+public:
+    MultiStartCallback(std::atomic<double> *bestCost, double abandonRatio, int gracePeriod) :
+        bestCost(bestCost), abandonRatio(abandonRatio), gracePeriod(gracePeriod)
+    {
+    }
+
+    virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary &summary)
+    {
+        double cost = summary.cost;
+        double best = bestCost->load();
+        while (cost < best && !bestCost->compare_exchange_weak(best, cost)) {
+        }
+
+        if (summary.iteration >= gracePeriod && cost > abandonRatio * bestCost->load()) {
+            abandoned = true;
+            return ceres::SOLVER_ABORT;
+        }
+
+        return ceres::SOLVER_CONTINUE;
+    }
+
+    bool abandoned = false;
+
+private:
+    std::atomic<double> *bestCost;
+    double abandonRatio;
+    int gracePeriod;
+};
+
+Model::Model()
+{
+    problem = nullptr;
+
+    resetSamples();
+}
+
+Model::~Model()
+{
+    delete problem;
+    delete voltageTable;
+
+    for (int i = 0; i < MODEL_PARAMETERS; i++) {
+        delete parameter[i];
+    }
+}
+
+double Model::anodeCurrentGradient(double va, double vg1, double vg2, double *dIaDva, double *dIaDvg1)
+{
+    double hVa = 1.0e-6 * (1.0 + std::abs(va));
+    double hVg1 = 1.0e-6 * (1.0 + std::abs(vg1));
+
+    *dIaDva = (anodeCurrent(va + hVa, vg1, vg2) - anodeCurrent(va - hVa, vg1, vg2)) / (2.0 * hVa);
+    *dIaDvg1 = (anodeCurrent(va, vg1 + hVg1, vg2) - anodeCurrent(va, vg1 - hVg1, vg2)) / (2.0 * hVg1);
+
+    return anodeCurrent(va, vg1, vg2);
+}
 
 /**
  * @brief Model::anodeVoltage
  * @param ia The desired anode current
  * @param vg1 The grid voltage
  * @param vg2 For pentodes, the screen grid voltage
+ * @param vaGuess If positive, the anode voltage to start the search from (e.g. the previous point on a curve)
  * @return The anode voltage that will result in the desired anode current
  *
- * Uses a gradient based search to find the anode voltage that will result in the specified
- * anode current given the specified grid voltages. This is provided to enable the accurate
- * determination of a cathode load line.
+ * Finds the anode voltage that will result in the specified anode current given the specified grid
+ * voltages. This is provided to enable the accurate determination of a cathode load line. If an
+ * inverse table has been set (see setInverseTable), is current and covers the query, the answer is
+ * interpolated from the table, otherwise it is solved by solveAnodeVoltage.
  */
-double Model::anodeVoltage(double ia, double vg1, double vg2)
+double Model::anodeVoltage(double ia, double vg1, double vg2, double vaGuess)
 {
-    double va = 100.0;
-    double tolerance = 1.2;
+    AnodeVoltageTable *table = inverseTable();
+    if (table != nullptr && vg2 == 0.0 && table->contains(ia, vg1)) {
+        return table->anodeVoltage(ia, vg1);
+    }
 
-    double iaTest = anodeCurrent(va, vg1, vg2);
-    double gradient = iaTest - anodeCurrent(va - 1.0, vg1, vg2);
-    double iaErr = ia - iaTest;
+    return solveAnodeVoltage(ia, vg1, vg2, vaGuess);
+}
 
-    while ((abs(iaErr) / ia) > 0.01) {
-        if (gradient != 0.0) {
-            double vaNext = va + iaErr / gradient;
-            if (vaNext < va / tolerance) { // use the gradient but limit step to 20%
-                vaNext = va / tolerance;
-            }
-            if (vaNext > tolerance * va) { // use the gradient but limit step to 20%
-                vaNext = tolerance * va;
-            }
-            va = vaNext;
+/**
+ * @brief Model::solveAnodeVoltage solves the model for the anode voltage, without the inverse table
+ * @param ia The desired anode current
+ * @param vg1 The grid voltage
+ * @param vg2 For pentodes, the screen grid voltage
+ * @param vaGuess If positive, the anode voltage to start the search from (e.g. the previous point on a curve)
+ * @return The anode voltage that will result in the desired anode current
+ *
+ * Uses a bracketed Newton search on the analytic derivative of the model, so the number of
+ * evaluations is bounded. A current of zero (or one that the device passes even at va = 0) gives 0
+ * and a current that cannot be reached below ANODE_VOLTAGE_LIMIT gives that limit.
+ */
+double Model::solveAnodeVoltage(double ia, double vg1, double vg2, double vaGuess)
+{
+    if (!(ia > 0.0)) {
+        return 0.0;
+    }
+
+    double va = vaGuess > 0.0 ? vaGuess : 100.0;
+
+    return invertIncreasing([this, vg1, vg2](double x, double *derivative) {
+        double dIaDvg1;
+        return anodeCurrentGradient(x, vg1, vg2, derivative, &dIaDvg1);
+    }, ia, va, qMax(1.0, 0.1 * va), 0.0, ANODE_VOLTAGE_LIMIT);
+}
+
+/**
+ * @brief Model::anodeVoltages finds the anode voltages for arrays of anode currents, e.g. along a load line
+ * @param ia The desired anode currents
+ * @param vg1 The grid voltages
+ * @param vg2 For pentodes only, the screen grid voltages (may be nullptr for triodes)
+ * @param va Receives the anode voltages
+ * @param count The number of points
+ *
+ * Points covered by the inverse table are interpolated. Each of the other points is solved starting
+ * from the solution of the previous point, so consecutive points along a curve typically need only
+ * one or two Newton steps.
+ */
+void Model::anodeVoltages(const double *ia, const double *vg1, const double *vg2, double *va, int count)
+{
+    AnodeVoltageTable *table = inverseTable();
+    double vaGuess = 0.0;
+
+    for (int i = 0; i < count; i++) {
+        double screen = vg2 != nullptr ? vg2[i] : 0.0;
+        if (table != nullptr && screen == 0.0 && table->contains(ia[i], vg1[i])) {
+            va[i] = table->anodeVoltage(ia[i], vg1[i]);
         } else {
-            va = 2 * va;
+            va[i] = solveAnodeVoltage(ia[i], vg1[i], screen, vaGuess);
+        }
+        if (va[i] > 0.0) {
+            vaGuess = va[i];
         }
-        iaTest = anodeCurrent(va, vg1, vg2);
-        gradient = iaTest - anodeCurrent(va - 1.0, vg1, vg2);
-        iaErr = ia - iaTest;
     }
+}
+
+/**
+ * @brief Model::gridVoltage
+ * @param ia The desired anode current
+ * @param va The anode voltage
+ * @param vg2 For pentodes, the screen grid voltage
+ * @param vg1Guess The grid voltage to start the search from
+ * @return The grid voltage that will result in the desired anode current
+ *
+ * The inverse of the model in the grid voltage, found in the same way as anodeVoltage. A current
+ * that cannot be reached within GRID_VOLTAGE_LIMIT of 0 V gives the nearest limit.
+ */
+double Model::gridVoltage(double ia, double va, double vg2, double vg1Guess)
+{
+    return invertIncreasing([this, va, vg2](double x, double *derivative) {
+        double dIaDva;
+        return anodeCurrentGradient(va, x, vg2, &dIaDva, derivative);
+    }, ia, vg1Guess, 1.0, -GRID_VOLTAGE_LIMIT, GRID_VOLTAGE_LIMIT);
+}
 
-    return va;
+/**
+ * @brief Model::anodeCurrents calculates the modelled anode current for arrays of samples
+ * @param va The anode voltages
+ * @param vg1 The grid voltages
+ * @param vg2 For pentodes only, the screen grid voltages (may be nullptr for triodes)
+ * @param ia Receives the anode currents in mA
+ * @param count The number of samples
+ *
+ * The models override this to read their parameters once and use the vector kernels of AnodeKernel.
+ */
+void Model::anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count)
+{
+    for (int i = 0; i < count; i++) {
+        ia[i] = anodeCurrent(va[i], vg1[i], vg2 != nullptr ? vg2[i] : 0.0);
+    }
 }
 
-void Model::solve()
+/**
+ * @brief Model::screenCurrents calculates the modelled screen current for arrays of samples
+ * @param va The anode voltages
+ * @param vg1 The grid voltages
+ * @param vg2 The screen grid voltages
+ * @param ig2 Receives the screen currents in mA
+ * @param count The number of samples
+ *
+ * The pentode models override this to read their parameters once.
+ */
+void Model::screenCurrents(const double *va, const double *vg1, const double *vg2, double *ig2, int count)
 {
+    for (int i = 0; i < count; i++) {
+        ig2[i] = screenCurrent(va[i], vg1[i], vg2 != nullptr ? vg2[i] : 0.0);
+    }
+}
+
+double Model::screenCurrent(double va, double vg1, double vg2)
+{
+    return 0.0;
+}
+
+void Model::addSample(double va, double ia, double vg1, double vg2, double ig2)
+{
+    if (jacobianType == JACOBIAN_AUTODIFF || batchSize <= 1) {
+        samples.append(va, ia, vg1, vg2, ig2);
+        pendingBegin = samples.end();
+        addResidualBlock(createCostFunction(va, ia, vg1, vg2, ig2), 1);
+        return;
+    }
+
+    qint64 last = samples.end() - 1;
+    if (last >= pendingBegin && (vg1 != *samples.vg1(last) || vg2 != *samples.vg2(last))) {
+        flushSamples(); // A change of grid voltage starts a new curve
+    }
+
+    samples.append(va, ia, vg1, vg2, ig2);
+
+    if (samples.end() - pendingBegin >= batchSize) {
+        flushSamples();
+    }
+}
+
+/**
+ * @brief Model::addSamples adds every sample held by a SampleStore
+ * @param source The samples to add, e.g. as read by MeasurementLoader
+ *
+ * The samples are copied into the model's store in one operation and then split into batches at
+ * each change of grid voltage, or when the batch size is reached.
+ */
+void Model::addSamples(const SampleStore &source)
+{
+    if (jacobianType == JACOBIAN_AUTODIFF || batchSize <= 1) {
+        for (qint64 i = source.first(); i < source.end(); i++) {
+            addSample(*source.va(i), *source.ia(i), *source.vg1(i), *source.vg2(i), *source.ig2(i));
+        }
+        return;
+    }
+
+    flushSamples();
+    samples.append(source);
+
+    qint64 end = samples.end();
+    qint64 begin = pendingBegin;
+    pendingBegin = end;
+
+    for (qint64 i = begin + 1; i <= end; i++) {
+        if (i == end || i - begin >= batchSize || *samples.vg1(i) != *samples.vg1(i - 1) || *samples.vg2(i) != *samples.vg2(i - 1)) {
+            addResidualBlock(createBatchCostFunction(begin, (int) (i - begin)), (int) (i - begin));
+            begin = i;
+        }
+    }
+}
+
+const SampleStore &Model::getSamples() const
+{
+    return samples;
+}
+
+/**
+ * @brief Model::solve
+ * @return A summary of the fit
+ *
+ * Fits the model to the samples added so far, starting from the current parameter values.
+ */
+FitResult Model::solve()
+{
+    return fit(0);
+}
+
+/**
+ * @brief Model::solveIncremental re-fits the model after further samples have been added
+ * @param maxIterations The iteration budget for the re-fit
+ * @return A summary of the fit
+ *
+ * New samples are appended to the existing problem and the fit restarts from the previous optimum,
+ * which is normally close to the new one, so a small iteration budget is sufficient.
+ */
+FitResult Model::solveIncremental(int maxIterations)
+{
+    return fit(maxIterations);
+}
+
+/**
+ * @brief The FitControlCallback class
+ *
+ * Passes the state of each iteration to a Model's IterationHook and stops the solver when the fit is
+ * cancelled (abandoning it) or when its deadline passes (keeping the best solution found so far).
+ */
+class FitControlCallback : public ceres::IterationCallback
+{
+public:
+    FitControlCallback(Model *model, const IterationHook &hook, const std::atomic<bool> *cancelFlag, const QDeadlineTimer &deadline) :
+        model(model), hook(hook), cancelFlag(cancelFlag), deadline(deadline)
+    {
+    }
+
+    virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary &summary)
+    {
+        if (hook) {
+            FitIteration iteration;
+            iteration.modelName = model->getName();
+            iteration.iteration = summary.iteration;
+            iteration.cost = summary.cost;
+            iteration.costChange = summary.cost_change;
+            iteration.gradientNorm = summary.gradient_norm;
+            iteration.stepNorm = summary.step_norm;
+            iteration.trustRegionRadius = summary.trust_region_radius;
+            iteration.successful = summary.step_is_successful;
+            iteration.elapsed = summary.cumulative_time_in_seconds * 1000.0;
+            iteration.parameters = model->getParameterValues();
+
+            hook(iteration);
+        }
+
+        if (cancelFlag != nullptr && cancelFlag->load()) {
+            return ceres::SOLVER_ABORT;
+        }
+
+        if (deadline.hasExpired()) {
+            return ceres::SOLVER_TERMINATE_SUCCESSFULLY;
+        }
+
+        return ceres::SOLVER_CONTINUE;
+    }
+
+private:
+    Model *model;
+    const IterationHook &hook;
+    const std::atomic<bool> *cancelFlag;
+    QDeadlineTimer deadline;
+};
+
+/**
+ * @brief Model::solveMultiStart fits the model from several starting points in parallel
+ * @param multiStartOptions The number of starts, the pre-screen and the abandonment rule
+ * @return The fit of every start and of the winner
+ *
+ * Ceres is a local optimiser, so a poor starting point can leave the fit in a poor minimum. The
+ * starts are the current parameter values plus the lowest cost seeds of a Latin hypercube drawn within
+ * the bounds set by setOptions (see drawSeeds). Each start is solved by its own model, with its own
+ * Problem and a copy of the samples, on a thread pool. Starts that clearly cannot win are abandoned
+ * (see MultiStartCallback). The parameters of the usable start with the lowest cost are then copied to
+ * this model.
+ */
+MultiStartResult Model::solveMultiStart(const MultiStartOptions &multiStartOptions)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    MultiStartResult result;
+
+    flushSamples();
+    if (sampleCount == 0) {
+        return result;
+    }
+
+    QVector<QVector<double>> seeds = drawSeeds(multiStartOptions);
+    int starts = seeds.size();
+
+    int cores = multiStartOptions.cores;
+    if (cores <= 0) {
+        cores = qMax(1, QThread::idealThreadCount());
+    }
+    int concurrentFits = qMin(starts, cores);
+    int threadsPerFit = qMax(1, cores / concurrentFits);
+
+    std::atomic<double> bestCost(std::numeric_limits<double>::infinity());
+
+    QVector<Model *> startModels(starts);
+    QVector<MultiStartCallback *> callbacks(starts);
+    result.starts.resize(starts);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(concurrentFits);
+
+    for (int i = 0; i < starts; i++) {
+        Model *model = ModelFactory::createModel(getType());
+        model->setJacobianType(jacobianType);
+        model->setBatchSize(batchSize);
+        model->setThreadCount(threadsPerFit);
+        model->setParameterValues(seeds.at(i));
+
+        MultiStartCallback *callback = new MultiStartCallback(&bestCost, multiStartOptions.abandonRatio, multiStartOptions.gracePeriod);
+        model->options.callbacks.push_back(callback);
+
+        startModels[i] = model;
+        callbacks[i] = callback;
+
+        const SampleStore *source = &samples;
+        FitResult *fitResult = &result.starts[i];
+        pool.start([model, source, fitResult]() {
+            model->addSamples(*source);
+            *fitResult = model->solve();
+        });
+    }
+
+    pool.waitForDone();
+
+    for (int i = 0; i < starts; i++) {
+        if (callbacks.at(i)->abandoned) {
+            result.abandoned++;
+        } else if (result.starts.at(i).usable && (result.bestStart < 0 || result.starts.at(i).cost < result.starts.at(result.bestStart).cost)) {
+            result.bestStart = i;
+        }
+    }
+
+    if (result.bestStart >= 0) {
+        result.best = result.starts.at(result.bestStart);
+        setParameterValues(startModels.at(result.bestStart)->getParameterValues());
+        scheduleInverseTable();
+    }
+
+    qDeleteAll(startModels);
+    qDeleteAll(callbacks);
+
+    result.wallTime = timer.nsecsElapsed() / 1.0e6;
+
+    qInfo("Multi-start fit of %s: %d starts, %d abandoned, best start %d", getName().toLocal8Bit().constData(),
+          starts, result.abandoned, result.bestStart);
+
+    return result;
+}
+
+/**
+ * @brief Model::fit
+ * @param maxIterations The iteration limit, or 0 to use the limit set by setOptions
+ * @return A summary of the fit
+ */
+FitResult Model::fit(int maxIterations)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    flushSamples();
+
+    FitResult result;
+    result.modelName = getName();
+    result.modelType = getType();
+
+    if (sampleCount == 0) { // No parameter blocks exist in an empty problem so there is nothing to fit
+        return result;
+    }
+
     setOptions();
+    clampToBounds();
+    if (autoTune) {
+        setSolverConfiguration(SolverTuner::configuration(this));
+    }
+    if (hasSolverConfiguration) {
+        options.linear_solver_type = solverConfiguration.linearSolver;
+        options.trust_region_strategy_type = solverConfiguration.trustRegion;
+    }
+    options.num_threads = threadCount;
+    if (maxIterations > 0) {
+        options.max_num_iterations = maxIterations;
+    }
+
+    if (cancelFlag != nullptr && cancelFlag->load()) {
+        result.termination = ceres::TerminationTypeToString(ceres::USER_FAILURE);
+        result.message = "Cancelled before the fit started";
+        result.wallTime = timer.nsecsElapsed() / 1.0e6;
+        return result;
+    }
+
+    bool controlled = iterationHook || cancelFlag != nullptr || !deadline.isForever();
+    FitControlCallback controlCallback(this, iterationHook, cancelFlag, deadline);
+    if (controlled) {
+        options.callbacks.push_back(&controlCallback);
+    }
+    options.update_state_every_iteration = (bool) iterationHook; // So that the hook sees the current parameters
 
     Solver::Summary summary;
-    Solve(options, &problem, &summary);
+    Solve(options, problem, &summary);
+
+    if (controlled) {
+        options.callbacks.erase(std::remove(options.callbacks.begin(), options.callbacks.end(), &controlCallback), options.callbacks.end());
+    }
+
+    qDebug(summary.BriefReport().c_str());
+
+    result.initialCost = summary.initial_cost;
+    result.cost = summary.final_cost;
+    measureRms(&result);
+    result.iterations = summary.num_successful_steps + summary.num_unsuccessful_steps;
+    result.residualEvaluations = (qint64) summary.num_residuals * (summary.num_residual_evaluations + summary.num_jacobian_evaluations);
+    result.wallTime = timer.nsecsElapsed() / 1.0e6;
+    result.residualTime = summary.residual_evaluation_time_in_seconds * 1000.0;
+    result.jacobianTime = summary.jacobian_evaluation_time_in_seconds * 1000.0;
+    result.linearSolverTime = summary.linear_solver_time_in_seconds * 1000.0;
+    result.solver = QString(ceres::LinearSolverTypeToString(options.linear_solver_type)) + "/" +
+            ceres::TrustRegionStrategyTypeToString(options.trust_region_strategy_type);
+    result.termination = ceres::TerminationTypeToString(summary.termination_type);
+    result.message = QString::fromStdString(summary.message);
+    result.usable = summary.IsSolutionUsable();
+
+    // Incremental fits can be cheaper than a table build, so the table is only rebuilt when queried
+    scheduleInverseTable();
 
-    qInfo(summary.BriefReport().c_str());
+    FitTelemetry::record(result);
+
+    return result;
+}
+
+void Model::setThreadCount(int newThreadCount)
+{
+    threadCount = newThreadCount;
+}
+
+int Model::getThreadCount() const
+{
+    return threadCount;
 }
 
+void Model::setIterationHook(const IterationHook &newIterationHook)
+{
+    iterationHook = newIterationHook;
+}
+
+void Model::setCancelFlag(const std::atomic<bool> *newCancelFlag)
+{
+    cancelFlag = newCancelFlag;
+}
+
+void Model::setDeadline(const QDeadlineTimer &newDeadline)
+{
+    deadline = newDeadline;
+}
+
+void Model::setSolverConfiguration(const SolverConfiguration &newSolverConfiguration)
+{
+    solverConfiguration = newSolverConfiguration;
+    hasSolverConfiguration = true;
+}
+
+/**
+ * @brief Model::clearSolverConfiguration returns to the solver choice made by setOptions
+ */
+void Model::clearSolverConfiguration()
+{
+    hasSolverConfiguration = false;
+    autoTune = false;
+}
+
+void Model::setAutoTune(bool newAutoTune)
+{
+    autoTune = newAutoTune;
+}
+
+/**
+ * @brief Model::seedFrom sets the parameters shared with another model to that model's values
+ * @param source The model to take the parameter values from
+ *
+ * Because the models are progressive refinements, the converged parameters of a simpler model are a
+ * good starting point for fitting a more complex one. Only the parameters the source model actually
+ * fits (its parameterBlocks) are copied, so a slot the source merely carries at its default (such as
+ * the Koren model's Vct) never overwrites a value fitted by an earlier model. Parameters that only
+ * exist in this model are left unchanged, as are all of the parameters when one model is a triode
+ * and the other a pentode (because the two families use the parameter slots differently).
+ */
+void Model::seedFrom(Model *source)
+{
+    if ((getType() >= KOREN_PENTODE) != (source->getType() >= KOREN_PENTODE)) {
+        return;
+    }
+
+    std::vector<double *> fitted = source->parameterBlocks();
+
+    for (int i = 0; i < MODEL_PARAMETERS; i++) {
+        if (parameter[i] == nullptr || source->parameter[i] == nullptr) {
+            continue;
+        }
+        if (std::find(fitted.begin(), fitted.end(), source->parameter[i]->getPointer()) != fitted.end()) {
+            parameter[i]->setValue(source->parameter[i]->getValue());
+        }
+    }
+
+    invalidateInverseTable();
+}
+
+/**
+ * @brief Model::getParameterValues
+ * @return A snapshot of all MODEL_PARAMETERS parameter slots (unused slots are 0)
+ */
+QVector<double> Model::getParameterValues() const
+{
+    QVector<double> values(MODEL_PARAMETERS, 0.0);
+
+    for (int i = 0; i < MODEL_PARAMETERS; i++) {
+        if (parameter[i] != nullptr) {
+            values[i] = parameter[i]->getValue();
+        }
+    }
+
+    return values;
+}
+
+/**
+ * @brief Model::setParameterValues restores a snapshot taken with getParameterValues
+ * @param values The parameter values
+ */
+void Model::setParameterValues(const QVector<double> &values)
+{
+    for (int i = 0; i < MODEL_PARAMETERS && i < values.size(); i++) {
+        if (parameter[i] != nullptr) {
+            parameter[i]->setValue(values.at(i));
+        }
+    }
+
+    invalidateInverseTable();
+}
+
+/**
+ * @brief Model::compareJacobians checks the analytic cost function against the automatic differentiation one
+ * @param va The anode voltage
+ * @param ia The anode current in mA
+ * @param vg1 The grid voltage
+ * @param vg2 For pentodes only, the screen grid voltage
+ * @param ig2 For pentodes only, the screen current in mA, or NAN if it was not measured
+ * @return The largest difference between the residuals or Jacobian entries of the two cost functions for
+ * this sample at the current parameter values, relative to the larger of the two values (or to 1e-8 where
+ * both are smaller than that)
+ *
+ * Only meaningful for the triode models: the pentode cost functions use automatic differentiation in
+ * both Jacobian modes, so for them this always gives 0.
+ */
+double Model::compareJacobians(double va, double ia, double vg1, double vg2, double ig2)
+{
+    int savedJacobianType = jacobianType;
+
+    jacobianType = JACOBIAN_ANALYTIC;
+    CostFunction *analytic = createCostFunction(va, ia, vg1, vg2, ig2);
+    jacobianType = JACOBIAN_AUTODIFF;
+    CostFunction *autodiff = createCostFunction(va, ia, vg1, vg2, ig2);
+    jacobianType = savedJacobianType;
+
+    std::vector<double *> blocks = parameterBlocks();
+    const std::vector<int32_t> &blockSizes = analytic->parameter_block_sizes();
+    int residuals = analytic->num_residuals();
+
+    std::vector<double> residual[2];
+    std::vector<std::vector<double>> jacobian[2];
+    std::vector<double *> jacobianPointers[2];
+    CostFunction *costFunctions[2] = { analytic, autodiff };
+    bool evaluated = true;
+    for (int c = 0; c < 2; c++) {
+        residual[c].assign(residuals, 0.0);
+        jacobian[c].resize(blockSizes.size());
+        jacobianPointers[c].resize(blockSizes.size());
+        for (size_t b = 0; b < blockSizes.size(); b++) {
+            jacobian[c][b].assign(residuals * blockSizes[b], 0.0);
+            jacobianPointers[c][b] = jacobian[c][b].data();
+        }
+        evaluated = costFunctions[c]->Evaluate(blocks.data(), residual[c].data(), jacobianPointers[c].data()) && evaluated;
+    }
+
+    double error = evaluated ? 0.0 : INFINITY;
+    for (int r = 0; r < residuals; r++) {
+        double scale = qMax(1.0e-8, qMax(std::abs(residual[0][r]), std::abs(residual[1][r])));
+        error = qMax(error, std::abs(residual[0][r] - residual[1][r]) / scale);
+    }
+    for (size_t b = 0; b < blockSizes.size(); b++) {
+        for (size_t i = 0; i < jacobian[0][b].size(); i++) {
+            double scale = qMax(1.0e-8, qMax(std::abs(jacobian[0][b][i]), std::abs(jacobian[1][b][i])));
+            error = qMax(error, std::abs(jacobian[0][b][i] - jacobian[1][b][i]) / scale);
+        }
+    }
+
+    delete analytic;
+    delete autodiff;
+
+    return error;
+}
+
+void Model::setJacobianType(int newJacobianType)
+{
+    flushSamples();
+    jacobianType = newJacobianType;
+}
+
+int Model::getJacobianType() const
+{
+    return jacobianType;
+}
+
+void Model::setBatchSize(int newBatchSize)
+{
+    flushSamples();
+    batchSize = newBatchSize;
+}
+
+int Model::getBatchSize() const
+{
+    return batchSize;
+}
+
+void Model::setInverseTable(double iaMax, double vg1Max, double maxError)
+{
+    if (voltageTable != nullptr && iaMax == inverseIaMax && vg1Max == inverseVg1Max && maxError == inverseMaxError) {
+        return;
+    }
+
+    delete voltageTable;
+    voltageTable = new AnodeVoltageTable();
+
+    inverseIaMax = iaMax;
+    inverseVg1Max = vg1Max;
+    inverseMaxError = maxError;
+
+    // A table that was current covered fitted parameters, so the new one is built from them on demand
+    inverseTablePending = inverseTablePending || inverseTableCurrent;
+    inverseTableCurrent = false;
+}
+
+void Model::clearInverseTable()
+{
+    delete voltageTable;
+    voltageTable = nullptr;
+    inverseTableCurrent = false;
+}
+
+/**
+ * @brief Model::invalidateInverseTable stops anodeVoltage using the inverse table until it is rebuilt
+ *
+ * Called whenever the parameters change other than by a fit. The table is not rebuilt on demand
+ * afterwards (the new parameters may be one of many, e.g. a Monte Carlo trial), only by the next fit
+ * or an explicit updateInverseTable(). Owners that change the parameters by other means, e.g.
+ * through the Parameters directly, must call it too.
+ */
+void Model::invalidateInverseTable()
+{
+    inverseTableCurrent = false;
+    inverseTablePending = false;
+}
+
+/**
+ * @brief Model::scheduleInverseTable marks the inverse table stale but due to be built on the next query
+ *
+ * Called when the parameters have been fitted or loaded, i.e. when they are worth building a table for.
+ */
+void Model::scheduleInverseTable()
+{
+    inverseTableCurrent = false;
+    inverseTablePending = true;
+}
+
+/**
+ * @brief Model::updateInverseTable rebuilds the inverse table, if there is one, from the current parameters
+ *
+ * Together with the first query after a fit (see inverseTable), this is the only place the table is
+ * built, so neither may happen while other threads are querying the model.
+ */
+void Model::updateInverseTable()
+{
+    if (voltageTable != nullptr && !inverseTableCurrent) {
+        voltageTable->build(this, inverseIaMax, inverseVg1Max, inverseMaxError);
+        inverseTableCurrent = true;
+    }
+    inverseTablePending = false;
+}
+
+/**
+ * @brief Model::inverseTable builds the inverse table if it is due (see scheduleInverseTable)
+ * @return The inverse table, or nullptr if none has been set or it is stale
+ */
+AnodeVoltageTable *Model::inverseTable()
+{
+    if (inverseTablePending) {
+        updateInverseTable();
+    }
+
+    return inverseTableCurrent ? voltageTable : nullptr;
+}
+
+/**
+ * @brief Model::flushSamples
+ *
+ * Adds any pending samples to the problem as a single batched residual block.
+ */
+void Model::flushSamples()
+{
+    int count = (int) (samples.end() - pendingBegin);
+    if (count == 0) {
+        return;
+    }
+
+    qint64 begin = pendingBegin;
+    pendingBegin = samples.end();
+
+    addResidualBlock(createBatchCostFunction(begin, count), count);
+}
+
+/**
+ * @brief Model::addResidualBlock adds a residual block to the problem and applies the sample window
+ * @param costFunction The cost function for the residual block
+ * @param samples The number of samples covered by the cost function
+ */
+void Model::addResidualBlock(CostFunction *costFunction, int samples)
+{
+    ResidualBlockId id = problem->AddResidualBlock(costFunction, NULL, parameterBlocks());
+    residualBlocks.append(qMakePair(id, samples));
+    sampleCount += samples;
+
+    trimToWindow();
+}
+
+/**
+ * @brief Model::measureRms finds the anode and screen current errors of the fitted model
+ * @param result Receives the rms and screenRms
+ *
+ * The Ceres cost cannot be used for this because a pentode sample has a screen residual as well as an
+ * anode one, and the screen residual is fixed at zero where ig2 was not measured. The errors are
+ * evaluated afresh over the samples in the problem instead, counting only the measured screen currents.
+ */
+void Model::measureRms(FitResult *result)
+{
+    qint64 first = samples.first();
+    int count = (int) samples.size();
+    if (count == 0) {
+        return;
+    }
+
+    std::vector<double> current(count);
+    anodeCurrents(samples.va(first), samples.vg1(first), samples.vg2(first), current.data(), count);
+
+    const double *ia = samples.ia(first);
+    double sumSquares = 0.0;
+    for (int i = 0; i < count; i++) {
+        double error = current[i] - ia[i];
+        sumSquares += error * error;
+    }
+    result->rms = std::sqrt(sumSquares / count);
+
+    if (getType() < KOREN_PENTODE) {
+        return;
+    }
+
+    screenCurrents(samples.va(first), samples.vg1(first), samples.vg2(first), current.data(), count);
+
+    const double *ig2 = samples.ig2(first);
+    sumSquares = 0.0;
+    int measured = 0;
+    for (int i = 0; i < count; i++) {
+        if (!std::isnan(ig2[i])) {
+            double error = current[i] - ig2[i];
+            sumSquares += error * error;
+            measured++;
+        }
+    }
+    result->screenRms = measured > 0 ? std::sqrt(sumSquares / measured) : 0.0;
+}
+
+/**
+ * @brief Model::trimToWindow removes the oldest residual blocks until the sample window is respected
+ *
+ * The most recent residual block is always retained.
+ */
+void Model::trimToWindow()
+{
+    if (sampleWindow <= 0) {
+        return;
+    }
+
+    while (sampleCount > sampleWindow && residualBlocks.size() > 1) {
+        QPair<ResidualBlockId, int> oldest = residualBlocks.takeFirst();
+        problem->RemoveResidualBlock(oldest.first);
+        sampleCount -= oldest.second;
+        samples.discardFront(oldest.second);
+    }
+}
+
+void Model::setSampleWindow(int newSampleWindow)
+{
+    sampleWindow = newSampleWindow;
+
+    trimToWindow();
+}
+
+int Model::getSampleWindow() const
+{
+    return sampleWindow;
+}
+
+int Model::getSampleCount() const
+{
+    return samples.size();
+}
+
+/**
+ * @brief Model::resetSamples discards all samples while keeping the current parameter values
+ *
+ * The next fit therefore still starts from the previous optimum.
+ */
+void Model::resetSamples()
+{
+    Problem::Options problemOptions;
+    problemOptions.enable_fast_removal = true; // Needed for efficient sample windowing
+
+    delete problem;
+    problem = new Problem(problemOptions);
+
+    samples.clear();
+    pendingBegin = samples.end();
+    residualBlocks.clear();
+    sampleCount = 0;
+}
+
+/**
+ * @brief Model::clampToBounds moves any parameter that lies outside its bounds onto the nearest bound
+ *
+ * Ceres rejects a problem whose starting point is infeasible, which can happen when the parameters
+ * have been seeded from another model or read from Json.
+ */
+void Model::clampToBounds()
+{
+    std::vector<double *> blocks = parameterBlocks();
+
+    for (double *block : blocks) {
+        if (problem->HasParameterBlock(block)) {
+            double lowerBound = problem->GetParameterLowerBound(block, 0);
+            double upperBound = problem->GetParameterUpperBound(block, 0);
+
+            if (*block < lowerBound) {
+                *block = lowerBound;
+            }
+            if (*block > upperBound) {
+                *block = upperBound;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Model::setLowerBound
+ * @param parameter The parameter to bound
+ * @param lowerBound The lower bound
+ *
+ * Bounds are only applied to parameters that the model actually uses, i.e. that appear in the
+ * problem. This allows a derived model to inherit setOptions from a model with parameters it drops.
+ */
 void Model::setLowerBound(Parameter* parameter, double lowerBound)
 {
-    problem.SetParameterLowerBound(parameter->getPointer(), 0, lowerBound);
+    if (problem->HasParameterBlock(parameter->getPointer())) {
+        problem->SetParameterLowerBound(parameter->getPointer(), 0, lowerBound);
+    }
 }
 
 void Model::setUpperBound(Parameter* parameter, double upperBound)
 {
-    problem.SetParameterUpperBound(parameter->getPointer(), 0, upperBound);
+    if (problem->HasParameterBlock(parameter->getPointer())) {
+        problem->SetParameterUpperBound(parameter->getPointer(), 0, upperBound);
+    }
 }
 
 void Model::setLimits(Parameter* parameter, double lowerBound, double upperBound)
 {
-    problem.SetParameterLowerBound(parameter->getPointer(), 0, lowerBound);
-    problem.SetParameterUpperBound(parameter->getPointer(), 0, upperBound);
+    setLowerBound(parameter, lowerBound);
+    setUpperBound(parameter, upperBound);
 }
 
-double Model::korenCurrent(double va, double vg, double kp, double kvb, double a, double mu)
+/**
+ * @brief Model::parameterBounds reads the bounds that setOptions places on each parameter
+ * @param lower Receives the lower bound of each of the MODEL_PARAMETERS parameter slots
+ * @param upper Receives the upper bound of each of the MODEL_PARAMETERS parameter slots
+ *
+ * Unbounded sides (and unused slots) are reported as -infinity or +infinity.
+ */
+void Model::parameterBounds(QVector<double> &lower, QVector<double> &upper)
 {
-    double x1 = std::sqrt(kvb + va * va);
-    double x2 = kp * (1 / mu + vg / x1);
-    double x3 = std::log(1.0 + std::exp(x2));
-    double et = (va / kp) * x3;
+    flushSamples();
+    setOptions();
 
-    if (et < 0.0) {
-        et = 0.0;
-    }
+    const double infinity = std::numeric_limits<double>::infinity();
+    lower.fill(-infinity, MODEL_PARAMETERS);
+    upper.fill(infinity, MODEL_PARAMETERS);
+
+    for (int i = 0; i < MODEL_PARAMETERS; i++) {
+        if (parameter[i] != nullptr && problem->HasParameterBlock(parameter[i]->getPointer())) {
+            double lowerBound = problem->GetParameterLowerBound(parameter[i]->getPointer(), 0);
+            double upperBound = problem->GetParameterUpperBound(parameter[i]->getPointer(), 0);
 
-    return pow(et, a);
+            if (lowerBound > -std::numeric_limits<double>::max()) {
+                lower[i] = lowerBound;
+            }
+            if (upperBound < std::numeric_limits<double>::max()) {
+                upper[i] = upperBound;
+            }
+        }
+    }
 }
 
-double Model::improvedKorenCurrent(double va, double vg, double kp, double kvb, double kvb2, double vct, double a, double mu)
+/**
+ * @brief Model::drawSeeds chooses the starting points for solveMultiStart
+ * @param multiStartOptions The number of starts and candidates
+ * @return The starting parameter values, with the current values first
+ *
+ * Candidates are drawn from a Latin hypercube over the bounds of each parameter. A parameter that is
+ * unbounded on a side is given a range of a decade either side of its current value and a range that
+ * spans more than a decade is sampled logarithmically. The candidates are ranked by their initial cost
+ * and the best of them become the starts.
+ */
+QVector<QVector<double>> Model::drawSeeds(const MultiStartOptions &multiStartOptions)
 {
-    double x1 = std::sqrt(kvb + va * va + va * kvb2);
-    double x2 = kp * (1 / mu + (vg + vct) / x1);
-    double x3 = std::log(1.0 + std::exp(x2));
-    double et = (va / kp) * x3;
+    QVector<double> lower;
+    QVector<double> upper;
+    parameterBounds(lower, upper);
+
+    QVector<double> current = getParameterValues();
+
+    int starts = qMax(1, multiStartOptions.starts);
+    int count = qMax(multiStartOptions.candidates, starts - 1);
+
+    std::mt19937 generator(multiStartOptions.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    QVector<QVector<double>> candidates(count, current);
+
+    for (int i = 0; i < MODEL_PARAMETERS; i++) {
+        if (parameter[i] == nullptr || !problem->HasParameterBlock(parameter[i]->getPointer())) {
+            continue;
+        }
+
+        double value = current.at(i);
+        double low = lower.at(i);
+        double high = upper.at(i);
+        if (value > 0.0) {
+            low = std::isfinite(low) ? low : value / 10.0;
+            high = std::isfinite(high) ? high : value * 10.0;
+        } else {
+            double span = 10.0 * qMax(std::abs(value), 1.0);
+            low = std::isfinite(low) ? low : value - span;
+            high = std::isfinite(high) ? high : value + span;
+        }
+        low = qMax(low, lower.at(i)); // Keep the decade either side within any finite bound
+        high = qMin(high, upper.at(i));
+
+        bool logarithmic = low > 0.0 && high > 10.0 * low;
+
+        std::vector<int> strata(count);
+        std::iota(strata.begin(), strata.end(), 0);
+        std::shuffle(strata.begin(), strata.end(), generator);
+
+        for (int j = 0; j < count; j++) {
+            double u = (strata[j] + uniform(generator)) / count;
+            if (logarithmic) {
+                candidates[j][i] = std::exp(std::log(low) + u * (std::log(high) - std::log(low)));
+            } else {
+                candidates[j][i] = low + u * (high - low);
+            }
+        }
+    }
+
+    // Pre-screen the candidates by their cost on this model's problem
+    QVector<QPair<double, int>> ranking;
+    Problem::EvaluateOptions evaluateOptions;
+    evaluateOptions.num_threads = threadCount;
+
+    for (int j = 0; j < count; j++) {
+        setParameterValues(candidates.at(j));
+
+        double cost = std::numeric_limits<double>::infinity();
+        if (!problem->Evaluate(evaluateOptions, &cost, nullptr, nullptr, nullptr) || !std::isfinite(cost)) {
+            cost = std::numeric_limits<double>::infinity();
+        }
+        ranking.append(qMakePair(cost, j));
+    }
+
+    setParameterValues(current);
+
+    std::stable_sort(ranking.begin(), ranking.end(), [](const QPair<double, int> &a, const QPair<double, int> &b) {
+        return a.first < b.first;
+    });
 
-    if (et < 0.0) {
-        et = 0.0;
+    QVector<QVector<double>> seeds;
+    seeds.append(current);
+    for (int j = 0; j < ranking.size() && seeds.size() < starts; j++) {
+        seeds.append(candidates.at(ranking.at(j).second));
     }
 
-    return pow(et, a);
+    return seeds;
 }
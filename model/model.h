@@ -1,20 +1,42 @@
 #pragma once
 
+#include <QDeadlineTimer>
 #include <QJsonObject>
+#include <QList>
+#include <QPair>
 #include <QString>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
 
 #include "ceres/ceres.h"
 #include "glog/logging.h"
 
 #include "../ui/parameter.h"
 #include "../ui/uibridge.h"
+#include "batchcostfunction.h"
+#include "anodekernel.h"
+#include "triodekernel.h"
+#include "pentodekernel.h"
+#include "samplestore.h"
+#include "fitresult.h"
+
+class AnodeVoltageTable;
 
 using ceres::AutoDiffCostFunction;
+using ceres::SizedCostFunction;
 using ceres::CostFunction;
 using ceres::Problem;
+using ceres::ResidualBlockId;
 using ceres::Solve;
 using ceres::Solver;
 
+/**
+ * @brief MODEL_PARAMETERS The number of Parameter slots in a Model
+ */
+#define MODEL_PARAMETERS 10
+
 /**
  * @brief The eTriodeParameter enum
  *
@@ -32,6 +54,24 @@ enum eTriodeParameter {
     TRI_MU
 };
 
+/**
+ * @brief The ePentodeParameter enum
+ *
+ * Defines indexes into the array of model Parameters for the pentode models. As for the triodes, the
+ * Derk models extend the parameters of the Koren model with their own.
+ */
+enum ePentodeParameter {
+    PENT_KG1,
+    PENT_KP,
+    PENT_KVB,
+    PENT_ALPHA,
+    PENT_MU,
+    PENT_KG2,
+    PENT_A,
+    PENT_ALPHA_S,
+    PENT_BETA
+};
+
 enum eModelType {
     SIMPLE_TRIODE,
     KOREN_TRIODE,
@@ -41,6 +81,73 @@ enum eModelType {
     DERKE_PENTODE
 };
 
+/**
+ * @brief The eJacobianType enum
+ *
+ * Selects how the residual blocks supply their derivatives to Ceres. The analytic cost functions use
+ * hand derived Jacobians that reuse the intermediate terms of the residual calculation whereas the
+ * automatic differentiation cost functions are retained as a reference implementation.
+ */
+enum eJacobianType {
+    JACOBIAN_ANALYTIC,
+    JACOBIAN_AUTODIFF
+};
+
+/**
+ * @brief The MultiStartOptions struct
+ *
+ * Controls Model::solveMultiStart.
+ */
+struct MultiStartOptions {
+    /**
+     * @brief starts The number of starts to solve, including the current parameter values
+     */
+    int starts = 8;
+    /**
+     * @brief candidates The number of Latin hypercube seeds pre-screened by cost to choose the starts
+     */
+    int candidates = 64;
+    /**
+     * @brief cores The number of cores to use, or 0 to use all of them
+     */
+    int cores = 0;
+    /**
+     * @brief abandonRatio A start is abandoned when its cost exceeds the best cost by this factor
+     */
+    double abandonRatio = 4.0;
+    /**
+     * @brief gracePeriod The number of iterations before a start may be abandoned
+     */
+    int gracePeriod = 5;
+    /**
+     * @brief seed The random seed, so that a multi-start fit is reproducible
+     */
+    unsigned int seed = 1;
+};
+
+/**
+ * @brief The SolverConfiguration struct
+ *
+ * The linear solver and trust region strategy used by Ceres for a fit. When a Model has a solver
+ * configuration it overrides the choice made by the model's setOptions.
+ */
+struct SolverConfiguration {
+    ceres::LinearSolverType linearSolver = ceres::DENSE_QR;
+    ceres::TrustRegionStrategyType trustRegion = ceres::LEVENBERG_MARQUARDT;
+
+    QString getName() const
+    {
+        return QString(ceres::LinearSolverTypeToString(linearSolver)) + "/" + ceres::TrustRegionStrategyTypeToString(trustRegion);
+    }
+};
+
+/**
+ * @brief IterationHook A function called at the end of each solver iteration
+ *
+ * The hook is called on the thread that is running the fit.
+ */
+typedef std::function<void(const FitIteration &)> IterationHook;
+
 /**
  * @brief sgn
  * @param val The value for which to compute the Signum
@@ -62,14 +169,24 @@ template <typename T> int sgn(T val) {
 class Model : public UIBridge
 {
 public:
+    Model();
+    virtual ~Model();
+
     /**
      * @brief addSample adds a sample to the sample set that will be use to fit the model
      * @param va The anode voltage
      * @param ia The anode current in mA
      * @param vg1 The grid voltage
      * @param vg2 For pentodes only, the screen grid voltage
+     * @param ig2 For pentodes only, the screen current in mA, or NAN if it was not measured
+     *
+     * Samples are appended to the model's SampleStore and accumulated into batches, one per grid
+     * voltage curve and capped at the batch size. Each batch becomes a single residual block that reads
+     * the store directly when it is complete or when the model is solved.
      */
-	virtual void addSample(double va, double ia, double vg1, double vg2 = 0.0) = 0;
+	virtual void addSample(double va, double ia, double vg1, double vg2 = 0.0, double ig2 = NAN);
+    void addSamples(const SampleStore &source);
+    const SampleStore &getSamples() const;
     /**
      * @brief fromJson reads the model parameters from a Json object
      * @param source The Json object to read
@@ -88,30 +205,244 @@ public:
      * @return The anode current in mA
      */
     virtual double anodeCurrent(double va, double vg1, double vg2 = 0.0) = 0;
-    virtual double anodeVoltage(double ia, double vg1, double vg2 = 0.0);
+    virtual void anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count);
+    /**
+     * @brief anodeCurrentGradient calculates the modelled anode current and its derivatives
+     * @param va The anode voltage
+     * @param vg1 The grid voltage
+     * @param vg2 For pentodes only, the screen grid voltage
+     * @param dIaDva Receives the derivative of the anode current w.r.t. va
+     * @param dIaDvg1 Receives the derivative of the anode current w.r.t. vg1
+     * @return The anode current in mA
+     *
+     * The models override this with analytic derivatives; the default uses central differences.
+     */
+    virtual double anodeCurrentGradient(double va, double vg1, double vg2, double *dIaDva, double *dIaDvg1);
+    /**
+     * @brief screenCurrent calculates the modelled screen current
+     * @param va The anode voltage
+     * @param vg1 The grid voltage
+     * @param vg2 The screen grid voltage
+     * @return The screen current in mA, which is 0 for triodes
+     */
+    virtual double screenCurrent(double va, double vg1, double vg2);
+    virtual void screenCurrents(const double *va, const double *vg1, const double *vg2, double *ig2, int count);
+    virtual double anodeVoltage(double ia, double vg1, double vg2 = 0.0, double vaGuess = 0.0);
+    void anodeVoltages(const double *ia, const double *vg1, const double *vg2, double *va, int count);
+    double solveAnodeVoltage(double ia, double vg1, double vg2 = 0.0, double vaGuess = 0.0);
+    double gridVoltage(double ia, double va, double vg2 = 0.0, double vg1Guess = 0.0);
     virtual QString getName() = 0;
+    /**
+     * @brief getType
+     * @return The eModelType of this model
+     */
+    virtual int getType() = 0;
 
-    void solve();
+    FitResult solve();
+    FitResult solveIncremental(int maxIterations = 10);
+    MultiStartResult solveMultiStart(const MultiStartOptions &multiStartOptions = MultiStartOptions());
+
+    /**
+     * @brief setSampleWindow bounds the number of samples held in the problem
+     * @param newSampleWindow The maximum number of samples, or 0 for no limit
+     *
+     * When the window is exceeded the oldest residual blocks (whole batches when batching) are removed
+     * from the problem so that a long tracer session does not grow without bound.
+     */
+    void setSampleWindow(int newSampleWindow);
+    int getSampleWindow() const;
+    int getSampleCount() const;
+    void resetSamples();
+
+    /**
+     * @brief setThreadCount sets the number of threads Ceres may use within a single solve
+     * @param newThreadCount The number of threads
+     */
+    void setThreadCount(int newThreadCount);
+    int getThreadCount() const;
+
+    /**
+     * @brief setIterationHook sets a function to be called at the end of every solver iteration
+     * @param newIterationHook The hook, or an empty function to remove it
+     */
+    void setIterationHook(const IterationHook &newIterationHook);
+    /**
+     * @brief setCancelFlag sets a flag that cancels the fit when it becomes true
+     * @param newCancelFlag The flag (checked at the end of every iteration), or nullptr for none
+     *
+     * A cancelled fit is abandoned and its result is not usable.
+     */
+    void setCancelFlag(const std::atomic<bool> *newCancelFlag);
+    /**
+     * @brief setDeadline sets a time by which fits must finish
+     * @param newDeadline The deadline (checked at the end of every iteration)
+     *
+     * A fit that reaches its deadline stops with the best solution found so far.
+     */
+    void setDeadline(const QDeadlineTimer &newDeadline);
+
+    /**
+     * @brief setSolverConfiguration overrides the linear solver and trust region strategy of setOptions
+     * @param newSolverConfiguration The configuration to use for subsequent fits
+     */
+    void setSolverConfiguration(const SolverConfiguration &newSolverConfiguration);
+    void clearSolverConfiguration();
+    /**
+     * @brief setAutoTune enables the choice of solver configuration by SolverTuner
+     * @param newAutoTune If true, each fit uses the configuration SolverTuner finds fastest for this
+     * model type and number of samples (tuning on a subsample first if no choice has been cached)
+     */
+    void setAutoTune(bool newAutoTune);
+
+    void seedFrom(Model *source);
+    double compareJacobians(double va, double ia, double vg1, double vg2 = 0.0, double ig2 = NAN);
+    QVector<double> getParameterValues() const;
+    void setParameterValues(const QVector<double> &values);
+
+    /**
+     * @brief setJacobianType selects analytic or automatic differentiation for subsequent samples
+     * @param newJacobianType One of eJacobianType
+     *
+     * The choice is made as each sample is added so this should be set before any samples are added.
+     */
+    void setJacobianType(int newJacobianType);
+    int getJacobianType() const;
+
+    /**
+     * @brief setBatchSize sets the maximum number of samples packed into one residual block
+     * @param newBatchSize The batch size, where 1 gives one residual block per sample
+     *
+     * Batching applies to the analytic cost functions only. The automatic differentiation reference
+     * mode always uses one residual block per sample.
+     */
+    void setBatchSize(int newBatchSize);
+    int getBatchSize() const;
+
+    /**
+     * @brief setInverseTable answers anodeVoltage from an AnodeVoltageTable where possible
+     * @param iaMax The largest anode current in the table, in mA
+     * @param vg1Max The magnitude of the most negative grid voltage in the table
+     * @param maxError The largest acceptable error in the anode voltage, in V
+     *
+     * Only the ranges are recorded here. The table is built on the first query after the parameters
+     * have been fitted (or loaded by fromJson), or by updateInverseTable(), and never from the default
+     * parameters. Any other change to the parameters makes it stale until the next fit or
+     * updateInverseTable(), and queries are solved directly while it is stale or outside the table.
+     */
+    void setInverseTable(double iaMax, double vg1Max, double maxError = 0.01);
+    void clearInverseTable();
+    void invalidateInverseTable();
+    void updateInverseTable();
+    AnodeVoltageTable *inverseTable();
 
  protected:
     /**
      * @brief problem The Ceres Problem used for model fitting
      */
-	Problem problem;
+	Problem *problem;
     /**
-     * @brief parameter The array of 8 model Parameters linked to the UI
+     * @brief parameter The array of model Parameters linked to the UI
      */
-	Parameter *parameter[8];
+	Parameter *parameter[MODEL_PARAMETERS] = {};
     /**
      * @brief options The options to be used by Ceres for solving the model approximation
      */
     Solver::Options options;
+    /**
+     * @brief jacobianType How the residual blocks compute their derivatives (see eJacobianType)
+     */
+    int jacobianType = JACOBIAN_ANALYTIC;
+    /**
+     * @brief batchSize The maximum number of samples in a batched residual block
+     */
+    int batchSize = 256;
+    /**
+     * @brief threadCount The number of threads used by Ceres within solve()
+     */
+    int threadCount = 1;
+    /**
+     * @brief iterationHook Called at the end of every solver iteration, if set
+     */
+    IterationHook iterationHook;
+    /**
+     * @brief cancelFlag Cancels the fit in progress when it becomes true
+     */
+    const std::atomic<bool> *cancelFlag = nullptr;
+    QDeadlineTimer deadline = QDeadlineTimer(QDeadlineTimer::Forever);
+    /**
+     * @brief solverConfiguration Overrides the solver choice of setOptions if hasSolverConfiguration is set
+     */
+    SolverConfiguration solverConfiguration;
+    bool hasSolverConfiguration = false;
+    bool autoTune = false;
+    /**
+     * @brief voltageTable The inverse table used by anodeVoltage, or nullptr for none
+     */
+    AnodeVoltageTable *voltageTable = nullptr;
+    double inverseIaMax = 0.0;
+    double inverseVg1Max = 0.0;
+    double inverseMaxError = 0.0;
+    /**
+     * @brief inverseTableCurrent true if voltageTable was built from the current parameters
+     */
+    bool inverseTableCurrent = false;
+    /**
+     * @brief inverseTablePending true if the current parameters were fitted or loaded, so that the
+     * next query builds voltageTable from them
+     */
+    bool inverseTablePending = false;
+
+    void scheduleInverseTable();
+    /**
+     * @brief samples The measured samples, read directly by the batched cost functions
+     */
+    SampleStore samples;
+    /**
+     * @brief pendingBegin The index of the first sample in samples yet to be added to the problem
+     */
+    qint64 pendingBegin = 0;
+    /**
+     * @brief residualBlocks The residual blocks in the problem, oldest first, with their sample counts
+     */
+    QList<QPair<ResidualBlockId, int>> residualBlocks;
+    /**
+     * @brief sampleCount The number of samples in the problem (excluding pending samples)
+     */
+    int sampleCount = 0;
+    /**
+     * @brief sampleWindow The maximum number of samples to hold in the problem, or 0 for no limit
+     */
+    int sampleWindow = 0;
 
     void setLowerBound(Parameter* parameter, double lowerBound);
     void setUpperBound(Parameter* parameter, double upperBound);
     void setLimits(Parameter* parameter, double lowerBound, double upperBound);
+    void parameterBounds(QVector<double> &lower, QVector<double> &upper);
+    QVector<QVector<double>> drawSeeds(const MultiStartOptions &multiStartOptions);
     virtual void setOptions() = 0;
-    double korenCurrent(double va, double vg, double kp, double kvb, double a, double mu);
-    double improvedKorenCurrent(double va, double vg, double kp, double kvb, double kvb2, double vct, double a, double mu);
+    void flushSamples();
+    void addResidualBlock(CostFunction *costFunction, int samples);
+    void trimToWindow();
+    void clampToBounds();
+    void measureRms(FitResult *result);
+    FitResult fit(int maxIterations);
+
+    /**
+     * @brief createCostFunction creates the cost function for a single sample
+     * @param ig2 For pentodes only, the screen current in mA, or NAN if it was not measured
+     * @return An analytic or automatic differentiation cost function according to jacobianType
+     */
+    virtual CostFunction *createCostFunction(double va, double ia, double vg1, double vg2, double ig2) = 0;
+    /**
+     * @brief createBatchCostFunction creates an analytic cost function for a range of samples
+     * @param begin The index in samples of the first sample in the batch
+     * @param count The number of samples in the batch
+     */
+    virtual CostFunction *createBatchCostFunction(qint64 begin, int count) = 0;
+    /**
+     * @brief parameterBlocks
+     * @return The model parameter blocks in the order expected by the model's cost functions
+     */
+    virtual std::vector<double *> parameterBlocks() = 0;
 };
 
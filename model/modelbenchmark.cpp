@@ -0,0 +1,379 @@
+#include "modelbenchmark.h"
+#include "modelfactory.h"
+#include "anodetable.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#define BENCHMARK_CURVES 10
+
+/**
+ * @brief BENCHMARK_SCREENS The number of screen voltages in a synthetic pentode dataset
+ */
+#define BENCHMARK_SCREENS 3
+
+/**
+ * @brief ModelBenchmark::knownParameters
+ * @param modelType The eModelType of the model
+ * @return Typical 12AX7 (or, for the pentodes, EL34) parameters for that model in the parameter slots
+ * (0 for unused slots)
+ *
+ * The values differ from the model defaults so that the fit has to move every parameter.
+ */
+QVector<double> ModelBenchmark::knownParameters(int modelType)
+{
+    QVector<double> values(MODEL_PARAMETERS, 0.0);
+
+    switch (modelType) {
+    case SIMPLE_TRIODE:
+        values[TRI_KG] = 0.9;
+        values[TRI_VCT] = 0.25;
+        values[TRI_ALPHA] = 1.4;
+        values[TRI_MU] = 95.0;
+        break;
+    case KOREN_TRIODE:
+        values[TRI_KG] = 1.06;
+        values[TRI_KP] = 600.0;
+        values[TRI_KVB] = 300.0;
+        values[TRI_ALPHA] = 1.4;
+        values[TRI_MU] = 95.0;
+        break;
+    case IMPROVED_KOREN_TRIODE:
+        values[TRI_KG] = 1.06;
+        values[TRI_KP] = 600.0;
+        values[TRI_KVB] = 300.0;
+        values[TRI_KVB2] = 20.0;
+        values[TRI_VCT] = 0.2;
+        values[TRI_ALPHA] = 1.4;
+        values[TRI_MU] = 95.0;
+        break;
+    case KOREN_PENTODE:
+        values[PENT_KG1] = 0.7;
+        values[PENT_KP] = 50.0;
+        values[PENT_KVB] = 20.0;
+        values[PENT_ALPHA] = 1.3;
+        values[PENT_MU] = 10.0;
+        values[PENT_KG2] = 4.5;
+        break;
+    case DERK_PENTODE:
+    case DERKE_PENTODE:
+        values[PENT_KG1] = 0.7;
+        values[PENT_KP] = 50.0;
+        values[PENT_ALPHA] = 1.3;
+        values[PENT_MU] = 10.0;
+        values[PENT_KG2] = 4.5;
+        values[PENT_A] = 0.0004;
+        values[PENT_ALPHA_S] = 5.4;
+        values[PENT_BETA] = 0.05;
+        break;
+    default:
+        break;
+    }
+
+    return values;
+}
+
+/**
+ * @brief ModelBenchmark::generate creates a synthetic set of anode curves
+ * @param reference The model (with known parameters) that generates the anode current
+ * @param samples The total number of samples
+ * @param vaMax The maximum anode voltage
+ * @param vg1Max The magnitude of the most negative grid voltage
+ * @return BENCHMARK_CURVES curves from vg1 = 0 to vg1 = -vg1Max, each of samples / BENCHMARK_CURVES
+ * points evenly spaced in anode voltage
+ *
+ * For a pentode the curves are repeated at BENCHMARK_SCREENS screen voltages from vaMax / 2 to vaMax
+ * (sharing the samples between them) and the screen current is recorded with the anode current.
+ */
+SampleStore ModelBenchmark::generate(Model *reference, int samples, double vaMax, double vg1Max)
+{
+    SampleStore store;
+    store.reserve(samples);
+
+    bool pentode = reference->getType() >= KOREN_PENTODE;
+    int screens = pentode ? BENCHMARK_SCREENS : 1;
+
+    int points = qMax(1, samples / (BENCHMARK_CURVES * screens));
+    for (int screen = 0; screen < screens; screen++) {
+        double vg2 = pentode ? 0.5 * vaMax * (1.0 + (double) screen / (BENCHMARK_SCREENS - 1)) : 0.0;
+        for (int curve = 0; curve < BENCHMARK_CURVES; curve++) {
+            double vg1 = -vg1Max * curve / (BENCHMARK_CURVES - 1);
+            for (int i = 1; i <= points; i++) {
+                double va = vaMax * i / points;
+                double ig2 = pentode ? reference->screenCurrent(va, vg1, vg2) : NAN;
+                store.append(va, reference->anodeCurrent(va, vg1, vg2), vg1, vg2, ig2);
+            }
+        }
+    }
+
+    return store;
+}
+
+/**
+ * @brief ModelBenchmark::run fits one model to one synthetic dataset
+ * @param modelType The eModelType of the model
+ * @param samples The size of the dataset
+ * @param tolerance The relative error allowed for each recovered parameter
+ * @return The benchmark record
+ */
+BenchmarkRecord ModelBenchmark::run(int modelType, int samples, double tolerance)
+{
+    BenchmarkRecord record;
+    record.modelType = modelType;
+
+    QVector<double> known = knownParameters(modelType);
+
+    Model *reference = ModelFactory::createModel(modelType);
+    if (reference == nullptr) {
+        return record;
+    }
+    reference->setParameterValues(known);
+    SampleStore store = generate(reference, samples, 400.0, modelType >= KOREN_PENTODE ? 20.0 : 4.0);
+    delete reference;
+
+    Model *model = ModelFactory::createModel(modelType);
+    record.modelName = model->getName();
+    record.samples = (int) store.size();
+
+    model->addSamples(store);
+    record.fit = model->solve();
+    record.processPeakMemory = peakMemory();
+
+    if (record.fit.wallTime > 0.0) {
+        record.evaluationsPerSecond = record.fit.residualEvaluations / (record.fit.wallTime / 1000.0);
+    }
+
+    QVector<double> fitted = model->getParameterValues();
+    for (int i = 0; i < known.size(); i++) {
+        if (known.at(i) != 0.0) {
+            record.parameterError = qMax(record.parameterError, std::abs(fitted.at(i) - known.at(i)) / std::abs(known.at(i)));
+        }
+    }
+    record.recovered = record.fit.usable && record.parameterError <= tolerance;
+
+    delete model;
+
+    qInfo("%s %d samples: %.1f ms, %d iterations, %.3g evaluations/s, %lld kB process peak, parameter error %.2g%s",
+          record.modelName.toLocal8Bit().constData(), record.samples, record.fit.wallTime, record.fit.iterations,
+          record.evaluationsPerSecond, record.processPeakMemory, record.parameterError, record.recovered ? "" : " NOT RECOVERED");
+
+    return record;
+}
+
+/**
+ * @brief ModelBenchmark::runAll benchmarks every triode and pentode model at each dataset size
+ * @param sizes The dataset sizes, e.g. 1000, 10000 and 100000 samples
+ * @param tolerance The relative error allowed for each recovered parameter
+ * @return The records, smallest dataset first
+ *
+ * The runs are sequential so that the timings (and peak memory) are not disturbed by each other.
+ */
+QVector<BenchmarkRecord> ModelBenchmark::runAll(const QVector<int> &sizes, double tolerance)
+{
+    QVector<BenchmarkRecord> records;
+
+    for (int i = 0; i < sizes.size(); i++) {
+        for (int modelType = SIMPLE_TRIODE; modelType <= DERKE_PENTODE; modelType++) {
+            records.append(run(modelType, sizes.at(i), tolerance));
+        }
+    }
+
+    return records;
+}
+
+/**
+ * @brief ModelBenchmark::checkJacobians compares the analytic and automatic differentiation Jacobians
+ * @param modelType The eModelType of the model
+ * @param tolerance The largest relative difference allowed
+ * @return The record, which passes if every point is within the tolerance
+ *
+ * The model is set to its known parameters and the two cost functions are evaluated over a grid of
+ * anode voltages up to 400 V and grid voltages from 0 to -4 V, including points beyond cut-off. Each
+ * sample's current is 5% above the model's own so that the residual is not zero.
+ *
+ * Only the triode models are checked. The pentode cost functions use automatic differentiation in
+ * both Jacobian modes, so comparing them would always pass without checking anything.
+ */
+JacobianCheckRecord ModelBenchmark::checkJacobians(int modelType, double tolerance)
+{
+    JacobianCheckRecord record;
+    record.modelType = modelType;
+
+    if (modelType < SIMPLE_TRIODE || modelType > IMPROVED_KOREN_TRIODE) {
+        qWarning("Model type %d has no analytic Jacobian to check", modelType);
+        return record;
+    }
+
+    Model *model = ModelFactory::createModel(modelType);
+    if (model == nullptr) {
+        return record;
+    }
+    model->setParameterValues(knownParameters(modelType));
+    record.modelName = model->getName();
+
+    const int vaPoints = 40;
+    const int vgPoints = 41;
+    for (int i = 0; i < vaPoints; i++) {
+        double va = 400.0 * (i + 1) / vaPoints;
+        for (int j = 0; j < vgPoints; j++) {
+            double vg1 = -4.0 * j / (vgPoints - 1);
+            double ia = 1.05 * model->anodeCurrent(va, vg1) + 0.01;
+
+            double error = model->compareJacobians(va, ia, vg1);
+            if (!(error <= record.maxError)) {
+                record.maxError = error;
+                record.worstVa = va;
+                record.worstVg1 = vg1;
+            }
+            record.points++;
+        }
+    }
+
+    record.passed = record.maxError <= tolerance;
+
+    delete model;
+
+    return record;
+}
+
+/**
+ * @brief ModelBenchmark::writeReport writes a CSV report of a benchmark run
+ * @param records The records returned by runAll()
+ * @param fileName The file to write
+ * @return true if the report was written
+ */
+bool ModelBenchmark::writeReport(const QVector<BenchmarkRecord> &records, const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning("Unable to write %s", fileName.toLocal8Bit().constData());
+        return false;
+    }
+
+    QTextStream stream(&file);
+    stream << "model,samples,fitTime,iterations,evaluationsPerSecond,processPeakMemory,rms,screenRms,parameterError,status\n";
+
+    for (int i = 0; i < records.size(); i++) {
+        const BenchmarkRecord &record = records.at(i);
+        stream << record.modelName << ","
+               << record.samples << ","
+               << record.fit.wallTime << ","
+               << record.fit.iterations << ","
+               << record.evaluationsPerSecond << ","
+               << record.processPeakMemory << ","
+               << record.fit.rms << ","
+               << record.fit.screenRms << ","
+               << record.parameterError << ","
+               << (record.recovered ? "ok" : "not recovered") << "\n";
+    }
+
+    return true;
+}
+
+/**
+ * @brief ModelBenchmark::peakMemory
+ * @return The peak resident memory of the process in kB, or 0 where this is not available
+ *
+ * This is a high water mark for the whole process, so it never decreases from one run to the next.
+ */
+qint64 ModelBenchmark::peakMemory()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MACOS
+        return usage.ru_maxrss / 1024; // Reported in bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief ModelBenchmark::runTable builds an AnodeTable from a model with known parameters and times it
+ * @param modelType The eModelType of the model
+ * @param targetError The error bound for the table in mA
+ * @param interpolation One of eTableInterpolation
+ * @param lookups The number of random points at which to time the table and the model
+ * @return The benchmark record
+ */
+TableBenchmarkRecord ModelBenchmark::runTable(int modelType, double targetError, int interpolation, int lookups)
+{
+    TableBenchmarkRecord record;
+    record.interpolation = interpolation;
+    record.targetError = targetError;
+
+    Model *model = ModelFactory::createModel(modelType);
+    if (model == nullptr) {
+        return record;
+    }
+    model->setParameterValues(knownParameters(modelType));
+
+    const double vaMax = 400.0;
+    const double vg1Max = 4.0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    AnodeTable table;
+    table.build(model, vaMax, vg1Max, targetError, interpolation);
+    record.buildTime = timer.nsecsElapsed() / 1.0e6;
+
+    record.vaCount = table.getVaCount();
+    record.vgCount = table.getVgCount();
+    record.memorySize = table.getMemorySize();
+    record.maxError = table.measureError(model, &record.rmsError);
+
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<double> vaDistribution(0.0, vaMax);
+    std::uniform_real_distribution<double> vgDistribution(-vg1Max, 0.0);
+
+    std::vector<double> va(lookups);
+    std::vector<double> vg(lookups);
+    std::vector<double> ia(lookups);
+    for (int i = 0; i < lookups; i++) {
+        va[i] = vaDistribution(generator);
+        vg[i] = vgDistribution(generator);
+    }
+
+    std::fill(ia.begin(), ia.end(), 0.0);
+
+    timer.restart();
+    table.anodeCurrents(va.data(), vg.data(), ia.data(), lookups);
+    double tableTime = timer.nsecsElapsed() / 1.0e9;
+
+    timer.restart();
+    for (int i = 0; i < lookups; i++) {
+        ia[i] = model->anodeCurrent(va[i], vg[i]);
+    }
+    double modelTime = timer.nsecsElapsed() / 1.0e9;
+
+    timer.restart();
+    model->anodeCurrents(va.data(), vg.data(), nullptr, ia.data(), lookups);
+    double batchTime = timer.nsecsElapsed() / 1.0e9;
+
+    record.lookupsPerSecond = tableTime > 0.0 ? lookups / tableTime : 0.0;
+    record.evaluationsPerSecond = modelTime > 0.0 ? lookups / modelTime : 0.0;
+    record.batchEvaluationsPerSecond = batchTime > 0.0 ? lookups / batchTime : 0.0;
+
+    qInfo("%s table (%s) for %g mA: %d x %d nodes, %lld kB, built in %.1f ms, %.3g lookups/s (model %.3g/s, batch %.3g/s), max error %.3g mA, rms %.3g mA",
+          model->getName().toLocal8Bit().constData(), interpolation == TABLE_CUBIC ? "cubic" : "monotone", targetError,
+          record.vaCount, record.vgCount, record.memorySize / 1024, record.buildTime, record.lookupsPerSecond,
+          record.evaluationsPerSecond, record.batchEvaluationsPerSecond, record.maxError, record.rmsError);
+
+    delete model;
+
+    return record;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+#include "model.h"
+#include "samplestore.h"
+#include "fitresult.h"
+
+/**
+ * @brief The BenchmarkRecord struct
+ *
+ * The outcome of fitting one model to one synthetic dataset.
+ */
+struct BenchmarkRecord {
+    QString modelName;
+    int modelType = -1;
+    /**
+     * @brief samples The number of samples in the dataset
+     */
+    int samples = 0;
+    FitResult fit;
+    /**
+     * @brief evaluationsPerSecond Per sample residual evaluations per second of fit time
+     */
+    double evaluationsPerSecond = 0.0;
+    /**
+     * @brief processPeakMemory The peak resident memory of the process in kB after the fit
+     *
+     * This is the cumulative high water mark of the whole process (including any earlier runs), not
+     * the memory used by this fit alone.
+     */
+    qint64 processPeakMemory = 0;
+    /**
+     * @brief parameterError The largest relative error of a fitted parameter against its known value
+     */
+    double parameterError = 0.0;
+    /**
+     * @brief recovered True if the fit was usable and parameterError is within the tolerance
+     */
+    bool recovered = false;
+};
+
+/**
+ * @brief The TableBenchmarkRecord struct
+ *
+ * The outcome of building and timing one AnodeTable.
+ */
+struct TableBenchmarkRecord {
+    int interpolation = 0;
+    /**
+     * @brief targetError The error bound requested when the table was built, in mA
+     */
+    double targetError = 0.0;
+    int vaCount = 0;
+    int vgCount = 0;
+    qint64 memorySize = 0;
+    /**
+     * @brief buildTime The time taken to build the table in ms
+     */
+    double buildTime = 0.0;
+    double lookupsPerSecond = 0.0;
+    /**
+     * @brief evaluationsPerSecond The rate of the model's own anodeCurrent, one sample at a time, for comparison
+     */
+    double evaluationsPerSecond = 0.0;
+    /**
+     * @brief batchEvaluationsPerSecond The rate of the model's (vectorised) anodeCurrents
+     */
+    double batchEvaluationsPerSecond = 0.0;
+    /**
+     * @brief maxError The largest error against the model found by AnodeTable::measureError, in mA
+     */
+    double maxError = 0.0;
+    double rmsError = 0.0;
+};
+
+/**
+ * @brief The JacobianCheckRecord struct
+ *
+ * The outcome of comparing the analytic and automatic differentiation cost functions of one triode model.
+ */
+struct JacobianCheckRecord {
+    QString modelName;
+    int modelType = -1;
+    /**
+     * @brief points The number of (va, vg1) points compared
+     */
+    int points = 0;
+    /**
+     * @brief maxError The largest relative difference found by Model::compareJacobians
+     */
+    double maxError = 0.0;
+    double worstVa = 0.0;
+    double worstVg1 = 0.0;
+    bool passed = false;
+};
+
+/**
+ * @brief The ModelBenchmark class
+ *
+ * Measures fitting throughput and accuracy. For each model and dataset size a set of anode curves is
+ * generated from known parameters, a model with default parameters is fitted to it with Model::solve,
+ * and the time, iterations, residual evaluation rate and peak memory are recorded together with how
+ * closely the known parameters were recovered.
+ */
+class ModelBenchmark
+{
+public:
+    static QVector<double> knownParameters(int modelType);
+    static SampleStore generate(Model *reference, int samples, double vaMax = 400.0, double vg1Max = 4.0);
+    static BenchmarkRecord run(int modelType, int samples, double tolerance = 0.02);
+    static QVector<BenchmarkRecord> runAll(const QVector<int> &sizes, double tolerance = 0.02);
+    static bool writeReport(const QVector<BenchmarkRecord> &records, const QString &fileName);
+    static qint64 peakMemory();
+
+    static JacobianCheckRecord checkJacobians(int modelType, double tolerance = 1.0e-6);
+
+    static TableBenchmarkRecord runTable(int modelType, double targetError, int interpolation, int lookups = 1 << 22);
+};
@@ -10,11 +10,11 @@ Model *ModelFactory::createModel(int modelType)
     case IMPROVED_KOREN_TRIODE:
         return new ImprovedKorenTriode();
     case KOREN_PENTODE:
-        break;
+        return new KorenPentode();
     case DERK_PENTODE:
-        break;
+        return new DerkPentode();
     case DERKE_PENTODE:
-        break;
+        return new DerkEPentode();
     }
 
     return nullptr;
@@ -3,6 +3,9 @@
 #include "simpletriode.h"
 #include "korentriode.h"
 #include "improvedkorentriode.h"
+#include "korenpentode.h"
+#include "derkpentode.h"
+#include "derkepentode.h"
 
 class ModelFactory
 {
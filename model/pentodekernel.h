@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cmath>
+
+#include "triodekernel.h"
+
+/*
+ * The pentode model formulas, written once as templates in the same way as the triode formulas in
+ * triodekernel.h. Each formula returns the anode current and, optionally, the screen current from
+ * the same intermediate terms, so that the two are fitted jointly (instantiated for ceres::Jet in the
+ * cost functions) and evaluated (for double) by the same code.
+ */
+
+/**
+ * @brief The KorenPentodeParameters struct
+ */
+template <typename T> struct KorenPentodeParameters {
+    T kg1;
+    T kp;
+    T kvb;
+    T alpha;
+    T mu;
+    T kg2;
+};
+
+/**
+ * @brief The DerkPentodeParameters struct
+ *
+ * The parameters of the Derk and DerkE models, which differ only in the form of the screen current's
+ * dependence on the anode voltage.
+ */
+template <typename T> struct DerkPentodeParameters {
+    T kg1;
+    T kp;
+    T alpha;
+    T mu;
+    T kg2;
+    T a;
+    T alphaS;
+    T beta;
+};
+
+/**
+ * @brief pentodeEffectiveVoltage
+ * @param kp The Koren Kp parameter
+ * @param mu The screen to grid amplification factor
+ * @param vg1 The grid voltage
+ * @param vg2 The screen grid voltage
+ * @return The effective voltage E1 = (vg2 / Kp) * softplus(Kp * (1 / mu + vg1 / vg2)), which is zero
+ * when the screen voltage is not positive
+ */
+template <typename T> inline T pentodeEffectiveVoltage(const T &kp, const T &mu, const T &vg1, const T &vg2)
+{
+    if (!(vg2 > T(0))) {
+        return T(0);
+    }
+
+    return (vg2 / kp) * softplus(kp * (T(1) / mu + vg1 / vg2));
+}
+
+/**
+ * @brief korenPentodeCurrent
+ * @param p The model parameters
+ * @param va The anode voltage
+ * @param vg1 The grid voltage
+ * @param vg2 The screen grid voltage
+ * @param ig2 If not NULL, receives the screen current in mA
+ * @return The anode current in mA
+ *
+ * The anode current is E1^alpha / Kg1 * atan(va / Kvb) and the screen current is Koren's
+ * (vg1 + vg2 / mu)^1.5 / Kg2, so that mu is shared by the two currents.
+ */
+template <typename T> inline T korenPentodeCurrent(const KorenPentodeParameters<T> &p, const T &va, const T &vg1, const T &vg2, T *ig2 = nullptr)
+{
+    using std::atan;
+    using std::pow;
+
+    if (ig2 != nullptr) {
+        T es = vg1 + vg2 / p.mu;
+        *ig2 = es > T(0) ? T(pow(es, T(1.5)) / p.kg2) : T(0);
+    }
+
+    T e1 = pentodeEffectiveVoltage(p.kp, p.mu, vg1, vg2);
+    if (e1 > T(0)) {
+        return pow(e1, p.alpha) / p.kg1 * atan(va / p.kvb);
+    }
+
+    return T(0);
+}
+
+/**
+ * @brief derkPentodeCurrent
+ * @param p The model parameters
+ * @param va The anode voltage
+ * @param vg1 The grid voltage
+ * @param vg2 The screen grid voltage
+ * @param recovery The fraction of the cathode current diverted to the screen at low anode voltage,
+ * 1 / (1 + beta * va) for the Derk model or exp(-(beta * va)^1.5) for the DerkE model
+ * @param ig2 If not NULL, receives the screen current in mA
+ * @return The anode current in mA
+ *
+ * Both currents are shares of the cathode current Ik = E1^alpha:
+ * ia = Ik * (1 / Kg1 - 1 / Kg2 + A * va / Kg1 - alphaS * recovery / Kg2) and
+ * ig2 = Ik / Kg2 * (1 + alphaS * recovery).
+ */
+template <typename T> inline T derkPentodeCurrent(const DerkPentodeParameters<T> &p, const T &va, const T &vg1, const T &vg2, const T &recovery, T *ig2 = nullptr)
+{
+    using std::pow;
+
+    T e1 = pentodeEffectiveVoltage(p.kp, p.mu, vg1, vg2);
+    T ik = e1 > T(0) ? T(pow(e1, p.alpha)) : T(0);
+
+    if (ig2 != nullptr) {
+        *ig2 = ik / p.kg2 * (T(1) + p.alphaS * recovery);
+    }
+
+    return ik * (T(1) / p.kg1 - T(1) / p.kg2 + p.a * va / p.kg1 - p.alphaS * recovery / p.kg2);
+}
+
+/**
+ * @brief derkRecovery
+ * @return The screen current recovery term of the Derk model, 1 / (1 + beta * va)
+ */
+template <typename T> inline T derkRecovery(const T &beta, const T &va)
+{
+    return T(1) / (T(1) + beta * va);
+}
+
+/**
+ * @brief derkERecovery
+ * @return The screen current recovery term of the DerkE model, exp(-(beta * va)^1.5), which is 1 for
+ * va <= 0
+ */
+template <typename T> inline T derkERecovery(const T &beta, const T &va)
+{
+    using std::exp;
+    using std::pow;
+
+    T x = beta * va;
+    if (x > T(0)) {
+        return exp(-pow(x, T(1.5)));
+    }
+
+    return T(1);
+}
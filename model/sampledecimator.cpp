@@ -0,0 +1,225 @@
+#include "sampledecimator.h"
+#include "modelfactory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+/**
+ * @brief SampleDecimator::deduplicate merges samples measured at the same voltages
+ * @param source The samples
+ * @param voltageResolution Voltages that round to the same multiple of this are treated as equal
+ * @return The unique samples in order of first occurrence, with the anode and screen currents of each
+ * averaged
+ */
+SampleStore SampleDecimator::deduplicate(const SampleStore &source, double voltageResolution)
+{
+    typedef std::tuple<qint64, qint64, qint64> Key;
+
+    std::map<Key, int> index;
+    std::vector<qint64> firstSample;
+    std::vector<double> iaSum;
+    std::vector<double> ig2Sum;
+    std::vector<int> iaCount;
+
+    for (qint64 i = source.first(); i < source.end(); i++) {
+        Key key(std::llround(*source.va(i) / voltageResolution),
+                std::llround(*source.vg1(i) / voltageResolution),
+                std::llround(*source.vg2(i) / voltageResolution));
+
+        std::map<Key, int>::iterator found = index.find(key);
+        if (found == index.end()) {
+            index[key] = (int) firstSample.size();
+            firstSample.push_back(i);
+            iaSum.push_back(*source.ia(i));
+            ig2Sum.push_back(*source.ig2(i));
+            iaCount.push_back(1);
+        } else {
+            iaSum[found->second] += *source.ia(i);
+            ig2Sum[found->second] += *source.ig2(i);
+            iaCount[found->second]++;
+        }
+    }
+
+    SampleStore unique;
+    unique.reserve(firstSample.size());
+    for (size_t j = 0; j < firstSample.size(); j++) {
+        qint64 i = firstSample[j];
+        unique.append(*source.va(i), iaSum[j] / iaCount[j], *source.vg1(i), *source.vg2(i), ig2Sum[j] / iaCount[j]);
+    }
+
+    return unique;
+}
+
+/**
+ * @brief SampleDecimator::decimate thins each grid voltage curve
+ * @param source The samples, with each curve (a run of samples with the same grid voltages) contiguous
+ * @param currentTolerance The maximum error in mA when a dropped sample is interpolated from those kept
+ * @return The retained samples, each curve sorted by anode voltage
+ */
+SampleStore SampleDecimator::decimate(const SampleStore &source, double currentTolerance)
+{
+    SampleStore result;
+
+    qint64 curveBegin = source.first();
+    while (curveBegin < source.end()) {
+        qint64 curveEnd = curveBegin + 1;
+        while (curveEnd < source.end() && *source.vg1(curveEnd) == *source.vg1(curveBegin) && *source.vg2(curveEnd) == *source.vg2(curveBegin)) {
+            curveEnd++;
+        }
+
+        std::vector<qint64> order;
+        for (qint64 i = curveBegin; i < curveEnd; i++) {
+            order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&source](qint64 a, qint64 b) {
+            return *source.va(a) < *source.va(b);
+        });
+
+        int n = (int) order.size();
+        std::vector<bool> keep(n, false);
+        keep[0] = true;
+        keep[n - 1] = true;
+
+        std::vector<std::pair<int, int>> segments; // Iterative Ramer-Douglas-Peucker
+        if (n > 2) {
+            segments.push_back(std::make_pair(0, n - 1));
+        }
+
+        while (!segments.empty()) {
+            int a = segments.back().first;
+            int b = segments.back().second;
+            segments.pop_back();
+
+            double vaA = *source.va(order[a]);
+            double iaA = *source.ia(order[a]);
+            double vaB = *source.va(order[b]);
+            double iaB = *source.ia(order[b]);
+
+            int worst = -1;
+            double worstError = currentTolerance;
+            for (int k = a + 1; k < b; k++) {
+                double fraction = (vaB > vaA) ? (*source.va(order[k]) - vaA) / (vaB - vaA) : double(k - a) / (b - a);
+                double error = std::abs(*source.ia(order[k]) - (iaA + fraction * (iaB - iaA)));
+                if (error > worstError) {
+                    worstError = error;
+                    worst = k;
+                }
+            }
+
+            if (worst >= 0) {
+                keep[worst] = true;
+                if (worst - a > 1) {
+                    segments.push_back(std::make_pair(a, worst));
+                }
+                if (b - worst > 1) {
+                    segments.push_back(std::make_pair(worst, b));
+                }
+            }
+        }
+
+        for (int k = 0; k < n; k++) {
+            if (keep[k]) {
+                qint64 i = order[k];
+                result.append(*source.va(i), *source.ia(i), *source.vg1(i), *source.vg2(i), *source.ig2(i));
+            }
+        }
+
+        curveBegin = curveEnd;
+    }
+
+    return result;
+}
+
+/**
+ * @brief SampleDecimator::fit fits a model to a decimated copy of the samples
+ * @param model The model to fit. Its samples are replaced by the decimated samples.
+ * @param source The full set of samples
+ * @param options The decimation options
+ * @return A report of the decimation, the verification and, optionally, the speedup
+ *
+ * After fitting the decimated samples, the fit is verified (if options.verify is set) by warm
+ * starting a fit of the same model type to the full data from the decimated fit. If any parameter
+ * moves by more than options.parameterTolerance (relative), the current tolerance is halved and the
+ * decimated fit repeated, up to options.maxRounds times. The report records whether the guarantee
+ * was met.
+ */
+DecimationReport SampleDecimator::fit(Model *model, const SampleStore &source, const DecimationOptions &options)
+{
+    DecimationReport report;
+    report.originalSamples = source.size();
+
+    SampleStore unique = deduplicate(source, options.voltageResolution);
+    report.uniqueSamples = unique.size();
+
+    QVector<double> start = model->getParameterValues();
+    double tolerance = options.currentTolerance;
+
+    for (int round = 1; round <= options.maxRounds; round++) {
+        report.rounds = round;
+        report.currentTolerance = tolerance;
+
+        SampleStore reduced = decimate(unique, tolerance);
+        report.decimatedSamples = reduced.size();
+
+        model->resetSamples();
+        model->setParameterValues(start);
+        model->addSamples(reduced);
+        report.decimatedFit = model->solve();
+
+        if (!options.verify) {
+            break;
+        }
+
+        Model *reference = ModelFactory::createModel(model->getType());
+        reference->setParameterValues(model->getParameterValues());
+        reference->addSamples(source);
+        report.verificationFit = reference->solveIncremental(options.verifyIterations);
+        report.parameterDeviation = parameterDeviation(model->getParameterValues(), reference->getParameterValues());
+        delete reference;
+
+        if (report.parameterDeviation <= options.parameterTolerance) {
+            report.withinTolerance = true;
+            break;
+        }
+
+        tolerance /= 2.0;
+    }
+
+    if (options.compareFullFit) {
+        Model *full = ModelFactory::createModel(model->getType());
+        full->setParameterValues(start);
+        full->addSamples(source);
+        report.fullFit = full->solve();
+        delete full;
+
+        if (report.decimatedFit.wallTime > 0.0) {
+            report.speedup = report.fullFit.wallTime / report.decimatedFit.wallTime;
+        }
+    }
+
+    qInfo("Decimated %lld samples to %lld (%lld unique), parameter deviation %.4f",
+          report.originalSamples, report.decimatedSamples, report.uniqueSamples, report.parameterDeviation);
+
+    return report;
+}
+
+/**
+ * @brief SampleDecimator::parameterDeviation
+ * @return The largest relative difference between corresponding parameter values
+ */
+double SampleDecimator::parameterDeviation(const QVector<double> &a, const QVector<double> &b)
+{
+    double deviation = 0.0;
+
+    for (int i = 0; i < a.size() && i < b.size(); i++) {
+        double scale = qMax(std::abs(a.at(i)), std::abs(b.at(i)));
+        if (scale > 0.0) {
+            deviation = qMax(deviation, std::abs(a.at(i) - b.at(i)) / scale);
+        }
+    }
+
+    return deviation;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <QVector>
+
+#include "model.h"
+#include "samplestore.h"
+#include "fitresult.h"
+
+/**
+ * @brief The DecimationOptions struct
+ *
+ * Controls SampleDecimator::fit.
+ */
+struct DecimationOptions {
+    /**
+     * @brief voltageResolution Samples whose voltages agree to within this resolution are duplicates
+     */
+    double voltageResolution = 0.01;
+    /**
+     * @brief currentTolerance The initial maximum error (in mA) of linear interpolation over dropped samples
+     */
+    double currentTolerance = 0.02;
+    /**
+     * @brief parameterTolerance The maximum relative difference between decimated and full data parameters
+     */
+    double parameterTolerance = 0.01;
+    /**
+     * @brief maxRounds The number of times the current tolerance may be halved to meet parameterTolerance
+     */
+    int maxRounds = 4;
+    /**
+     * @brief verifyIterations The iteration budget of the warm started full data fit used for verification
+     */
+    int verifyIterations = 20;
+    /**
+     * @brief verify If true, the decimated fit is checked against a fit to the full data
+     */
+    bool verify = true;
+    /**
+     * @brief compareFullFit If true, the full data is also fitted from the starting parameters to measure the speedup
+     */
+    bool compareFullFit = false;
+};
+
+/**
+ * @brief The DecimationReport struct
+ *
+ * The outcome of SampleDecimator::fit.
+ */
+struct DecimationReport {
+    qint64 originalSamples = 0;
+    qint64 uniqueSamples = 0;
+    qint64 decimatedSamples = 0;
+    /**
+     * @brief currentTolerance The current tolerance used for the final decimation
+     */
+    double currentTolerance = 0.0;
+    /**
+     * @brief parameterDeviation The largest relative difference between decimated and full data parameters
+     */
+    double parameterDeviation = 0.0;
+    /**
+     * @brief withinTolerance True if the deviation was verified to be within the parameter tolerance
+     */
+    bool withinTolerance = false;
+    int rounds = 0;
+    FitResult decimatedFit;
+    FitResult verificationFit;
+    FitResult fullFit;
+    /**
+     * @brief speedup The full data fit time divided by the decimated fit time (if compareFullFit was set)
+     */
+    double speedup = 0.0;
+};
+
+/**
+ * @brief The SampleDecimator class
+ *
+ * Reduces an oversampled measurement before fitting. Duplicate samples are merged and then each grid
+ * voltage curve is thinned with a Ramer-Douglas-Peucker simplification in (va, ia), which keeps samples
+ * where the curve bends (near cut-off and at the knee) and drops them where it is nearly straight.
+ */
+class SampleDecimator
+{
+public:
+    static SampleStore deduplicate(const SampleStore &source, double voltageResolution);
+    static SampleStore decimate(const SampleStore &source, double currentTolerance);
+    static DecimationReport fit(Model *model, const SampleStore &source, const DecimationOptions &options = DecimationOptions());
+
+private:
+    static double parameterDeviation(const QVector<double> &a, const QVector<double> &b);
+};
@@ -0,0 +1,89 @@
+#include "samplestore.h"
+
+SampleStore::SampleStore()
+{
+
+}
+
+void SampleStore::append(double va, double ia, double vg1, double vg2, double ig2)
+{
+    vaValues.push_back(va);
+    iaValues.push_back(ia);
+    vg1Values.push_back(vg1);
+    vg2Values.push_back(vg2);
+    ig2Values.push_back(ig2);
+
+    endIndex++;
+}
+
+/**
+ * @brief SampleStore::append appends all of the samples held by another store
+ * @param source The store to copy from
+ */
+void SampleStore::append(const SampleStore &source)
+{
+    qint64 count = source.size();
+    if (count == 0) {
+        return;
+    }
+
+    reserve(size() + count);
+
+    vaValues.insert(vaValues.end(), source.va(source.first()), source.va(source.first()) + count);
+    iaValues.insert(iaValues.end(), source.ia(source.first()), source.ia(source.first()) + count);
+    vg1Values.insert(vg1Values.end(), source.vg1(source.first()), source.vg1(source.first()) + count);
+    vg2Values.insert(vg2Values.end(), source.vg2(source.first()), source.vg2(source.first()) + count);
+    ig2Values.insert(ig2Values.end(), source.ig2(source.first()), source.ig2(source.first()) + count);
+
+    endIndex += count;
+}
+
+void SampleStore::reserve(qint64 count)
+{
+    qint64 capacity = count + (firstIndex - baseIndex);
+
+    vaValues.reserve(capacity);
+    iaValues.reserve(capacity);
+    vg1Values.reserve(capacity);
+    vg2Values.reserve(capacity);
+    ig2Values.reserve(capacity);
+}
+
+/**
+ * @brief SampleStore::clear discards all samples and restarts the absolute indexes from 0
+ */
+void SampleStore::clear()
+{
+    vaValues.clear();
+    iaValues.clear();
+    vg1Values.clear();
+    vg2Values.clear();
+    ig2Values.clear();
+
+    baseIndex = 0;
+    firstIndex = 0;
+    endIndex = 0;
+}
+
+/**
+ * @brief SampleStore::discardFront discards the oldest samples
+ * @param count The number of samples to discard
+ *
+ * The indexes of the remaining samples are unchanged. The storage is compacted once the discarded
+ * samples make up more than half of it, so the cost of discarding is amortised.
+ */
+void SampleStore::discardFront(qint64 count)
+{
+    firstIndex += qMin(count, size());
+
+    qint64 discarded = firstIndex - baseIndex;
+    if (discarded > (qint64) vaValues.size() / 2) {
+        vaValues.erase(vaValues.begin(), vaValues.begin() + discarded);
+        iaValues.erase(iaValues.begin(), iaValues.begin() + discarded);
+        vg1Values.erase(vg1Values.begin(), vg1Values.begin() + discarded);
+        vg2Values.erase(vg2Values.begin(), vg2Values.begin() + discarded);
+        ig2Values.erase(ig2Values.begin(), ig2Values.begin() + discarded);
+
+        baseIndex = firstIndex;
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <cmath>
+#include <vector>
+
+/**
+ * @brief The SampleStore class
+ *
+ * A structure of arrays holding measured samples (va, ia, vg1, vg2, ig2) contiguously. The store is
+ * owned by a Model and is read directly by the fitting cost functions and by plotting. The screen
+ * current ig2 is only measured for pentodes and is NAN where it was not measured.
+ *
+ * Samples are addressed by an absolute index that is stable for the life of the sample, so that a
+ * residual block can refer to a range of samples even after older samples have been discarded from
+ * the front of the store (see discardFront). Storage for discarded samples is reclaimed lazily.
+ */
+class SampleStore
+{
+public:
+    SampleStore();
+
+    void append(double va, double ia, double vg1, double vg2, double ig2 = NAN);
+    void append(const SampleStore &source);
+    void reserve(qint64 count);
+    void clear();
+    void discardFront(qint64 count);
+
+    /**
+     * @brief size
+     * @return The number of samples held
+     */
+    qint64 size() const
+    {
+        return endIndex - firstIndex;
+    }
+
+    /**
+     * @brief first
+     * @return The absolute index of the oldest sample held
+     */
+    qint64 first() const
+    {
+        return firstIndex;
+    }
+
+    /**
+     * @brief end
+     * @return The absolute index one past the newest sample held
+     */
+    qint64 end() const
+    {
+        return endIndex;
+    }
+
+    /**
+     * @brief va
+     * @param index The absolute index of a sample
+     * @return A pointer to the anode voltage of that sample; following samples are contiguous
+     */
+    const double *va(qint64 index) const
+    {
+        return vaValues.data() + (index - baseIndex);
+    }
+
+    const double *ia(qint64 index) const
+    {
+        return iaValues.data() + (index - baseIndex);
+    }
+
+    const double *vg1(qint64 index) const
+    {
+        return vg1Values.data() + (index - baseIndex);
+    }
+
+    const double *vg2(qint64 index) const
+    {
+        return vg2Values.data() + (index - baseIndex);
+    }
+
+    const double *ig2(qint64 index) const
+    {
+        return ig2Values.data() + (index - baseIndex);
+    }
+
+private:
+    std::vector<double> vaValues;
+    std::vector<double> iaValues;
+    std::vector<double> vg1Values;
+    std::vector<double> vg2Values;
+    std::vector<double> ig2Values;
+
+    /**
+     * @brief baseIndex The absolute index of element 0 of the arrays
+     */
+    qint64 baseIndex = 0;
+    qint64 firstIndex = 0;
+    qint64 endIndex = 0;
+};
@@ -5,11 +5,8 @@ struct SimpleTriodeResidual {
 
     template <typename T>
     bool operator()(const T* const kg, const T* const vct, const T* const a, const T* const mu, T* residual) const {
-        T e1t = va_ / mu[0] + vg_ + vct[0];
-        if (e1t < 0.0) {
-            e1t = mu[0] - mu[0];
-        }
-        T ia = pow(e1t, a[0]) / kg[0];
+        SimpleTriodeParameters<T> p = { kg[0], vct[0], a[0], mu[0] };
+        T ia = simpleTriodeCurrent(p, T(va_), T(vg_));
         residual[0] = ia_ - ia;
         return !(isnan(ia) || isinf(ia));
     }
@@ -20,6 +17,50 @@ private:
     const double ia_;
 };
 
+/**
+ * @brief The SimpleTriodeAnalyticResidual struct
+ *
+ * Analytic equivalent of SimpleTriodeResidual, shared by the single sample and batched cost functions.
+ * The parameters are, in order, Kg, Vct, alpha and mu.
+ */
+struct SimpleTriodeAnalyticResidual {
+    static const int parameterCount = 4;
+
+    static inline bool evaluate(const double *parameters, double va, double vg1, double vg2, double ia, double *residual, double *gradient)
+    {
+        const SimpleTriodeParameters<double> p = { parameters[0], parameters[1], parameters[2], parameters[3] };
+        const double kg = p.kg;
+        const double a = p.alpha;
+        const double mu = p.mu;
+
+        double e1t;
+        double iaModel = simpleTriodeCurrent(p, va, vg1, &e1t);
+        residual[0] = ia - iaModel;
+
+        if (std::isnan(iaModel) || std::isinf(iaModel)) {
+            return false;
+        }
+
+        if (gradient != NULL) {
+            double dIaDE1t = 0.0; // Below cut-off the current, and so every derivative, is zero
+            double logE1t = 0.0;
+            if (e1t > 0.0) {
+                dIaDE1t = a * iaModel / e1t;
+                logE1t = std::log(e1t);
+            }
+
+            gradient[0] = iaModel / kg;
+            gradient[1] = -dIaDE1t;
+            gradient[2] = -iaModel * logE1t;
+            gradient[3] = dIaDE1t * va / (mu * mu);
+        }
+
+        return true;
+    }
+};
+
+typedef AnalyticCostFunction<SimpleTriodeAnalyticResidual, 1, 1, 1, 1> SimpleTriodeCostFunction;
+
 SimpleTriode::SimpleTriode()
 {
     parameter[TRI_KG] = new Parameter("Kg:", 0.7);
@@ -28,28 +69,63 @@ SimpleTriode::SimpleTriode()
     parameter[TRI_MU] = new Parameter("Mu:", 100.0);
 }
 
-void SimpleTriode::addSample(double va, double ia, double vg1, double vg2)
+CostFunction *SimpleTriode::createCostFunction(double va, double ia, double vg1, double vg2, double ig2)
+{
+    if (jacobianType == JACOBIAN_AUTODIFF) {
+        return new AutoDiffCostFunction<SimpleTriodeResidual, 1, 1, 1, 1, 1>(
+            new SimpleTriodeResidual(va, vg1, ia));
+    }
+
+    return new SimpleTriodeCostFunction(va, ia, vg1, vg2);
+}
+
+CostFunction *SimpleTriode::createBatchCostFunction(qint64 begin, int count)
+{
+    return new BatchCostFunction<SimpleTriodeAnalyticResidual>(&samples, begin, count);
+}
+
+std::vector<double *> SimpleTriode::parameterBlocks()
 {
-    problem.AddResidualBlock(
-        new AutoDiffCostFunction<SimpleTriodeResidual, 1, 1, 1, 1, 1>(
-            new SimpleTriodeResidual(va, vg1, ia)),
-        NULL,
+    return {
         parameter[TRI_KG]->getPointer(),
         parameter[TRI_VCT]->getPointer(),
         parameter[TRI_ALPHA]->getPointer(),
-        parameter[TRI_MU]->getPointer());
+        parameter[TRI_MU]->getPointer()
+    };
 }
 
 double SimpleTriode::anodeCurrent(double va, double vg1, double vg2)
 {
-    double ia = 0.0;
+    return simpleTriodeCurrent(simpleTriodeParameters(), va, vg1);
+}
+
+void SimpleTriode::anodeCurrents(const double *va, const double *vg1, const double *vg2, double *ia, int count)
+{
+    const SimpleTriodeParameters<double> p = simpleTriodeParameters();
 
-    double e1t = va / parameter[TRI_MU]->getValue() + vg1 + parameter[TRI_VCT]->getValue();
-    if (e1t > 0) {
-        ia = pow(e1t, parameter[TRI_ALPHA]->getValue()) / parameter[TRI_KG]->getValue();
+    for (int i = 0; i < count; i++) {
+        ia[i] = simpleTriodeCurrent(p, va[i], vg1[i]);
     }
+}
 
-    return ia;
+double SimpleTriode::anodeCurrentGradient(double va, double vg1, double vg2, double *dIaDva, double *dIaDvg1)
+{
+    return simpleTriodeGradient(simpleTriodeParameters(), va, vg1, dIaDva, dIaDvg1);
+}
+
+/**
+ * @brief SimpleTriode::simpleTriodeParameters
+ * @return A snapshot of the parameters for use with simpleTriodeCurrent
+ */
+SimpleTriodeParameters<double> SimpleTriode::simpleTriodeParameters() const
+{
+    SimpleTriodeParameters<double> p;
+    p.kg = parameter[TRI_KG]->getValue();
+    p.vct = parameter[TRI_VCT]->getValue();
+    p.alpha = parameter[TRI_ALPHA]->getValue();
+    p.mu = parameter[TRI_MU]->getValue();
+
+    return p;
 }
 
 void SimpleTriode::fromJson(QJsonObject source)
@@ -69,6 +145,8 @@ void SimpleTriode::fromJson(QJsonObject source)
     if (source.contains("vct") && source["vct"].isDouble()) {
         parameter[TRI_VCT]->setValue(source["vct"].toDouble());
     }
+
+    scheduleInverseTable();
 }
 
 void SimpleTriode::toJson(QJsonObject &destination, double vg1Max, double vg2Max)
@@ -101,30 +179,38 @@ QString SimpleTriode::getName()
     return QString("Simple");
 }
 
+int SimpleTriode::getType()
+{
+    return SIMPLE_TRIODE;
+}
+
 void SimpleTriode::setKg(double kg)
 {
     parameter[TRI_KG]->setValue(kg);
+    invalidateInverseTable();
 }
 
 void SimpleTriode::setMu(double mu)
 {
     parameter[TRI_MU]->setValue(mu);
+    invalidateInverseTable();
 }
 
 void SimpleTriode::setAlpha(double alpha)
 {
     parameter[TRI_ALPHA]->setValue(alpha);
+    invalidateInverseTable();
 }
 
 void SimpleTriode::setVct(double vct)
 {
     parameter[TRI_VCT]->setValue(vct);
+    invalidateInverseTable();
 }
 
 void SimpleTriode::setOptions()
 {
     options.max_num_iterations = 100;
-    options.minimizer_progress_to_stdout = true;
 
     setLowerBound(parameter[TRI_KG], 0.0000001); // Kg > 0
     setLimits(parameter[TRI_ALPHA], 1.0, 2.0); // 1.0 <= alpha <= 2.0
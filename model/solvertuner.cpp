@@ -0,0 +1,141 @@
+#include "solvertuner.h"
+#include "modelfactory.h"
+
+#include <cmath>
+
+/**
+ * @brief SolverTuner::subsampleSize The maximum number of samples used to benchmark each candidate
+ */
+int SolverTuner::subsampleSize = 2000;
+
+QMutex SolverTuner::mutex;
+QMap<QPair<int, int>, SolverConfiguration> SolverTuner::cache;
+
+/**
+ * @brief SolverTuner::candidates
+ * @return The configurations to benchmark. Dogleg needs an exact linear solver so it is not paired
+ * with CGNR.
+ */
+QVector<SolverConfiguration> SolverTuner::candidates()
+{
+    QVector<SolverConfiguration> configurations;
+
+    ceres::LinearSolverType exactSolvers[] = { ceres::DENSE_QR, ceres::DENSE_NORMAL_CHOLESKY };
+    ceres::TrustRegionStrategyType strategies[] = { ceres::LEVENBERG_MARQUARDT, ceres::DOGLEG };
+
+    for (ceres::LinearSolverType linearSolver : exactSolvers) {
+        for (ceres::TrustRegionStrategyType trustRegion : strategies) {
+            SolverConfiguration configuration;
+            configuration.linearSolver = linearSolver;
+            configuration.trustRegion = trustRegion;
+            configurations.append(configuration);
+        }
+    }
+
+    SolverConfiguration cgnr;
+    cgnr.linearSolver = ceres::CGNR;
+    cgnr.trustRegion = ceres::LEVENBERG_MARQUARDT;
+    configurations.append(cgnr);
+
+    return configurations;
+}
+
+/**
+ * @brief SolverTuner::configuration
+ * @param model The model about to be fitted
+ * @return The cached configuration for the model's type and sample count, tuning the model first if
+ * there is none
+ */
+SolverConfiguration SolverTuner::configuration(Model *model)
+{
+    QPair<int, int> key = qMakePair(model->getType(), bucket(model->getSampleCount()));
+
+    {
+        QMutexLocker locker(&mutex);
+        if (cache.contains(key)) {
+            return cache.value(key);
+        }
+    }
+
+    SolverConfiguration chosen = tune(model); // Concurrent fits may tune the same key; the last one wins
+
+    QMutexLocker locker(&mutex);
+    cache.insert(key, chosen);
+
+    return chosen;
+}
+
+/**
+ * @brief SolverTuner::tune benchmarks every candidate configuration on a subsample of a model's data
+ * @param model The model, whose samples and current parameters are used (but not changed)
+ * @param results Receives the fit made with each candidate, in the order of candidates()
+ * @return The fastest configuration that converged or, if none did, the one with the lowest usable
+ * cost, or the default configuration if no fit was usable
+ */
+SolverConfiguration SolverTuner::tune(Model *model, QVector<FitResult> *results)
+{
+    const SampleStore &samples = model->getSamples();
+    qint64 stride = qMax((qint64) 1, (samples.size() + subsampleSize - 1) / subsampleSize);
+
+    SampleStore subsample;
+    for (qint64 i = samples.first(); i < samples.end(); i += stride) {
+        subsample.append(*samples.va(i), *samples.ia(i), *samples.vg1(i), *samples.vg2(i), *samples.ig2(i));
+    }
+
+    QVector<SolverConfiguration> configurations = candidates();
+    QVector<FitResult> fits;
+
+    int fastest = -1;
+    int cheapest = -1;
+    for (int i = 0; i < configurations.size(); i++) {
+        Model *candidate = ModelFactory::createModel(model->getType());
+        candidate->setJacobianType(model->getJacobianType());
+        candidate->setBatchSize(model->getBatchSize());
+        candidate->setParameterValues(model->getParameterValues());
+        candidate->setSolverConfiguration(configurations.at(i));
+        candidate->addSamples(subsample);
+
+        FitResult fit = candidate->solve();
+        fits.append(fit);
+        delete candidate;
+
+        if (fit.usable && fit.termination == ceres::TerminationTypeToString(ceres::CONVERGENCE)) {
+            if (fastest < 0 || fit.wallTime < fits.at(fastest).wallTime) {
+                fastest = i;
+            }
+        }
+        if (fit.usable && (cheapest < 0 || fit.cost < fits.at(cheapest).cost)) {
+            cheapest = i;
+        }
+    }
+
+    if (results != nullptr) {
+        *results = fits;
+    }
+
+    int chosen = fastest >= 0 ? fastest : cheapest;
+    if (chosen < 0) {
+        return SolverConfiguration();
+    }
+
+    qInfo("Tuned %s for %d samples: %s (%.1f ms on %lld samples)", model->getName().toLocal8Bit().constData(),
+          model->getSampleCount(), configurations.at(chosen).getName().toLocal8Bit().constData(),
+          fits.at(chosen).wallTime, subsample.size());
+
+    return configurations.at(chosen);
+}
+
+void SolverTuner::clearCache()
+{
+    QMutexLocker locker(&mutex);
+    cache.clear();
+}
+
+/**
+ * @brief SolverTuner::bucket
+ * @return The order of magnitude of the sample count (e.g. 3 for 1000 to 9999 samples)
+ */
+int SolverTuner::bucket(int samples)
+{
+    return samples > 0 ? (int) std::floor(std::log10((double) samples)) : 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QVector>
+
+#include "model.h"
+#include "fitresult.h"
+
+/**
+ * @brief The SolverTuner class
+ *
+ * Chooses the fastest Ceres solver configuration for a model. The candidates (dense QR, dense normal
+ * Cholesky and CGNR, with Levenberg-Marquardt or, for the exact factorisations, dogleg) are each used
+ * to fit the model to a subsample of its data from its current parameters. The fastest candidate that
+ * converges is chosen and cached against the model type and the order of magnitude of the sample
+ * count, so later fits of similar problems reuse it without tuning again.
+ */
+class SolverTuner
+{
+public:
+    static QVector<SolverConfiguration> candidates();
+    static SolverConfiguration configuration(Model *model);
+    static SolverConfiguration tune(Model *model, QVector<FitResult> *results = nullptr);
+    static void clearCache();
+
+    static int subsampleSize;
+
+private:
+    static int bucket(int samples);
+
+    static QMutex mutex;
+    static QMap<QPair<int, int>, SolverConfiguration> cache;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cmath>
+
+/*
+ * The triode model formulas, written once as templates so that the same code is used to fit the
+ * models (instantiated for double in the analytic cost functions and for ceres::Jet in the automatic
+ * differentiation cost functions) and to evaluate them (for double, or float where precision allows).
+ *
+ * Each model has a plain parameter struct that is filled once from the model's Parameters (or from
+ * the solver's parameter blocks) so that a loop over many samples binds the parameters once and the
+ * kernel is inlined into it.
+ */
+
+/**
+ * @brief softplus
+ * @param x The value for which to compute the softplus function
+ * @return log(1 + exp(x)) evaluated without overflow for large x
+ */
+template <typename T> inline T softplus(const T &x)
+{
+    using std::exp;
+    using std::log1p;
+
+    if (x > T(0)) {
+        return x + log1p(exp(-x));
+    }
+
+    return log1p(exp(x));
+}
+
+/**
+ * @brief sigmoid
+ * @param x The value for which to compute the logistic sigmoid
+ * @return 1 / (1 + exp(-x)), the derivative of softplus(x)
+ */
+template <typename T> inline T sigmoid(const T &x)
+{
+    using std::exp;
+
+    if (x > T(0)) {
+        return T(1) / (T(1) + exp(-x));
+    }
+
+    T e = exp(x);
+    return e / (T(1) + e);
+}
+
+/**
+ * @brief The SimpleTriodeParameters struct
+ */
+template <typename T> struct SimpleTriodeParameters {
+    T kg;
+    T vct;
+    T alpha;
+    T mu;
+};
+
+/**
+ * @brief The KorenTriodeParameters struct
+ */
+template <typename T> struct KorenTriodeParameters {
+    T kg;
+    T kp;
+    T kvb;
+    T alpha;
+    T mu;
+};
+
+/**
+ * @brief The ImprovedKorenTriodeParameters struct
+ */
+template <typename T> struct ImprovedKorenTriodeParameters {
+    T kg;
+    T kp;
+    T kvb;
+    T kvb2;
+    T vct;
+    T alpha;
+    T mu;
+};
+
+/**
+ * @brief The KorenTriodeTerms struct
+ *
+ * The intermediate terms of the Koren family of models, which the analytic Jacobians reuse.
+ */
+template <typename T> struct KorenTriodeTerms {
+    T x1;
+    T x2;
+    T softplus;
+    T et;
+};
+
+/**
+ * @brief simpleTriodeCurrent
+ * @param p The model parameters
+ * @param va The anode voltage
+ * @param vg1 The grid voltage
+ * @param e1t If not NULL, receives the effective voltage va / mu + vg1 + vct
+ * @return The anode current in mA, which is zero below cut-off
+ */
+template <typename T> inline T simpleTriodeCurrent(const SimpleTriodeParameters<T> &p, const T &va, const T &vg1, T *e1t = nullptr)
+{
+    using std::pow;
+
+    T e = va / p.mu + vg1 + p.vct;
+    if (e1t != nullptr) {
+        *e1t = e;
+    }
+
+    if (e > T(0)) {
+        return pow(e, p.alpha) / p.kg;
+    }
+
+    return T(0);
+}
+
+/**
+ * @brief improvedKorenTriodeCurrent
+ * @param p The model parameters
+ * @param va The anode voltage
+ * @param vg1 The grid voltage
+ * @param terms If not NULL, receives the intermediate terms
+ * @return The anode current in mA
+ */
+template <typename T> inline T improvedKorenTriodeCurrent(const ImprovedKorenTriodeParameters<T> &p, const T &va, const T &vg1, KorenTriodeTerms<T> *terms = nullptr)
+{
+    using std::pow;
+    using std::sqrt;
+
+    T x1 = sqrt(p.kvb + va * va + p.kvb2 * va);
+    T x2 = p.kp * (T(1) / p.mu + (vg1 + p.vct) / x1);
+    T x3 = softplus(x2);
+    T et = (va / p.kp) * x3;
+
+    if (terms != nullptr) {
+        terms->x1 = x1;
+        terms->x2 = x2;
+        terms->softplus = x3;
+        terms->et = et;
+    }
+
+    if (et > T(0)) {
+        return pow(et, p.alpha) / p.kg;
+    }
+
+    return T(0);
+}
+
+/**
+ * @brief korenTriodeCurrent
+ * @return The anode current in mA, i.e. that of the Improved Koren model with kvb2 and vct of zero
+ */
+template <typename T> inline T korenTriodeCurrent(const KorenTriodeParameters<T> &p, const T &va, const T &vg1, KorenTriodeTerms<T> *terms = nullptr)
+{
+    ImprovedKorenTriodeParameters<T> improved = { p.kg, p.kp, p.kvb, T(0), T(0), p.alpha, p.mu };
+
+    return improvedKorenTriodeCurrent(improved, va, vg1, terms);
+}
+
+/**
+ * @brief simpleTriodeGradient
+ * @param p The model parameters
+ * @param va The anode voltage
+ * @param vg1 The grid voltage
+ * @param dIaDva Receives the derivative of the anode current w.r.t. va
+ * @param dIaDvg1 Receives the derivative of the anode current w.r.t. vg1
+ * @return The anode current in mA
+ */
+template <typename T> inline T simpleTriodeGradient(const SimpleTriodeParameters<T> &p, const T &va, const T &vg1, T *dIaDva, T *dIaDvg1)
+{
+    T e;
+    T ia = simpleTriodeCurrent(p, va, vg1, &e);
+    T dIaDe = ia > T(0) ? p.alpha * ia / e : T(0);
+
+    *dIaDva = dIaDe / p.mu;
+    *dIaDvg1 = dIaDe;
+
+    return ia;
+}
+
+/**
+ * @brief improvedKorenTriodeGradient
+ * @param p The model parameters
+ * @param va The anode voltage
+ * @param vg1 The grid voltage
+ * @param dIaDva Receives the derivative of the anode current w.r.t. va
+ * @param dIaDvg1 Receives the derivative of the anode current w.r.t. vg1
+ * @return The anode current in mA
+ */
+template <typename T> inline T improvedKorenTriodeGradient(const ImprovedKorenTriodeParameters<T> &p, const T &va, const T &vg1, T *dIaDva, T *dIaDvg1)
+{
+    KorenTriodeTerms<T> terms;
+    T ia = improvedKorenTriodeCurrent(p, va, vg1, &terms);
+
+    if (!(ia > T(0))) {
+        *dIaDva = T(0);
+        *dIaDvg1 = T(0);
+        return ia;
+    }
+
+    T dIaDet = p.alpha * ia / terms.et;
+    T s = sigmoid(terms.x2);
+    T dx1 = (T(2) * va + p.kvb2) / (T(2) * terms.x1);
+    T dx2 = -p.kp * (vg1 + p.vct) * dx1 / (terms.x1 * terms.x1);
+
+    *dIaDva = dIaDet * (terms.softplus + va * s * dx2) / p.kp;
+    *dIaDvg1 = dIaDet * va * s / terms.x1;
+
+    return ia;
+}
+
+/**
+ * @brief korenTriodeGradient
+ * @return The anode current in mA and its derivatives, as for improvedKorenTriodeGradient
+ */
+template <typename T> inline T korenTriodeGradient(const KorenTriodeParameters<T> &p, const T &va, const T &vg1, T *dIaDva, T *dIaDvg1)
+{
+    ImprovedKorenTriodeParameters<T> improved = { p.kg, p.kp, p.kvb, T(0), T(0), p.alpha, p.mu };
+
+    return improvedKorenTriodeGradient(improved, va, vg1, dIaDva, dIaDvg1);
+}
@@ -0,0 +1,58 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "../model/batchfitter.h"
+#include "../model/fittelemetry.h"
+
+/**
+ * Command line front end for BatchFitter:
+ *
+ *     batchfit [-j threads] [--telemetry fits.jsonl] <input directory> <output directory>
+ *
+ * Returns 0 if every device was fitted successfully.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("batchfit");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fits every measurement file in a directory and writes the model for each device");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Directory of measurement files");
+    parser.addPositionalArgument("output", "Directory for the fitted models and summary.csv");
+
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads", "Number of devices to fit at once (default: all cores)", "threads");
+    parser.addOption(threadsOption);
+    QCommandLineOption telemetryOption("telemetry", "Append a Json line describing every fit to this file", "file");
+    parser.addOption(telemetryOption);
+
+    parser.process(app);
+
+    QStringList arguments = parser.positionalArguments();
+    if (arguments.size() != 2) {
+        parser.showHelp(1);
+    }
+
+    if (parser.isSet(telemetryOption)) {
+        FitTelemetry::setLogFile(parser.value(telemetryOption));
+    }
+
+    BatchFitter fitter(arguments.at(0), arguments.at(1));
+    if (parser.isSet(threadsOption)) {
+        fitter.setThreadCount(parser.value(threadsOption).toInt());
+    }
+
+    QVector<BatchFitRecord> records = fitter.run();
+
+    int failures = 0;
+    for (int i = 0; i < records.size(); i++) {
+        if (!records.at(i).success) {
+            failures++;
+        }
+    }
+
+    qInfo("Fitted %d of %d devices", (int) records.size() - failures, (int) records.size());
+
+    return failures == 0 ? 0 : 1;
+}
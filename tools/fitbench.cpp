@@ -0,0 +1,59 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "../model/modelbenchmark.h"
+
+/**
+ * Command line front end for ModelBenchmark:
+ *
+ *     fitbench [-s 1000,10000,100000] [-t tolerance] [-o report.csv]
+ *
+ * Returns 0 if every model recovered the known parameters at every size.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("fitbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks model fitting on synthetic triode and pentode datasets generated from known parameters");
+    parser.addHelpOption();
+
+    QCommandLineOption sizesOption(QStringList() << "s" << "sizes", "Comma separated dataset sizes (default: 1000,10000,100000)", "sizes", "1000,10000,100000");
+    parser.addOption(sizesOption);
+    QCommandLineOption toleranceOption(QStringList() << "t" << "tolerance", "Relative error allowed for each recovered parameter (default: 0.02)", "tolerance", "0.02");
+    parser.addOption(toleranceOption);
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "CSV report to write", "file");
+    parser.addOption(outputOption);
+
+    parser.process(app);
+
+    QVector<int> sizes;
+    QStringList sizeList = parser.value(sizesOption).split(',');
+    for (int i = 0; i < sizeList.size(); i++) {
+        int size = sizeList.at(i).toInt();
+        if (size > 0) {
+            sizes.append(size);
+        }
+    }
+    if (sizes.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    QVector<BenchmarkRecord> records = ModelBenchmark::runAll(sizes, parser.value(toleranceOption).toDouble());
+
+    if (parser.isSet(outputOption)) {
+        ModelBenchmark::writeReport(records, parser.value(outputOption));
+    }
+
+    int failures = 0;
+    for (int i = 0; i < records.size(); i++) {
+        if (!records.at(i).recovered) {
+            failures++;
+        }
+    }
+
+    qInfo("%d of %d fits recovered the known parameters", (int) records.size() - failures, (int) records.size());
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "../model/modelbenchmark.h"
+
+/**
+ * Command line front end for ModelBenchmark::checkJacobians:
+ *
+ *     jacobiancheck [-t tolerance]
+ *
+ * Compares the analytic cost function of each triode model with its automatic differentiation reference
+ * over a grid of anode and grid voltages. Returns 0 if every model agrees within the tolerance.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("jacobiancheck");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Checks the analytic Jacobians of the triode models against automatic differentiation");
+    parser.addHelpOption();
+
+    QCommandLineOption toleranceOption(QStringList() << "t" << "tolerance", "Relative difference allowed (default: 1e-6)", "tolerance", "1e-6");
+    parser.addOption(toleranceOption);
+
+    parser.process(app);
+
+    double tolerance = parser.value(toleranceOption).toDouble();
+
+    int failures = 0;
+    for (int modelType = SIMPLE_TRIODE; modelType <= IMPROVED_KOREN_TRIODE; modelType++) {
+        JacobianCheckRecord record = ModelBenchmark::checkJacobians(modelType, tolerance);
+        qInfo("%-24s %d points, largest relative difference %.3g at va = %.1f, vg1 = %.2f: %s", qPrintable(record.modelName),
+              record.points, record.maxError, record.worstVa, record.worstVg1, record.passed ? "ok" : "MISMATCH");
+        if (!record.passed) {
+            failures++;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonDocument>
+
+#include "../model/device.h"
+#include "../circuit/commoncathodemontecarlo.h"
+#include "../ui/parameter.h"
+
+/**
+ * Command line front end for CommonCathodeMonteCarlo:
+ *
+ *     stagemontecarlo [--vb 300] [--ra 100k] [--rk 1.5k] [--resistor-tolerance 0.05] [--model-spread 0.02] [-n 1M] <model.json> [tube.json ...]
+ *
+ * With one model, every trial perturbs its parameters by --model-spread. With several (fitted tubes of
+ * the same type), each trial picks one of them at random, perturbed by --model-spread if it is given.
+ * Reports the distributions of the bias point and gain and, with --output, writes every trial as CSV.
+ */
+
+/**
+ * @brief report prints the distribution of one result
+ * @param monteCarlo The Monte Carlo analysis that has been run
+ * @param column The eMonteCarloColumn
+ */
+static void report(const CommonCathodeMonteCarlo &monteCarlo, int column)
+{
+    MonteCarloStatistics statistics = monteCarlo.getStatistics(column);
+    qInfo("%-16s mean %10.4g  sd %10.4g (%5.2f%%)  min %10.4g  1%% %10.4g  median %10.4g  99%% %10.4g  max %10.4g",
+          qPrintable(CommonCathodeMonteCarlo::getColumnName(column)), statistics.mean, statistics.deviation,
+          statistics.mean != 0.0 ? 100.0 * statistics.deviation / qAbs(statistics.mean) : 0.0, statistics.minimum,
+          statistics.percentile1, statistics.median, statistics.percentile99, statistics.maximum);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("stagemontecarlo");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Monte Carlo tolerance analysis of a triode common cathode stage");
+    parser.addHelpOption();
+    parser.addPositionalArgument("model", "The fitted device model (Json)");
+    parser.addPositionalArgument("tubes", "Further fitted tubes of the same type to draw from (Json)", "[tube.json ...]");
+
+    QCommandLineOption vbOption("vb", "Supply voltage (default: 300)", "volts", "300");
+    parser.addOption(vbOption);
+    QCommandLineOption raOption("ra", "Anode resistor (default: 100k)", "ohms", "100k");
+    parser.addOption(raOption);
+    QCommandLineOption rkOption("rk", "Cathode resistor (default: 1.5k)", "ohms", "1.5k");
+    parser.addOption(rkOption);
+    QCommandLineOption supplyToleranceOption("supply-tolerance", "Relative tolerance of the supply, uniform (default: 0)", "tolerance", "0");
+    parser.addOption(supplyToleranceOption);
+    QCommandLineOption resistorToleranceOption("resistor-tolerance", "Relative tolerance of the resistors, uniform (default: 0.05)", "tolerance", "0.05");
+    parser.addOption(resistorToleranceOption);
+    QCommandLineOption modelSpreadOption("model-spread", "Relative standard deviation of every model parameter (default: 0.02 for one model, 0 for a set of tubes)", "spread");
+    parser.addOption(modelSpreadOption);
+    QCommandLineOption trialsOption(QStringList() << "n" << "trials", "Number of trials (default: 1M)", "trials", "1M");
+    parser.addOption(trialsOption);
+    QCommandLineOption seedOption("seed", "Random seed (default: 1)", "seed", "1");
+    parser.addOption(seedOption);
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads", "Number of threads (default: all cores)", "threads");
+    parser.addOption(threadsOption);
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Write every trial to this CSV file", "file");
+    parser.addOption(outputOption);
+
+    parser.process(app);
+
+    QStringList arguments = parser.positionalArguments();
+    if (arguments.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    QList<Device *> devices;
+    for (int i = 0; i < arguments.size(); i++) {
+        QFile modelFile(arguments.at(i));
+        if (!modelFile.open(QIODevice::ReadOnly)) {
+            qWarning("Unable to open %s", qPrintable(arguments.at(i)));
+            qDeleteAll(devices);
+            return 1;
+        }
+        devices.append(new Device(QJsonDocument::fromJson(modelFile.readAll())));
+    }
+
+    CommonCathodeMonteCarlo monteCarlo(devices.first());
+    if (devices.size() > 1) {
+        for (int i = 0; i < devices.size(); i++) {
+            if (!monteCarlo.addTube(devices.at(i))) {
+                qDeleteAll(devices);
+                return 1;
+            }
+        }
+    }
+
+    QCommandLineOption *nominalOptions[] = { &vbOption, &rkOption, &raOption };
+    for (int index = TRI_CC_VB; index <= TRI_CC_RA; index++) {
+        bool ok;
+        double value = Parameter::parseValue(parser.value(*nominalOptions[index]), &ok);
+        if (!ok || value <= 0.0) {
+            qWarning("Invalid value %s for --%s", qPrintable(parser.value(*nominalOptions[index])), qPrintable(nominalOptions[index]->names().last()));
+            qDeleteAll(devices);
+            return 1;
+        }
+        monteCarlo.setNominal(index, value);
+    }
+
+    Tolerance supplyTolerance;
+    supplyTolerance.distribution = DISTRIBUTION_UNIFORM;
+    supplyTolerance.spread = parser.value(supplyToleranceOption).toDouble();
+    monteCarlo.setTolerance(TRI_CC_VB, supplyTolerance);
+
+    Tolerance resistorTolerance;
+    resistorTolerance.distribution = DISTRIBUTION_UNIFORM;
+    resistorTolerance.spread = parser.value(resistorToleranceOption).toDouble();
+    monteCarlo.setTolerance(TRI_CC_RA, resistorTolerance);
+    monteCarlo.setTolerance(TRI_CC_RK, resistorTolerance);
+
+    Tolerance modelTolerance;
+    modelTolerance.distribution = DISTRIBUTION_NORMAL;
+    modelTolerance.spread = parser.isSet(modelSpreadOption) ? parser.value(modelSpreadOption).toDouble() : (devices.size() > 1 ? 0.0 : 0.02);
+    for (int i = 0; i < MODEL_PARAMETERS; i++) {
+        monteCarlo.setModelTolerance(i, modelTolerance);
+    }
+
+    monteCarlo.setSeed(parser.value(seedOption).toULongLong());
+    if (parser.isSet(threadsOption)) {
+        monteCarlo.setThreadCount(parser.value(threadsOption).toInt());
+    }
+
+    bool ok;
+    double trialCount = Parameter::parseValue(parser.value(trialsOption), &ok);
+    qint64 trials = ok && trialCount >= 1.0 && trialCount <= 1.0e15 ? (qint64) trialCount : 0;
+    if (trials < 1 || trials != trialCount) { // A whole number, so 1k and 1M but not 1m or 2.5
+        qWarning("Invalid number of trials %s", qPrintable(parser.value(trialsOption)));
+        qDeleteAll(devices);
+        return 1;
+    }
+
+    monteCarlo.run(trials);
+
+    qInfo("Solved %lld trials in %.1f ms (%.2f million trials/s), %.1f evaluations per trial, %lld unconverged",
+          trials, monteCarlo.getWallTime(), monteCarlo.getWallTime() > 0.0 ? trials / monteCarlo.getWallTime() / 1000.0 : 0.0,
+          (double) monteCarlo.getEvaluations() / trials, monteCarlo.getUnconverged());
+
+    const int columns[] = { MC_IA, MC_VA, MC_VK, MC_GAIN, MC_GAIN_UNBYPASSED, MC_DISSIPATION };
+    for (int i = 0; i < 6; i++) {
+        report(monteCarlo, columns[i]);
+    }
+
+    bool written = !parser.isSet(outputOption) || monteCarlo.writeCsv(parser.value(outputOption));
+
+    qDeleteAll(devices);
+
+    return written ? 0 : 1;
+}
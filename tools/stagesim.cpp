@@ -0,0 +1,289 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonDocument>
+#include <QtEndian>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "../model/device.h"
+#include "../circuit/commoncathodesimulator.h"
+#include "../ui/parameter.h"
+
+/**
+ * Command line front end for CommonCathodeSimulator:
+ *
+ *     stagesim [--vb 300] [--ra 100k] [--rk 1.5k] [--ck 22u] [--ci 22n] [--co 22n] [-x 2] <model.json> <input.wav> <output.wav>
+ *     stagesim --sine 10 [options] <model.json> [output.wav]
+ *
+ * Runs a wav file (16, 24 or 32 bit PCM, or 32 bit float) through a common cathode stage built around
+ * the fitted device, one simulator per channel, and writes the result as 32 bit float (the output is
+ * not clipped). With --sine, a 1 kHz sine at 48 kHz is simulated instead. Reports the bias point and
+ * how many times faster than real time the simulation ran.
+ */
+
+/**
+ * @brief The WavData struct
+ *
+ * The samples of a wav file, one vector per channel, normalised to +/-1 full scale.
+ */
+struct WavData {
+    int sampleRate = 48000;
+    std::vector<std::vector<float>> channels;
+};
+
+/**
+ * @brief readWav
+ * @param fileName The wav file to read
+ * @param wav Receives the sample rate and samples
+ * @return true if the file was read
+ */
+static bool readWav(const QString &fileName, WavData *wav)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning("Unable to open %s", qPrintable(fileName));
+        return false;
+    }
+
+    QByteArray contents = file.readAll();
+    const uchar *data = reinterpret_cast<const uchar *>(contents.constData());
+    if (contents.size() < 12 || contents.left(4) != "RIFF" || contents.mid(8, 4) != "WAVE") {
+        qWarning("%s is not a wav file", qPrintable(fileName));
+        return false;
+    }
+
+    int format = 0;
+    int channelCount = 0;
+    int bits = 0;
+    int position = 12;
+    while (position + 8 <= contents.size()) {
+        QByteArray id = contents.mid(position, 4);
+        int size = (int) qFromLittleEndian<quint32>(data + position + 4);
+        int start = position + 8;
+        if (size < 0 || start + size > contents.size()) {
+            size = contents.size() - start;
+        }
+
+        if (id == "fmt " && size >= 16) {
+            format = qFromLittleEndian<quint16>(data + start);
+            channelCount = qFromLittleEndian<quint16>(data + start + 2);
+            wav->sampleRate = (int) qFromLittleEndian<quint32>(data + start + 4);
+            bits = qFromLittleEndian<quint16>(data + start + 14);
+            if (format == 0xFFFE && size >= 26) { // WAVE_FORMAT_EXTENSIBLE: the format is in the sub-format
+                format = qFromLittleEndian<quint16>(data + start + 24);
+            }
+        } else if (id == "data") {
+            bool pcm = format == 1 && (bits == 16 || bits == 24 || bits == 32);
+            bool floating = format == 3 && bits == 32;
+            if (channelCount < 1 || !(pcm || floating)) {
+                qWarning("%s: unsupported format %d with %d bits", qPrintable(fileName), format, bits);
+                return false;
+            }
+
+            int bytes = bits / 8;
+            int frames = size / (bytes * channelCount);
+            wav->channels.assign(channelCount, std::vector<float>(frames));
+
+            const uchar *sample = data + start;
+            for (int i = 0; i < frames; i++) {
+                for (int c = 0; c < channelCount; c++) {
+                    float value;
+                    if (floating) {
+                        quint32 word = qFromLittleEndian<quint32>(sample);
+                        memcpy(&value, &word, sizeof(value));
+                    } else if (bits == 16) {
+                        value = qFromLittleEndian<qint16>(sample) / 32768.0f;
+                    } else if (bits == 24) {
+                        qint32 word = (qint32) ((quint32) sample[0] << 8 | (quint32) sample[1] << 16 | (quint32) sample[2] << 24);
+                        value = (word >> 8) / 8388608.0f;
+                    } else {
+                        value = (float) (qFromLittleEndian<qint32>(sample) / 2147483648.0);
+                    }
+                    wav->channels[c][i] = value;
+                    sample += bytes;
+                }
+            }
+
+            return true;
+        }
+
+        position = start + size + (size & 1);
+    }
+
+    qWarning("%s has no audio data", qPrintable(fileName));
+    return false;
+}
+
+/**
+ * @brief writeWav writes 32 bit float samples
+ * @param fileName The wav file to write
+ * @param wav The sample rate and samples
+ * @return true if the file was written
+ */
+static bool writeWav(const QString &fileName, const WavData &wav)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("Unable to create %s", qPrintable(fileName));
+        return false;
+    }
+
+    int channelCount = (int) wav.channels.size();
+    int frames = channelCount > 0 ? (int) wav.channels[0].size() : 0;
+    quint32 dataSize = (quint32) frames * channelCount * 4;
+
+    QByteArray header(44, 0);
+    uchar *data = reinterpret_cast<uchar *>(header.data());
+    memcpy(data, "RIFF", 4);
+    qToLittleEndian<quint32>(36 + dataSize, data + 4);
+    memcpy(data + 8, "WAVEfmt ", 8);
+    qToLittleEndian<quint32>(16, data + 16);
+    qToLittleEndian<quint16>(3, data + 20);
+    qToLittleEndian<quint16>(channelCount, data + 22);
+    qToLittleEndian<quint32>(wav.sampleRate, data + 24);
+    qToLittleEndian<quint32>(wav.sampleRate * channelCount * 4, data + 28);
+    qToLittleEndian<quint16>(channelCount * 4, data + 32);
+    qToLittleEndian<quint16>(32, data + 34);
+    memcpy(data + 36, "data", 4);
+    qToLittleEndian<quint32>(dataSize, data + 40);
+
+    QByteArray samples(dataSize, 0);
+    uchar *sample = reinterpret_cast<uchar *>(samples.data());
+    for (int i = 0; i < frames; i++) {
+        for (int c = 0; c < channelCount; c++) {
+            quint32 word;
+            memcpy(&word, &wav.channels[c][i], sizeof(word));
+            qToLittleEndian<quint32>(word, sample);
+            sample += 4;
+        }
+    }
+
+    return file.write(header) == header.size() && file.write(samples) == samples.size();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("stagesim");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulates a triode common cathode stage on an audio file");
+    parser.addHelpOption();
+    parser.addPositionalArgument("model", "The fitted device model (Json)");
+    parser.addPositionalArgument("input", "The input wav file (omitted with --sine)");
+    parser.addPositionalArgument("output", "The output wav file (optional with --sine)");
+
+    QCommandLineOption vbOption("vb", "Supply voltage (default: 300)", "volts", "300");
+    parser.addOption(vbOption);
+    QCommandLineOption raOption("ra", "Anode resistor (default: 100k)", "ohms", "100k");
+    parser.addOption(raOption);
+    QCommandLineOption rkOption("rk", "Cathode resistor (default: 1.5k)", "ohms", "1.5k");
+    parser.addOption(rkOption);
+    QCommandLineOption ckOption("ck", "Cathode bypass capacitor (default: none)", "farads", "0");
+    parser.addOption(ckOption);
+    QCommandLineOption ciOption("ci", "Input coupling capacitor (default: none)", "farads", "0");
+    parser.addOption(ciOption);
+    QCommandLineOption rgOption("rg", "Grid leak resistor (default: 1M)", "ohms", "1M");
+    parser.addOption(rgOption);
+    QCommandLineOption coOption("co", "Output coupling capacitor (default: none)", "farads", "0");
+    parser.addOption(coOption);
+    QCommandLineOption rlOption("rl", "Load resistor (default: 1M)", "ohms", "1M");
+    parser.addOption(rlOption);
+    QCommandLineOption oversamplingOption(QStringList() << "x" << "oversampling", "Oversampling factor (default: 1)", "factor", "1");
+    parser.addOption(oversamplingOption);
+    QCommandLineOption inputScaleOption("input-scale", "Grid voltage of a full scale input (default: 1)", "volts", "1");
+    parser.addOption(inputScaleOption);
+    QCommandLineOption outputScaleOption("output-scale", "Output voltage written as full scale (default: 100)", "volts", "100");
+    parser.addOption(outputScaleOption);
+    QCommandLineOption blockOption(QStringList() << "b" << "block", "Samples per processing block (default: 1024)", "samples", "1024");
+    parser.addOption(blockOption);
+    QCommandLineOption sineOption("sine", "Simulate this many seconds of a full scale 1 kHz sine instead of a file", "seconds");
+    parser.addOption(sineOption);
+
+    parser.process(app);
+
+    QStringList arguments = parser.positionalArguments();
+    bool sine = parser.isSet(sineOption);
+    if (arguments.size() < (sine ? 1 : 3) || arguments.size() > (sine ? 2 : 3)) {
+        parser.showHelp(1);
+    }
+
+    CommonCathodeStage stage;
+    QCommandLineOption *componentOptions[] = { &raOption, &rkOption, &ckOption, &ciOption, &rgOption, &coOption, &rlOption };
+    double *components[] = { &stage.ra, &stage.rk, &stage.ck, &stage.ci, &stage.rg, &stage.co, &stage.rl };
+    for (int i = 0; i < 7; i++) {
+        bool ok;
+        *components[i] = Parameter::parseValue(parser.value(*componentOptions[i]), &ok);
+        if (!ok || *components[i] < 0.0) {
+            qWarning("Invalid value %s for --%s", qPrintable(parser.value(*componentOptions[i])), qPrintable(componentOptions[i]->names().last()));
+            return 1;
+        }
+    }
+    stage.vb = parser.value(vbOption).toDouble();
+
+    if (!(stage.vb > 0.0 && stage.ra > 0.0 && stage.rk > 0.0 && stage.rg > 0.0 && stage.rl > 0.0)) {
+        qWarning("The supply voltage and resistors must be positive");
+        return 1;
+    }
+
+    QFile modelFile(arguments.at(0));
+    if (!modelFile.open(QIODevice::ReadOnly)) {
+        qWarning("Unable to open %s", qPrintable(arguments.at(0)));
+        return 1;
+    }
+    Device device(QJsonDocument::fromJson(modelFile.readAll()));
+
+    WavData wav;
+    if (sine) {
+        int frames = (int) (parser.value(sineOption).toDouble() * wav.sampleRate);
+        wav.channels.assign(1, std::vector<float>(qMax(0, frames)));
+        const double pi = 3.14159265358979323846;
+        for (int i = 0; i < frames; i++) {
+            wav.channels[0][i] = (float) std::sin(2.0 * pi * 1000.0 * i / wav.sampleRate);
+        }
+    } else if (!readWav(arguments.at(1), &wav)) {
+        return 1;
+    }
+
+    int oversampling = qMax(1, parser.value(oversamplingOption).toInt());
+    int blockSize = qMax(1, parser.value(blockOption).toInt());
+
+    double processingTime = 0.0;
+    qint64 steps = 0;
+    qint64 evaluations = 0;
+    for (size_t c = 0; c < wav.channels.size(); c++) {
+        CommonCathodeSimulator simulator(&device, stage, wav.sampleRate, oversampling);
+        simulator.setInputScale(parser.value(inputScaleOption).toDouble());
+        simulator.setOutputScale(parser.value(outputScaleOption).toDouble());
+
+        if (c == 0) {
+            qInfo("Bias: ia = %.3f mA, va = %.1f V, vk = %.3f V", simulator.getBiasCurrent(), simulator.getBiasAnodeVoltage(), simulator.getBiasCathodeVoltage());
+        }
+
+        std::vector<float> &samples = wav.channels[c];
+        for (size_t i = 0; i < samples.size(); i += blockSize) {
+            int count = (int) qMin((size_t) blockSize, samples.size() - i);
+            simulator.process(samples.data() + i, samples.data() + i, count);
+        }
+
+        const SimulationStatistics &statistics = simulator.getStatistics();
+        processingTime += statistics.processingTime;
+        steps += statistics.steps;
+        evaluations += statistics.evaluations;
+    }
+
+    double duration = wav.channels.empty() ? 0.0 : (double) wav.channels[0].size() * wav.channels.size() / wav.sampleRate;
+    qInfo("Simulated %.2f s of audio (%d channels) at %dx oversampling in %.1f ms: %.0fx real time per core, %.2f model evaluations per step",
+          duration / qMax((size_t) 1, wav.channels.size()), (int) wav.channels.size(), oversampling, processingTime,
+          processingTime > 0.0 ? duration / (processingTime / 1000.0) : 0.0, steps > 0 ? (double) evaluations / steps : 0.0);
+
+    QString outputName = sine ? (arguments.size() > 1 ? arguments.at(1) : QString()) : arguments.at(2);
+    if (!outputName.isEmpty() && !writeWav(outputName, wav)) {
+        return 1;
+    }
+
+    return 0;
+}
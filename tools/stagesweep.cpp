@@ -0,0 +1,137 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonDocument>
+
+#include "../model/device.h"
+#include "../circuit/commoncathodesweep.h"
+#include "../ui/parameter.h"
+
+/**
+ * Command line front end for CommonCathodeSweep:
+ *
+ *     stagesweep [--vb 150:450:100] [--ra 22k:470k:100] [--rk 220:22k:100] [-j threads] <model.json> [output]
+ *
+ * Each range is start:stop:steps; the resistors are stepped by a constant ratio. The result is written
+ * as CSV if the output name ends in .csv and as a columnar binary file (CommonCathodeSweep::save)
+ * otherwise. Reports the sweep rate and the highest gain found within the device's anode dissipation.
+ */
+
+/**
+ * @brief parseRange
+ * @param text A range start:stop:steps, or a single value, with values as for Parameter::parseValue
+ * @param logarithmic Whether the range is stepped by a constant ratio
+ * @param range Receives the range
+ * @return true if the range was parsed
+ */
+static bool parseRange(const QString &text, bool logarithmic, SweepRange *range)
+{
+    QStringList fields = text.split(':');
+    if (fields.size() != 1 && fields.size() != 3) {
+        return false;
+    }
+
+    double values[2];
+    for (int i = 0; i < qMin(2, fields.size()); i++) {
+        bool ok;
+        values[i] = Parameter::parseValue(fields.at(i), &ok);
+        if (!ok || values[i] <= 0.0) {
+            return false;
+        }
+    }
+
+    bool ok = true;
+    range->start = values[0];
+    range->stop = fields.size() == 3 ? values[1] : values[0];
+    range->steps = fields.size() == 3 ? fields.at(2).trimmed().toInt(&ok) : 1;
+    range->logarithmic = logarithmic;
+
+    return ok && range->steps >= 1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("stagesweep");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Sweeps the supply voltage and resistors of a triode common cathode stage");
+    parser.addHelpOption();
+    parser.addPositionalArgument("model", "The fitted device model (Json)");
+    parser.addPositionalArgument("output", "The result file (.csv for CSV, otherwise columnar binary)");
+
+    QCommandLineOption vbOption("vb", "Supply voltage range (default: 150:450:100)", "range", "150:450:100");
+    parser.addOption(vbOption);
+    QCommandLineOption raOption("ra", "Anode resistor range (default: 22k:470k:100)", "range", "22k:470k:100");
+    parser.addOption(raOption);
+    QCommandLineOption rkOption("rk", "Cathode resistor range (default: 220:22k:100)", "range", "220:22k:100");
+    parser.addOption(rkOption);
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads", "Number of threads (default: all cores)", "threads");
+    parser.addOption(threadsOption);
+
+    parser.process(app);
+
+    QStringList arguments = parser.positionalArguments();
+    if (arguments.size() < 1 || arguments.size() > 2) {
+        parser.showHelp(1);
+    }
+
+    QFile modelFile(arguments.at(0));
+    if (!modelFile.open(QIODevice::ReadOnly)) {
+        qWarning("Unable to open %s", qPrintable(arguments.at(0)));
+        return 1;
+    }
+    Device device(QJsonDocument::fromJson(modelFile.readAll()));
+
+    CommonCathodeSweep sweep(&device);
+
+    QCommandLineOption *rangeOptions[] = { &vbOption, &rkOption, &raOption };
+    for (int index = TRI_CC_VB; index <= TRI_CC_RA; index++) {
+        SweepRange range;
+        if (!parseRange(parser.value(*rangeOptions[index]), index != TRI_CC_VB, &range)) {
+            qWarning("Invalid range %s", qPrintable(parser.value(*rangeOptions[index])));
+            return 1;
+        }
+        sweep.setRange(index, range);
+    }
+
+    if (parser.isSet(threadsOption)) {
+        sweep.setThreadCount(parser.value(threadsOption).toInt());
+    }
+
+    qint64 points = sweep.run();
+
+    qInfo("Swept %lld points in %.1f ms (%.2f million points/s), %.1f evaluations per point, %lld unconverged",
+          points, sweep.getWallTime(), sweep.getWallTime() > 0.0 ? points / sweep.getWallTime() / 1000.0 : 0.0,
+          points > 0 ? (double) sweep.getEvaluations() / points : 0.0, sweep.getUnconverged());
+
+    const std::vector<double> &gain = sweep.getColumn(SWEEP_GAIN);
+    const std::vector<double> &ratio = sweep.getColumn(SWEEP_DISSIPATION_RATIO);
+    qint64 best = -1;
+    qint64 withinPaMax = 0;
+    for (qint64 i = 0; i < points; i++) {
+        if (ratio[i] <= 1.0) {
+            withinPaMax++;
+            if (best < 0 || gain[i] > gain[best]) {
+                best = i;
+            }
+        }
+    }
+
+    qInfo("%lld points within paMax", withinPaMax);
+    if (best >= 0) {
+        qInfo("Highest gain within paMax: %.1f at vb = %.0f V, ra = %.0f, rk = %.0f (ia = %.3f mA, headroom %.1f V, %.0f%% of paMax)",
+              gain[best], sweep.getColumn(SWEEP_VB)[best], sweep.getColumn(SWEEP_RA)[best], sweep.getColumn(SWEEP_RK)[best],
+              sweep.getColumn(SWEEP_IA)[best], sweep.getColumn(SWEEP_HEADROOM)[best], 100.0 * ratio[best]);
+    }
+
+    if (arguments.size() > 1) {
+        QString outputName = arguments.at(1);
+        bool written = outputName.endsWith(".csv") ? sweep.writeCsv(outputName) : sweep.save(outputName);
+        if (!written) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "../model/modelbenchmark.h"
+#include "../model/anodetable.h"
+
+/**
+ * Command line front end for ModelBenchmark::runTable:
+ *
+ *     tablebench [-e 0.01,0.001,0.0001]
+ *
+ * Builds cubic and monotone tables of each triode model for each error bound and reports their size,
+ * build time, lookups per second (against the model's own batch evaluation) and measured error.
+ * Returns 0 if every table met its error bound.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("tablebench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks interpolated anode current tables against the analytic models");
+    parser.addHelpOption();
+
+    QCommandLineOption errorsOption(QStringList() << "e" << "errors", "Comma separated error bounds in mA (default: 0.01,0.001,0.0001)", "errors", "0.01,0.001,0.0001");
+    parser.addOption(errorsOption);
+
+    parser.process(app);
+
+    QStringList errors = parser.value(errorsOption).split(',');
+
+    int failures = 0;
+    for (int i = 0; i < errors.size(); i++) {
+        double targetError = errors.at(i).toDouble();
+        if (targetError <= 0.0) {
+            continue;
+        }
+
+        for (int modelType = SIMPLE_TRIODE; modelType <= IMPROVED_KOREN_TRIODE; modelType++) {
+            for (int interpolation = TABLE_CUBIC; interpolation <= TABLE_MONOTONE; interpolation++) {
+                TableBenchmarkRecord record = ModelBenchmark::runTable(modelType, targetError, interpolation);
+                if (record.maxError > targetError) {
+                    failures++;
+                }
+            }
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -24,3 +24,28 @@ double *Parameter::getPointer()
 {
     return &value;
 }
+
+/**
+ * @brief Parameter::parseValue reads a value with an optional SI suffix
+ * @param text The value, e.g. 100k, 1.5k, 22u, 4n7 or 1M (a suffix within the digits stands for the point)
+ * @param ok Set to false if the value cannot be parsed
+ * @return The value, scaled by the suffix
+ */
+double Parameter::parseValue(QString text, bool *ok)
+{
+    const QString suffixes = "pnumkM";
+    const double multipliers[] = { 1.0e-12, 1.0e-9, 1.0e-6, 1.0e-3, 1.0e3, 1.0e6 };
+
+    text = text.trimmed();
+    double multiplier = 1.0;
+    for (int i = 0; i < text.size(); i++) {
+        int suffix = suffixes.indexOf(text.at(i));
+        if (suffix >= 0) {
+            multiplier = multipliers[suffix];
+            text = text.left(i) + (i < text.size() - 1 ? "." + text.mid(i + 1) : QString());
+            break;
+        }
+    }
+
+    return text.toDouble(ok) * multiplier;
+}
@@ -13,6 +13,8 @@ public:
 
     void setValue(double newValue);
 
+    static double parseValue(QString text, bool *ok);
+
 private:
     QString name;
     double value;
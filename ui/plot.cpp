@@ -18,6 +18,7 @@ void Plot::setAxes(double _xStart, double _xStop, double xMajorDivision, double
     double rounding = 0.5;
 
     scene->clear();
+    revision++;
 
     if (xScale < 0) {
         if (xMajorDivision > 0) {
@@ -115,4 +116,14 @@ QGraphicsTextItem *Plot::createLabel(double x, double y, double value)
 void Plot::clear()
 {
     scene->clear();
+    revision++;
+}
+
+/**
+ * @brief Plot::getRevision
+ * @return A count of the times the scene has been cleared, which deletes every item that was drawn on it
+ */
+int Plot::getRevision() const
+{
+    return revision;
 }
@@ -17,9 +17,11 @@ public:
     QGraphicsLineItem *createSegment(double x1, double y1, double x2, double y2, QPen pen);
     QGraphicsTextItem *createLabel(double x, double y, double value);
     void clear();
+    int getRevision() const;
 
 private:
     QGraphicsScene *scene;
+    int revision = 0;
     double xScale;
     double yScale;
     double xStart;